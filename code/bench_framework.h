@@ -0,0 +1,256 @@
+#ifndef BENCH_FRAMEWORK_H
+#define BENCH_FRAMEWORK_H
+
+#include "test_framework.h"
+#include <string.h>
+#include <time.h>
+#include <x86intrin.h>
+
+// NOTE(bruno): a BENCH body sets up whatever it needs and then puts the code
+// to time inside BENCH_LOOP, which runs it as many times as the harness asks
+// for. The harness doubles the batch size until one batch takes
+// BENCH_BATCH_NANOSECONDS, keeps running batches of that size until
+// BENCH_WARMUP_NANOSECONDS have passed and then times BENCH_SAMPLE_COUNT of
+// them. Numbers are per iteration of the loop, cycles are whatever rdtsc
+// counts, which is the reference clock and not the core clock on anything
+// recent, so turbo shows up as fewer cycles.
+#define BENCH_SAMPLE_COUNT 101
+#define BENCH_BATCH_NANOSECONDS 1000000ull
+#define BENCH_WARMUP_NANOSECONDS 50000000ull
+#define BENCH_MAX_RESULTS 64
+
+enum BenchPhase {
+	BenchPhase_Start,
+	BenchPhase_Warmup,
+	BenchPhase_Measure,
+	BenchPhase_Done,
+};
+
+struct BenchResult {
+	char name[64];
+	uint64 iterationsPerSample;
+	real64 medianCycles;
+	real64 p99Cycles;
+	real64 medianNanoseconds;
+	real64 p99Nanoseconds;
+	// NOTE(bruno): 0 when the bench doesn't say how many items an iteration
+	// works through
+	real64 cyclesPerItem;
+};
+
+struct BenchContext {
+	const char *currentBenchName;
+	// NOTE(bruno): set by the bench, pixels, samples, positions...
+	uint64 itemsPerIteration;
+
+	uint32 phase;
+	uint64 batchIterations;
+	uint64 remainingIterations;
+	uint64 batchStartCycles;
+	uint64 batchStartNanoseconds;
+	uint64 warmupStartNanoseconds;
+
+	uint32 sampleCount;
+	real64 sampleCycles[BENCH_SAMPLE_COUNT];
+	real64 sampleNanoseconds[BENCH_SAMPLE_COUNT];
+
+	uint32 resultCount;
+	BenchResult results[BENCH_MAX_RESULTS];
+};
+
+global_variable BenchContext g_benchContext = {};
+
+#define BENCH(name)                                                            \
+	void name(BenchContext *);                                                 \
+	void name##_runner() {                                                     \
+		beginBench(&g_benchContext, #name);                                    \
+		name(&g_benchContext);                                                 \
+		endBench(&g_benchContext, &g_testContext);                             \
+	}                                                                          \
+	void name(BenchContext *bench)
+
+#define RUN_BENCH(name)                                                        \
+	do {                                                                       \
+		name##_runner();                                                       \
+	} while (0)
+
+#define BENCH_LOOP(bench) while (keepBenchRunning(bench))
+
+// NOTE(bruno): makes the compiler believe value gets read, so the work that
+// produced it can't be thrown away. Needs an lvalue
+#define BENCH_KEEP(value) asm volatile("" : : "m"(value) : "memory")
+
+inline uint64 getBenchNanoseconds() {
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64)now.tv_sec * 1000000000ull + (uint64)now.tv_nsec;
+}
+
+void beginBench(BenchContext *bench, const char *name) {
+	bench->currentBenchName = name;
+	bench->itemsPerIteration = 0;
+	bench->phase = BenchPhase_Start;
+	bench->sampleCount = 0;
+	bench->remainingIterations = 0;
+	printf("\nRunning bench: %s\n", name);
+}
+
+// NOTE(bruno): runs between batches, so none of this is in the numbers
+bool startNextBenchBatch(BenchContext *bench) {
+	uint64 cycles = __rdtsc();
+	uint64 nanoseconds = getBenchNanoseconds();
+
+	if (bench->phase == BenchPhase_Start) {
+		bench->phase = BenchPhase_Warmup;
+		bench->batchIterations = 1;
+		bench->warmupStartNanoseconds = nanoseconds;
+	} else {
+		uint64 batchCycles = cycles - bench->batchStartCycles;
+		uint64 batchNanoseconds = nanoseconds - bench->batchStartNanoseconds;
+
+		if (bench->phase == BenchPhase_Warmup) {
+			if (batchNanoseconds < BENCH_BATCH_NANOSECONDS) {
+				bench->batchIterations *= 2;
+			} else if (nanoseconds - bench->warmupStartNanoseconds >=
+					   BENCH_WARMUP_NANOSECONDS) {
+				bench->phase = BenchPhase_Measure;
+			}
+		} else {
+			uint32 sample = bench->sampleCount++;
+			bench->sampleCycles[sample] =
+				(real64)batchCycles / (real64)bench->batchIterations;
+			bench->sampleNanoseconds[sample] =
+				(real64)batchNanoseconds / (real64)bench->batchIterations;
+			if (bench->sampleCount == BENCH_SAMPLE_COUNT) {
+				bench->phase = BenchPhase_Done;
+				return false;
+			}
+		}
+	}
+
+	bench->remainingIterations = bench->batchIterations - 1;
+	bench->batchStartNanoseconds = getBenchNanoseconds();
+	bench->batchStartCycles = __rdtsc();
+	return true;
+}
+
+inline bool keepBenchRunning(BenchContext *bench) {
+	if (bench->remainingIterations) {
+		bench->remainingIterations--;
+		return true;
+	}
+	return startNextBenchBatch(bench);
+}
+
+void sortBenchSamples(real64 *samples, uint32 count) {
+	for (uint32 i = 1; i < count; i++) {
+		real64 value = samples[i];
+		uint32 at = i;
+		while (at > 0 && samples[at - 1] > value) {
+			samples[at] = samples[at - 1];
+			at--;
+		}
+		samples[at] = value;
+	}
+}
+
+// NOTE(bruno): a bench that never ran its loop counts as a failed test
+void endBench(BenchContext *bench, TestContext *ctx) {
+	ctx->totalTests++;
+	if (bench->phase != BenchPhase_Done) {
+		ctx->failedTests++;
+		printf("  ✗ %s never ran its BENCH_LOOP\n", bench->currentBenchName);
+		return;
+	}
+	ctx->passedTests++;
+	if (bench->resultCount == BENCH_MAX_RESULTS) return;
+
+	sortBenchSamples(bench->sampleCycles, bench->sampleCount);
+	sortBenchSamples(bench->sampleNanoseconds, bench->sampleCount);
+	uint32 median = bench->sampleCount / 2;
+	uint32 p99 = (bench->sampleCount * 99 + 99) / 100 - 1;
+
+	BenchResult *result = &bench->results[bench->resultCount++];
+	snprintf(result->name, sizeof(result->name), "%s",
+			 bench->currentBenchName);
+	result->iterationsPerSample = bench->batchIterations;
+	result->medianCycles = bench->sampleCycles[median];
+	result->p99Cycles = bench->sampleCycles[p99];
+	result->medianNanoseconds = bench->sampleNanoseconds[median];
+	result->p99Nanoseconds = bench->sampleNanoseconds[p99];
+	result->cyclesPerItem =
+		bench->itemsPerIteration
+			? result->medianCycles / (real64)bench->itemsPerIteration
+			: 0.0;
+
+	printf("  median %.0f cycles (%.3f us)  p99 %.0f cycles (%.3f us)  "
+		   "%.3f cycles/item  %llu iterations x %u samples\n",
+		   result->medianCycles, result->medianNanoseconds / 1000.0,
+		   result->p99Cycles, result->p99Nanoseconds / 1000.0,
+		   result->cyclesPerItem,
+		   (unsigned long long)result->iterationsPerSample,
+		   bench->sampleCount);
+}
+
+// NOTE(bruno): one bench per line, whitespace separated, lines starting with
+// # are comments. The same file works as a baseline for the next run
+bool writeBenchResults(BenchContext *bench, const char *filename) {
+	FILE *file = fopen(filename, "w");
+	if (!file) return false;
+
+	fprintf(file, "# name iterations median_cycles p99_cycles median_ns "
+				  "p99_ns cycles_per_item\n");
+	for (uint32 i = 0; i < bench->resultCount; i++) {
+		BenchResult *result = &bench->results[i];
+		fprintf(file, "%s %llu %.1f %.1f %.1f %.1f %.4f\n", result->name,
+				(unsigned long long)result->iterationsPerSample,
+				result->medianCycles, result->p99Cycles,
+				result->medianNanoseconds, result->p99Nanoseconds,
+				result->cyclesPerItem);
+	}
+	return fclose(file) == 0;
+}
+
+// NOTE(bruno): compares medians, p99 is too noisy to fail anything on.
+// Returns how many benches got slower than the threshold allows, or -1 if
+// the baseline can't be read
+int compareBenchResults(BenchContext *bench, const char *filename,
+						real64 thresholdPercent) {
+	FILE *file = fopen(filename, "r");
+	if (!file) return -1;
+
+	printf("\nCompared to %s (threshold %.1f%%):\n", filename,
+		   thresholdPercent);
+
+	int regressionCount = 0;
+	char line[256];
+	while (fgets(line, sizeof(line), file)) {
+		if (line[0] == '#') continue;
+
+		char name[64];
+		unsigned long long iterations;
+		real64 medianCycles;
+		if (sscanf(line, "%63s %llu %lf", name, &iterations, &medianCycles) !=
+				3 ||
+			medianCycles <= 0.0) {
+			continue;
+		}
+
+		for (uint32 i = 0; i < bench->resultCount; i++) {
+			BenchResult *result = &bench->results[i];
+			if (strcmp(result->name, name) != 0) continue;
+
+			real64 changePercent =
+				100.0 * (result->medianCycles - medianCycles) / medianCycles;
+			bool isRegression = changePercent > thresholdPercent;
+			if (isRegression) regressionCount++;
+			printf("  %s %-40s %12.0f -> %12.0f cycles  %+7.2f%%\n",
+				   isRegression ? "✗" : "✓", name, medianCycles,
+				   result->medianCycles, changePercent);
+		}
+	}
+	fclose(file);
+	return regressionCount;
+}
+
+#endif // BENCH_FRAMEWORK_H
@@ -0,0 +1,283 @@
+// NOTE(bruno): build with ./bin/build bench and run from the repository root:
+//
+//   ./target/handmade_bench [--save results.txt] [--baseline baseline.txt]
+//                           [--threshold percent]
+//
+// --save writes the results in the format --baseline reads, so saving a run
+// before a change and comparing against it after tells whether a hot path
+// got slower. Exits with 1 when any bench is slower than the baseline by
+// more than the threshold (10% unless given).
+
+#include "handmade.cpp"
+#include "bench_framework.h"
+
+#include <stdlib.h>
+
+#define BENCH_BACKBUFFER_WIDTH 960
+#define BENCH_BACKBUFFER_HEIGHT 540
+#define BENCH_POSITION_COUNT 1024
+
+global_variable uint32
+	g_benchPixels[BENCH_BACKBUFFER_WIDTH * BENCH_BACKBUFFER_HEIGHT];
+global_variable uint8 g_benchArenaMemory[Megabytes(1)];
+global_variable World g_benchWorld;
+global_variable WorldPosition g_benchPositions[BENCH_POSITION_COUNT];
+global_variable GameAudioState g_benchAudio;
+global_variable uint32 g_benchTexels[64 * 64];
+
+GameBackbuffer createBenchBackbuffer() {
+	GameBackbuffer buffer = {};
+	buffer.width = BENCH_BACKBUFFER_WIDTH;
+	buffer.height = BENCH_BACKBUFFER_HEIGHT;
+	buffer.pitch = BENCH_BACKBUFFER_WIDTH * sizeof(uint32);
+	buffer.memory = g_benchPixels;
+	return buffer;
+}
+
+// NOTE(bruno): the 3x3 tilemaps around the origin, generated the same way
+// the game does it
+World *createBenchWorld() {
+	MemoryArena arena;
+	initializeArena(&arena, sizeof(g_benchArenaMemory), g_benchArenaMemory);
+	World *world = &g_benchWorld;
+	initializeWorld(world, &arena, 16, 9);
+	world->seed = 1234;
+	world->tileSideInMeters = 1.4f;
+	world->tileSideInPixels = 60;
+
+	for (int32 tilemapY = -1; tilemapY <= 1; tilemapY++) {
+		for (int32 tilemapX = -1; tilemapX <= 1; tilemapX++) {
+			Tilemap *tilemap = addTilemap(world, tilemapX, tilemapY);
+			generateTilemapTiles(world, tilemapX, tilemapY, tilemap->tiles);
+			tilemap->state = TilemapState_Ready;
+		}
+	}
+	return world;
+}
+
+// NOTE(bruno): fixed seed, every run times the same positions
+void fillBenchPositions(World *world, real32 maxRelative) {
+	uint32 state = 12345;
+	for (uint32 i = 0; i < BENCH_POSITION_COUNT; i++) {
+		WorldPosition *position = &g_benchPositions[i];
+		state = state * 1664525 + 1013904223;
+		position->tilemapX = (int32)(state >> 8) % 3 - 1;
+		state = state * 1664525 + 1013904223;
+		position->tilemapY = (int32)(state >> 8) % 3 - 1;
+		state = state * 1664525 + 1013904223;
+		position->tileX = (int32)((state >> 8) % (uint32)world->tilemapWidth);
+		state = state * 1664525 + 1013904223;
+		position->tileY = (int32)((state >> 8) % (uint32)world->tilemapHeight);
+		state = state * 1664525 + 1013904223;
+		position->tileRelX = maxRelative * (real32)(state >> 8) / 16777216.0f;
+		state = state * 1664525 + 1013904223;
+		position->tileRelY = maxRelative * (real32)(state >> 8) / 16777216.0f;
+	}
+}
+
+BENCH(bench_renderRectangle_fullscreen) {
+	GameBackbuffer buffer = createBenchBackbuffer();
+	bench->itemsPerIteration = buffer.width * buffer.height;
+
+	BENCH_LOOP(bench) {
+		renderRectangle(&buffer, 0, 0, (real32)buffer.width,
+						(real32)buffer.height, 1, 0, 1);
+		BENCH_KEEP(g_benchPixels);
+	}
+}
+
+BENCH(bench_renderRectangle_tile) {
+	GameBackbuffer buffer = createBenchBackbuffer();
+	bench->itemsPerIteration = 60 * 60;
+
+	BENCH_LOOP(bench) {
+		renderRectangle(&buffer, 130.0f, 70.0f, 190.0f, 130.0f, 0.5f, 0.5f,
+						0.5f);
+		BENCH_KEEP(g_benchPixels);
+	}
+}
+
+BENCH(bench_renderBlendedRectangle_alpha) {
+	GameBackbuffer buffer = createBenchBackbuffer();
+	bench->itemsPerIteration = buffer.width * buffer.height;
+
+	BENCH_LOOP(bench) {
+		renderBlendedRectangle(&buffer, 0, 0, (real32)buffer.width,
+							   (real32)buffer.height, 1, 0, 1, 0.5f,
+							   RenderBlend_Alpha);
+		BENCH_KEEP(g_benchPixels);
+	}
+}
+
+// NOTE(bruno): a 64x64 sprite four times its size and turned 30 degrees, so
+// a 256x256 quad, half of it see through
+BENCH(bench_renderTexturedQuad_rotated) {
+	for (uint32 i = 0; i < arraylength(g_benchTexels); i++) {
+		uint32 alpha = (i & 1) ? 0xFF : 0x80;
+		g_benchTexels[i] = (alpha << 24) | ((i * 2654435761u) & 0x007F7F7F);
+	}
+	LoadedBitmap bitmap = {};
+	bitmap.width = 64;
+	bitmap.height = 64;
+	bitmap.pitch = 64 * sizeof(uint32);
+	bitmap.memory = g_benchTexels;
+
+	GameBackbuffer buffer = createBenchBackbuffer();
+	real32 angle = PI / 6.0f;
+	Vector2 xAxis = {256.0f * cos(angle), 256.0f * sin(angle)};
+	Vector2 yAxis = {-xAxis.y, xAxis.x};
+	Vector2 origin = {480.0f - 0.5f * (xAxis.x + yAxis.x),
+					  270.0f - 0.5f * (xAxis.y + yAxis.y)};
+	bench->itemsPerIteration = 256 * 256;
+
+	BENCH_LOOP(bench) {
+		renderTexturedQuad(&buffer, origin, xAxis, yAxis, &bitmap, 1.0f);
+		BENCH_KEEP(g_benchPixels);
+	}
+}
+
+BENCH(bench_recanonicalizePosition) {
+	World *world = createBenchWorld();
+	// NOTE(bruno): up to two and a half tiles out, so most of them move and
+	// the ones near the edge change tilemaps
+	fillBenchPositions(world, 2.5f * world->tileSideInMeters);
+	bench->itemsPerIteration = BENCH_POSITION_COUNT;
+
+	BENCH_LOOP(bench) {
+		int32 tileSum = 0;
+		for (uint32 i = 0; i < BENCH_POSITION_COUNT; i++) {
+			WorldPosition result =
+				recanonicalizePosition(world, g_benchPositions[i]);
+			tileSum += result.tileX + result.tileY;
+		}
+		BENCH_KEEP(tileSum);
+	}
+}
+
+BENCH(bench_isWorldPointEmpty) {
+	World *world = createBenchWorld();
+	fillBenchPositions(world, 0.0f);
+	bench->itemsPerIteration = BENCH_POSITION_COUNT;
+
+	BENCH_LOOP(bench) {
+		uint32 emptyCount = 0;
+		for (uint32 i = 0; i < BENCH_POSITION_COUNT; i++) {
+			emptyCount += isWorldPointEmpty(world, g_benchPositions[i]);
+		}
+		BENCH_KEEP(emptyCount);
+	}
+}
+
+#define BENCH_SOUND_COUNT 8
+#define BENCH_SOUND_SAMPLES 4096
+#define BENCH_OUTPUT_SAMPLES 1024
+
+global_variable int16 g_benchSoundSamples[2][BENCH_SOUND_SAMPLES + 4];
+
+// NOTE(bruno): a full callback's worth of samples with the tone and eight
+// sounds playing, half of them stereo. Sounds get rewound every iteration so
+// none of them ever finishes
+BENCH(bench_gameOutputSound) {
+	for (uint32 i = 0; i < BENCH_SOUND_SAMPLES; i++) {
+		g_benchSoundSamples[0][i] = (int16)((i * 37) % 8000 - 4000);
+		g_benchSoundSamples[1][i] = (int16)((i * 53) % 8000 - 4000);
+	}
+
+	LoadedSound monoSound = {};
+	monoSound.sampleCount = BENCH_SOUND_SAMPLES;
+	monoSound.channelCount = 1;
+	monoSound.samples[0] = g_benchSoundSamples[0];
+	LoadedSound stereoSound = monoSound;
+	stereoSound.channelCount = 2;
+	stereoSound.samples[1] = g_benchSoundSamples[1];
+
+	g_benchAudio = {};
+	g_benchAudio.toneHz = 256.0f;
+	g_benchAudio.toneVolume = 3000.0f;
+	for (uint32 i = 0; i < BENCH_SOUND_COUNT; i++) {
+		SoundCommand play = {};
+		play.type = SoundCommand_PlaySound;
+		play.sound = (i & 1) ? &stereoSound : &monoSound;
+		play.volume = 0.25f;
+		play.pan = -1.0f + 2.0f * (real32)i / (real32)BENCH_SOUND_COUNT;
+		startPlayingSound(&g_benchAudio, &play);
+	}
+
+	int16 output[2 * BENCH_OUTPUT_SAMPLES];
+	GameSoundBuffer soundBuffer = {};
+	soundBuffer.sampleRate = 48000;
+	soundBuffer.sampleCount = BENCH_OUTPUT_SAMPLES;
+	soundBuffer.samples = output;
+	bench->itemsPerIteration = BENCH_OUTPUT_SAMPLES;
+
+	BENCH_LOOP(bench) {
+		for (uint32 i = 0; i < g_benchAudio.playingSoundCount; i++) {
+			g_benchAudio.playingSounds[i].samplesPlayed = 0;
+		}
+		gameOutputSound(&soundBuffer, &g_benchAudio);
+		BENCH_KEEP(output);
+	}
+}
+
+int main(int argc, char **argv) {
+	const char *saveFilename = 0;
+	const char *baselineFilename = 0;
+	real64 thresholdPercent = 10.0;
+	for (int i = 1; i < argc; i += 2) {
+		if (i + 1 == argc) {
+			printf("Option %s needs a value\n", argv[i]);
+			return 2;
+		}
+		if (strcmp(argv[i], "--save") == 0) {
+			saveFilename = argv[i + 1];
+		} else if (strcmp(argv[i], "--baseline") == 0) {
+			baselineFilename = argv[i + 1];
+		} else if (strcmp(argv[i], "--threshold") == 0) {
+			thresholdPercent = atof(argv[i + 1]);
+		} else {
+			printf("Unknown option %s\n", argv[i]);
+			return 2;
+		}
+	}
+
+	printf("========================================\n");
+	printf("Running Handmade Benchmarks\n");
+	printf("========================================\n");
+
+	RUN_BENCH(bench_renderRectangle_fullscreen);
+	RUN_BENCH(bench_renderRectangle_tile);
+	RUN_BENCH(bench_renderBlendedRectangle_alpha);
+	RUN_BENCH(bench_renderTexturedQuad_rotated);
+	RUN_BENCH(bench_recanonicalizePosition);
+	RUN_BENCH(bench_isWorldPointEmpty);
+	RUN_BENCH(bench_gameOutputSound);
+
+	if (g_testContext.failedTests) {
+		printf("\n✗ %d benches never ran.\n", g_testContext.failedTests);
+		return 1;
+	}
+
+	if (saveFilename) {
+		if (writeBenchResults(&g_benchContext, saveFilename)) {
+			printf("\nSaved results to %s\n", saveFilename);
+		} else {
+			printf("\nFailed to save results to %s\n", saveFilename);
+			return 2;
+		}
+	}
+
+	if (baselineFilename) {
+		int regressionCount = compareBenchResults(
+			&g_benchContext, baselineFilename, thresholdPercent);
+		if (regressionCount < 0) {
+			printf("\nFailed to read baseline %s\n", baselineFilename);
+			return 2;
+		}
+		if (regressionCount > 0) {
+			printf("✗ %d benches got slower.\n", regressionCount);
+			return 1;
+		}
+		printf("✓ No regressions.\n");
+	}
+	return 0;
+}
@@ -1,79 +1,90 @@
 #include "handmade.h"
 #include "handmade_intrinsics.h"
+#include "handmade_debug.h"
 
-global_variable real32 PI = 3.14159265359f;
-
-void renderRectangle(GameBackbuffer *buffer, real32 minXf, real32 minYf,
-					 real32 maxXf, real32 maxYf, real32 R, real32 G, real32 B) {
-	int32 minX = roundReal32ToInt32(minXf);
-	int32 minY = roundReal32ToInt32(minYf);
-	int32 maxX = roundReal32ToInt32(maxXf);
-	int32 maxY = roundReal32ToInt32(maxYf);
-	if (minX < 0) minX = 0;
-	if (minY < 0) minY = 0;
-	if (maxX > buffer->width) maxX = buffer->width;
-	if (maxY > buffer->height) maxY = buffer->height;
-
-	uint32 color =
-		(((uint32)255.0f << 24) | (roundReal32ToUInt32(R * 255.0f) << 16) |
-		 (roundReal32ToUInt32(G * 255.0f) << 8) |
-		 (roundReal32ToUInt32(B * 255.0f) << 0));
-
-	size_t bytesPerPixel = sizeof(uint32);
-
-	uint8 *row =
-		(uint8 *)buffer->memory + minX * bytesPerPixel + minY * buffer->pitch;
-
-	for (int y = minY; y < maxY; y++) {
-		uint32 *pixel = (uint32 *)row;
-		for (int x = minX; x < maxX; x++) {
-			*pixel++ = color;
+#include "handmade_render.cpp"
+
+uint32 getTileUnchecked(World *world, Tilemap *tilemap, int32 tileX,
+						int32 tileY) {
+	assert(tileX < world->tilemapWidth);
+	assert(tileY < world->tilemapHeight);
+	return tilemap->tiles[tileY * world->tilemapWidth + tileX];
+}
+
+void initializeWorld(World *world, MemoryArena *arena, int32 tilemapWidth,
+					 int32 tilemapHeight) {
+	world->tilemapWidth = tilemapWidth;
+	world->tilemapHeight = tilemapHeight;
+
+	world->firstFreeTilemap = 0;
+	for (uint32 i = 0; i < arraylength(world->tilemaps); i++) {
+		Tilemap *tilemap = &world->tilemaps[i];
+		tilemap->state = TilemapState_Unloaded;
+		tilemap->tiles =
+			pushArray(arena, tilemapWidth * tilemapHeight, uint32);
+		tilemap->nextInHash = world->firstFreeTilemap;
+		world->firstFreeTilemap = tilemap;
+	}
+	for (uint32 i = 0; i < arraylength(world->tilemapHash); i++) {
+		world->tilemapHash[i] = 0;
+	}
+}
+
+// NOTE(bruno): returns the tilemap slot regardless of its state, only the
+// streaming code should care about tilemaps that are not ready yet
+Tilemap *findTilemap(World *world, int32 tilemapX, int32 tilemapY) {
+	uint32 slot =
+		getTilemapHashSlot(tilemapX, tilemapY, WORLD_TILEMAP_HASH_SIZE);
+	for (Tilemap *tilemap = world->tilemapHash[slot]; tilemap;
+		 tilemap = tilemap->nextInHash) {
+		if (tilemap->tilemapX == tilemapX && tilemap->tilemapY == tilemapY) {
+			return tilemap;
 		}
-		row += buffer->pitch;
 	}
+	return 0;
 }
 
-void gameOutputSound(GameSoundBuffer *soundBuffer, GameState *gameState) {
-	if (soundBuffer->sampleCount == 0) return;
+Tilemap *addTilemap(World *world, int32 tilemapX, int32 tilemapY) {
+	assert(!findTilemap(world, tilemapX, tilemapY));
 
-	int toneHz = 256;
-	int wavePeriod = soundBuffer->sampleRate / toneHz;
+	Tilemap *tilemap = world->firstFreeTilemap;
+	if (!tilemap) return 0;
+	world->firstFreeTilemap = tilemap->nextInHash;
 
-	int16 *sampleOut = soundBuffer->samples;
+	tilemap->tilemapX = tilemapX;
+	tilemap->tilemapY = tilemapY;
+	tilemap->state = TilemapState_Unloaded;
 
-	for (int i = 0; i < soundBuffer->sampleCount; i++) {
-		// TODO(bruno): ditch this compile-time flag once we stop debugging
-		// audio with a sine wave
-#if ENABLE_SINE_WAVE
-		int toneVolume = 3000;
-		real32 sineValue = sin(gameState->tsine);
-		int16 sampleValue = (int16)(sineValue * toneVolume);
-#else
-		int16 sampleValue = 0;
-#endif
-		*sampleOut++ = sampleValue;
-		*sampleOut++ = sampleValue;
+	uint32 slot =
+		getTilemapHashSlot(tilemapX, tilemapY, WORLD_TILEMAP_HASH_SIZE);
+	tilemap->nextInHash = world->tilemapHash[slot];
+	world->tilemapHash[slot] = tilemap;
 
-		gameState->tsine += 2.0f * PI * 1.0f / (real32)wavePeriod;
-		if (gameState->tsine > 2.0f * PI) {
-			gameState->tsine -= 2.0f * PI;
+	return tilemap;
+}
+
+void removeTilemap(World *world, Tilemap *tilemap) {
+	uint32 slot = getTilemapHashSlot(tilemap->tilemapX, tilemap->tilemapY,
+									 WORLD_TILEMAP_HASH_SIZE);
+	for (Tilemap **link = &world->tilemapHash[slot]; *link;
+		 link = &(*link)->nextInHash) {
+		if (*link == tilemap) {
+			*link = tilemap->nextInHash;
+			break;
 		}
 	}
-}
 
-uint32 getTileUnchecked(World *world, Tilemap *tilemap, int32 tileX,
-						int32 tileY) {
-	assert(tileX < world->tilemapWidth);
-	assert(tileY < world->tilemapHeight);
-	return tilemap->tiles[tileY * world->tilemapWidth + tileX];
+	tilemap->state = TilemapState_Unloaded;
+	tilemap->nextInHash = world->firstFreeTilemap;
+	world->firstFreeTilemap = tilemap;
 }
 
+// NOTE(bruno): tilemaps that are missing or still being generated come back
+// as null, which everything treats as solid
 Tilemap *getTilemap(World *world, int32 tilemapX, int32 tilemapY) {
-	assert(tilemapX < world->width);
-	assert(tilemapY < world->height);
-	assert(tilemapX >= 0);
-	assert(tilemapY >= 0);
-	return &world->tilemaps[tilemapY * world->width + tilemapX];
+	Tilemap *tilemap = findTilemap(world, tilemapX, tilemapY);
+	if (tilemap && tilemap->state != TilemapState_Ready) tilemap = 0;
+	return tilemap;
 }
 
 bool isTilemapPointEmpty(World *world, Tilemap *tilemap, int32 testTileX,
@@ -136,175 +147,448 @@ bool isWorldPointEmpty(World *world, WorldPosition pos) {
 	return isTilemapPointEmpty(world, tilemap, pos.tileX, pos.tileY);
 }
 
+inline int32 floorDivInt32(int32 value, int32 divisor) {
+	int32 result = value / divisor;
+	if ((value % divisor) < 0) result -= 1;
+	return result;
+}
+
+// NOTE(bruno): absolute tile coordinates count tiles from the origin of
+// tilemap (0, 0), ignoring tilemap boundaries
+inline int32 getAbsTileX(World *world, WorldPosition pos) {
+	return pos.tilemapX * world->tilemapWidth + pos.tileX;
+}
+
+inline int32 getAbsTileY(World *world, WorldPosition pos) {
+	return pos.tilemapY * world->tilemapHeight + pos.tileY;
+}
+
+inline TilePosition getTilePosition(World *world, int32 absTileX,
+									int32 absTileY) {
+	TilePosition result = {};
+	result.tilemapX = floorDivInt32(absTileX, world->tilemapWidth);
+	result.tilemapY = floorDivInt32(absTileY, world->tilemapHeight);
+	result.tileX = absTileX - result.tilemapX * world->tilemapWidth;
+	result.tileY = absTileY - result.tilemapY * world->tilemapHeight;
+	return result;
+}
+
+bool isAbsTilePointEmpty(World *world, int32 absTileX, int32 absTileY) {
+	TilePosition tile = getTilePosition(world, absTileX, absTileY);
+	Tilemap *tilemap = getTilemap(world, tile.tilemapX, tile.tilemapY);
+	return isTilemapPointEmpty(world, tilemap, tile.tileX, tile.tileY);
+}
+
+// NOTE(bruno): the camera sits at the center of the backbuffer
+void getScreenPosition(GameBackbuffer *buffer, World *world,
+					   WorldPosition camera, WorldPosition position,
+					   real32 *screenX, real32 *screenY) {
+	int32 tileOffsetX =
+		getAbsTileX(world, position) - getAbsTileX(world, camera);
+	int32 tileOffsetY =
+		getAbsTileY(world, position) - getAbsTileY(world, camera);
+
+	*screenX = 0.5f * (real32)buffer->width +
+			   (real32)tileOffsetX * (real32)world->tileSideInPixels +
+			   (position.tileRelX - camera.tileRelX) * world->metersToPixels;
+	*screenY = 0.5f * (real32)buffer->height +
+			   (real32)tileOffsetY * (real32)world->tileSideInPixels +
+			   (position.tileRelY - camera.tileRelY) * world->metersToPixels;
+}
+
+// NOTE(bruno): t = 0 gives from, t = 1 gives to. Works across tile and
+// tilemap boundaries since the blend happens in meters from the start
+WorldPosition interpolateWorldPosition(World *world, WorldPosition from,
+									   WorldPosition to, real32 t) {
+	real32 deltaX =
+		(real32)(getAbsTileX(world, to) - getAbsTileX(world, from)) *
+			world->tileSideInMeters +
+		(to.tileRelX - from.tileRelX);
+	real32 deltaY =
+		(real32)(getAbsTileY(world, to) - getAbsTileY(world, from)) *
+			world->tileSideInMeters +
+		(to.tileRelY - from.tileRelY);
+
+	WorldPosition result = from;
+	result.tileRelX += t * deltaX;
+	result.tileRelY += t * deltaY;
+	return recanonicalizePosition(world, result);
+}
+
+// NOTE(bruno): screen position of the top left corner of the camera tile
+inline void getCameraTileOrigin(GameBackbuffer *buffer, World *world,
+								WorldPosition camera, real32 *originX,
+								real32 *originY) {
+	*originX =
+		0.5f * (real32)buffer->width - camera.tileRelX * world->metersToPixels;
+	*originY = 0.5f * (real32)buffer->height -
+			   camera.tileRelY * world->metersToPixels;
+}
+
+// NOTE(bruno): every tile that covers at least part of a pixel, a tile that
+// only touches the edge of the backbuffer isn't in it
+TileRange getVisibleTileRange(GameBackbuffer *buffer, World *world,
+							  WorldPosition camera) {
+	real32 tileSide = (real32)world->tileSideInPixels;
+	int32 cameraAbsTileX = getAbsTileX(world, camera);
+	int32 cameraAbsTileY = getAbsTileY(world, camera);
+	real32 originX, originY;
+	getCameraTileOrigin(buffer, world, camera, &originX, &originY);
+
+	TileRange range;
+	range.minAbsTileX =
+		cameraAbsTileX + floorReal32ToInt32(-originX / tileSide);
+	range.minAbsTileY =
+		cameraAbsTileY + floorReal32ToInt32(-originY / tileSide);
+	range.maxAbsTileX =
+		cameraAbsTileX +
+		ceilReal32ToInt32(((real32)buffer->width - originX) / tileSide) - 1;
+	range.maxAbsTileY =
+		cameraAbsTileY +
+		ceilReal32ToInt32(((real32)buffer->height - originY) / tileSide) - 1;
+	return range;
+}
+
+// NOTE(bruno): only walks the tiles that overlap the backbuffer, grouped by
+// tilemap so each tilemap gets looked up once however many of its tiles are
+// on screen. The cost depends on the screen size and not on the world layout
+void renderVisibleTiles(GameBackbuffer *buffer, World *world,
+						WorldPosition camera, int32 highlightAbsTileX,
+						int32 highlightAbsTileY) {
+	TIMED_FUNCTION();
+
+	real32 tileSide = (real32)world->tileSideInPixels;
+	int32 cameraAbsTileX = getAbsTileX(world, camera);
+	int32 cameraAbsTileY = getAbsTileY(world, camera);
+	real32 originX, originY;
+	getCameraTileOrigin(buffer, world, camera, &originX, &originY);
+
+	TileRange range = getVisibleTileRange(buffer, world, camera);
+	int32 minAbsTileX = range.minAbsTileX;
+	int32 minAbsTileY = range.minAbsTileY;
+	int32 maxAbsTileX = range.maxAbsTileX;
+	int32 maxAbsTileY = range.maxAbsTileY;
+
+	TilePosition minTile = getTilePosition(world, minAbsTileX, minAbsTileY);
+	TilePosition maxTile = getTilePosition(world, maxAbsTileX, maxAbsTileY);
+
+	for (int32 tilemapY = minTile.tilemapY; tilemapY <= maxTile.tilemapY;
+		 tilemapY++) {
+		for (int32 tilemapX = minTile.tilemapX; tilemapX <= maxTile.tilemapX;
+			 tilemapX++) {
+			// NOTE(bruno): the tilemap might still be generating
+			Tilemap *tilemap = getTilemap(world, tilemapX, tilemapY);
+
+			int32 firstAbsTileX = tilemapX * world->tilemapWidth;
+			int32 firstAbsTileY = tilemapY * world->tilemapHeight;
+			int32 beginX = firstAbsTileX > minAbsTileX ? firstAbsTileX
+													   : minAbsTileX;
+			int32 beginY = firstAbsTileY > minAbsTileY ? firstAbsTileY
+													   : minAbsTileY;
+			int32 endX = firstAbsTileX + world->tilemapWidth - 1;
+			int32 endY = firstAbsTileY + world->tilemapHeight - 1;
+			if (endX > maxAbsTileX) endX = maxAbsTileX;
+			if (endY > maxAbsTileY) endY = maxAbsTileY;
+
+			for (int32 absTileY = beginY; absTileY <= endY; absTileY++) {
+				for (int32 absTileX = beginX; absTileX <= endX; absTileX++) {
+					uint32 tileID =
+						tilemap ? getTileUnchecked(world, tilemap,
+												   absTileX - firstAbsTileX,
+												   absTileY - firstAbsTileY)
+								: 1;
+					real32 gray = 0.5f;
+					if (tileID == 1) {
+						gray = 1.0f;
+					}
+
+#if HANDMADE_INTERNAL
+					if (absTileX == highlightAbsTileX &&
+						absTileY == highlightAbsTileY) {
+						gray = 0.0f;
+					}
+#endif
+
+					int32 offsetX = absTileX - cameraAbsTileX;
+					int32 offsetY = absTileY - cameraAbsTileY;
+					real32 minX = originX + (real32)offsetX * tileSide;
+					real32 minY = originY + (real32)offsetY * tileSide;
+					real32 maxX = minX + tileSide;
+					real32 maxY = minY + tileSide;
+					renderRectangle(buffer, minX, minY, maxX, maxY, gray, gray,
+									gray);
+				}
+			}
+		}
+	}
+}
+
+#include "handmade_audio.cpp"
+#include "handmade_asset.cpp"
+#include "handmade_flowfield.cpp"
+#include "handmade_worldgen.cpp"
+
+// NOTE(bruno): one fixed step of input->deltaTime
+void simulatePlayer(GameState *gameState, World *world, GameInput *input,
+					real32 secondsBeforeLatch) {
+	TIMED_FUNCTION();
+
+	real32 playerHeight = world->tileSideInMeters;
+	real32 playerWidth = 0.75f * playerHeight;
+
+	for (size_t i = 0; i < arraylength(input->controllers); i++) {
+		GameControllerInput *controller = gameGetController(input, i);
+
+		real32 dPlayerX = 0.0f;
+		real32 dPlayerY = 0.0f;
+		if (controller->isAnalog) {
+			// NOTE(bruno): the platform already took the dead zone out and
+			// keeps the stick inside the unit circle, so a full push is as
+			// fast as the d-pad
+			dPlayerX = controller->stickAverageX;
+			dPlayerY = controller->stickAverageY;
+		} else {
+			if (wasButtonDown(&controller->moveDown, secondsBeforeLatch)) {
+				dPlayerY = 1.0f;
+			}
+			if (wasButtonDown(&controller->moveUp, secondsBeforeLatch)) {
+				dPlayerY = -1.0f;
+			}
+			if (wasButtonDown(&controller->moveLeft, secondsBeforeLatch)) {
+				dPlayerX = -1.0f;
+			}
+			if (wasButtonDown(&controller->moveRight, secondsBeforeLatch)) {
+				dPlayerX = 1.0f;
+			}
+		}
+		real32 speed = 5.0f * input->deltaTime;
+		dPlayerX *= speed;
+		dPlayerY *= speed;
+
+		WorldPosition newPosition = gameState->playerPos;
+		newPosition.tileRelX += dPlayerX;
+		newPosition.tileRelY += dPlayerY;
+		newPosition = recanonicalizePosition(world, newPosition);
+
+		WorldPosition newLeft = newPosition;
+		newLeft.tileRelX -= (playerWidth / 2);
+		newLeft = recanonicalizePosition(world, newLeft);
+		WorldPosition newRight = newPosition;
+		newRight.tileRelX += (playerWidth / 2);
+		newRight = recanonicalizePosition(world, newRight);
+
+		if (isWorldPointEmpty(world, newPosition) &&
+			isWorldPointEmpty(world, newLeft) &&
+			isWorldPointEmpty(world, newRight)) {
+			gameState->playerPos = newPosition;
+		}
+	}
+}
+
 void gameUpdateAndRender(GameMemory *gameMemory, GameBackbuffer *backbuffer,
-						 GameSoundBuffer *soundBuffer, GameInput *input) {
+						 GameInput *input) {
+#if HANDMADE_INTERNAL
+	// NOTE(bruno): our globals start over on every reload
+	globalDebugTable = gameMemory->debugTable;
+#endif
+	TIMED_FUNCTION();
+
 	assert(sizeof(GameState) <= gameMemory->permanentStorageSize);
 
 	GameState *gameState = (GameState *)gameMemory->permanentStorage;
 	if (!gameMemory->isInitialized) {
-		gameState->tsine = 0.0f;
+#define TILEMAP_WIDTH 16
+#define TILEMAP_HEIGHT 9
 		gameState->playerPos.tilemapX = 0;
 		gameState->playerPos.tilemapY = 0;
-		gameState->playerPos.tileX = 3;
-		gameState->playerPos.tileY = 3;
+		// NOTE(bruno): the generator always keeps the middle of a tilemap
+		// empty, so that is a safe place to spawn
+		gameState->playerPos.tileX = TILEMAP_WIDTH / 2;
+		gameState->playerPos.tileY = TILEMAP_HEIGHT / 2;
 		gameState->playerPos.tileRelX = 0.1f;
 		gameState->playerPos.tileRelY = 0.1f; // 5 pixels offset for now
+		gameState->previousPlayerPos = gameState->playerPos;
+
+		initializeArena(&gameState->worldArena,
+						gameMemory->permanentStorageSize - sizeof(GameState),
+						(uint8 *)gameMemory->permanentStorage +
+							sizeof(GameState));
+
+		World *world = pushStruct(&gameState->worldArena, World);
+		initializeWorld(world, &gameState->worldArena, TILEMAP_WIDTH,
+						TILEMAP_HEIGHT);
+		world->seed = 1234;
+		world->tileSideInMeters = 1.4f;
+		world->tileSideInPixels = 60;
+		world->metersToPixels =
+			((real32)world->tileSideInPixels / world->tileSideInMeters);
+		gameState->world = world;
+
+		initializeFlowField(&gameState->flowField, world,
+							&gameState->worldArena);
+
+		SoundCommand tone = {};
+		tone.type = SoundCommand_SetTone;
+		tone.toneHz = 256.0f;
+		tone.toneVolume = 3000.0f;
+		pushSoundCommand(&gameState->soundCommands, tone);
 
 		gameMemory->isInitialized = true;
 	}
 
-#define TILEMAP_WIDTH 16
-#define TILEMAP_HEIGHT 9
-	uint32 tiles00[TILEMAP_HEIGHT][TILEMAP_WIDTH] = {
-		{1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
-		{1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-		{1, 1, 0, 0, 0, 0, 1, 1, 1, 0, 0, 0, 0, 0, 0, 1},
-		{1, 0, 0, 0, 0, 0, 1, 1, 1, 0, 0, 0, 0, 0, 0, 1},
-		{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-		{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-		{1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-		{1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-		{1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1},
-	};
-	uint32 tiles01[TILEMAP_HEIGHT][TILEMAP_WIDTH] = {
-		{1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1},
-		{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-		{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-		{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-		{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-		{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-		{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-		{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-		{1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
-	};
-	uint32 tiles10[TILEMAP_HEIGHT][TILEMAP_WIDTH] = {
-		{1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
-		{1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-		{1, 1, 0, 0, 0, 0, 1, 1, 1, 0, 0, 0, 0, 0, 0, 1},
-		{1, 0, 0, 0, 0, 0, 1, 1, 1, 0, 0, 0, 0, 0, 0, 1},
-		{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-		{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-		{1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-		{1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-		{1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1},
-	};
-	uint32 tiles11[TILEMAP_HEIGHT][TILEMAP_WIDTH] = {
-		{1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1},
-		{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-		{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-		{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-		{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-		{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-		{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-		{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-		{1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
-	};
-
-	Tilemap tilemaps[2][2] = {};
-	tilemaps[0][1] = tilemaps[0][0];
-	tilemaps[1][0] = tilemaps[0][0];
-	tilemaps[1][1] = tilemaps[0][0];
-
-	tilemaps[0][0].tiles = (uint32 *)tiles00;
-	tilemaps[1][0].tiles = (uint32 *)tiles01;
-	tilemaps[0][1].tiles = (uint32 *)tiles10;
-	tilemaps[1][1].tiles = (uint32 *)tiles11;
-
-	World world = {};
-	world.width = 2;
-	world.height = 2;
-	world.tilemapWidth = TILEMAP_WIDTH;
-	world.tilemapHeight = TILEMAP_HEIGHT;
-	world.tilemaps = (Tilemap *)tilemaps;
-	world.tileSideInMeters = 1.4f;
-	world.tileSideInPixels = 60;
-	world.metersToPixels =
-		((real32)world.tileSideInPixels / world.tileSideInMeters);
-
-	Tilemap *tilemap = getTilemap(&world, gameState->playerPos.tilemapX,
-								  gameState->playerPos.tilemapY);
+	assert(sizeof(TransientState) <= gameMemory->transientStorageSize);
+	TransientState *transientState =
+		(TransientState *)gameMemory->transientStorage;
+	if (!transientState->isInitialized) {
+		initializeArena(&transientState->transientArena,
+						gameMemory->transientStorageSize -
+							sizeof(TransientState),
+						(uint8 *)gameMemory->transientStorage +
+							sizeof(TransientState));
+
+		openAssetPack(gameMemory, &transientState->assets,
+					  &transientState->transientArena, "data/assets.hmp",
+					  ASSET_DEFAULT_RESIDENT_BUDGET);
+
+		// NOTE(bruno): without a pack (or with one that has no door sound)
+		// we fall back to the loose file, a missing file just leaves the
+		// sound empty. With a pack, asking for it now gets the load going
+		// before the first door
+		transientState->doorAsset =
+			getFirstAsset(&transientState->assets, Asset_DoorSound);
+		if (transientState->doorAsset) {
+			getSound(gameMemory, &transientState->assets,
+					 transientState->doorAsset);
+		} else {
+			beginLoadingWAV(gameMemory, &transientState->transientArena,
+							&transientState->doorSoundLoad,
+							&transientState->doorSound, "data/door.wav");
+		}
+
+		transientState->musicIsOpen = openStreamingWAV(
+			gameMemory, &transientState->transientArena,
+			&transientState->music, "data/music.wav", true);
+		if (transientState->musicIsOpen) {
+			SoundCommand music = {};
+			music.type = SoundCommand_PlayStream;
+			music.stream = &transientState->music;
+			music.volume = 0.5f;
+			music.pan = 0.0f;
+			pushSoundCommand(&gameState->soundCommands, music);
+		}
+
+		transientState->isInitialized = true;
+	}
+
+	updateLoadingWAV(gameMemory, &transientState->transientArena,
+					 &transientState->doorSoundLoad);
+	if (transientState->musicIsOpen) {
+		updateStreamingSound(gameMemory, &transientState->music);
+	}
+
+	World *world = gameState->world;
+	WorldPosition oldPlayerPos = gameState->playerPos;
 
 	real32 playerR = 0.0f;
 	real32 playerG = 1.0f;
 	real32 playerB = 1.0f;
-	real32 playerHeight = world.tileSideInMeters;
+	real32 playerHeight = world->tileSideInMeters;
 	real32 playerWidth = 0.75f * playerHeight;
 
-	for (size_t i = 0; i < arraylength(input->controllers); i++) {
-		GameControllerInput *controller = gameGetController(input, i);
+	// NOTE(bruno): the last step lines up with the input latch, so it always
+	// sees the newest input. The ones before it see the buttons as they were
+	// when they would have run
+	for (uint32 step = 0; step < input->simulationStepCount; step++) {
+		real32 secondsBeforeLatch =
+			(real32)(input->simulationStepCount - 1 - step) * input->deltaTime;
+		gameState->previousPlayerPos = gameState->playerPos;
+		simulatePlayer(gameState, world, input, secondsBeforeLatch);
+	}
 
-		if (controller->isAnalog) {
-		} else {
-			real32 speed = 5.0f * input->deltaTime;
-			real32 dPlayerX = 0.0f;
-			real32 dPlayerY = 0.0f;
-			if (controller->moveDown.endedDown) dPlayerY = 1.0f;
-			if (controller->moveUp.endedDown) dPlayerY = -1.0f;
-			if (controller->moveLeft.endedDown) dPlayerX = -1.0f;
-			if (controller->moveRight.endedDown) dPlayerX = 1.0f;
-			dPlayerX *= speed;
-			dPlayerY *= speed;
-
-			WorldPosition newPosition = gameState->playerPos;
-			newPosition.tileRelX += dPlayerX;
-			newPosition.tileRelY += dPlayerY;
-			newPosition = recanonicalizePosition(&world, newPosition);
-
-			WorldPosition newLeft = newPosition;
-			newLeft.tileRelX -= (playerWidth / 2);
-			newLeft = recanonicalizePosition(&world, newLeft);
-			WorldPosition newRight = newPosition;
-			newRight.tileRelX += (playerWidth / 2);
-			newRight = recanonicalizePosition(&world, newRight);
-
-			if (isWorldPointEmpty(&world, newPosition) &&
-				isWorldPointEmpty(&world, newLeft) &&
-				isWorldPointEmpty(&world, newRight)) {
-				gameState->playerPos = newPosition;
-			}
-		}
+	// NOTE(bruno): the audio thread only ever sees the sound after it is
+	// loaded, the command ring publishes it. A sound from the pack can't be
+	// evicted from the moment it is pushed until the audio thread finishes
+	// playing it, and gets asked for again every frame
+	LoadedSound *doorSound = &transientState->doorSound;
+	if (transientState->doorAsset) {
+		doorSound = getSound(gameMemory, &transientState->assets,
+							 transientState->doorAsset);
+	}
+	if (doorSound->sampleCount &&
+		(gameState->playerPos.tilemapX != oldPlayerPos.tilemapX ||
+		 gameState->playerPos.tilemapY != oldPlayerPos.tilemapY)) {
+		SoundCommand door = {};
+		door.type = SoundCommand_PlaySound;
+		door.sound = doorSound;
+		door.volume = 1.0f;
+		door.pan = 0.0f;
+		pushSoundCommand(&gameState->soundCommands, door);
 	}
 
-	gameOutputSound(soundBuffer,
-					gameState); // TODO(bruno): Allow sample offsets
-								// here for more robust platform options
+	// NOTE(bruno): everything below renders the player where it is between
+	// the last two simulation steps, not where the last step left it
+	WorldPosition renderPlayerPos =
+		interpolateWorldPosition(world, gameState->previousPlayerPos,
+								 gameState->playerPos, input->interpolation);
+
+	// TODO(bruno): smooth camera follow, for now it is locked to the player
+	gameState->cameraPos = renderPlayerPos;
+
+	updateWorldStreaming(gameState, gameMemory, gameState->cameraPos.tilemapX,
+						 gameState->cameraPos.tilemapY);
+
+	// NOTE(bruno): free when the player stays on the same tile and nothing
+	// nearby changed, repaired in place otherwise
+	updateFlowField(&gameState->flowField, world,
+					getAbsTileX(world, gameState->playerPos),
+					getAbsTileY(world, gameState->playerPos));
+
+	// NOTE(bruno): the platform's frame graph tells simulation and rendering
+	// apart by this block
+	TIMED_BLOCK("render");
 
 	renderRectangle(backbuffer, 0, 0, backbuffer->width, backbuffer->height, 1,
 					0, 1);
 
-	for (int32 tileY = 0; tileY < world.tilemapHeight; tileY++) {
-		for (int32 tileX = 0; tileX < world.tilemapWidth; tileX++) {
-
-			uint32 tileID = getTileUnchecked(&world, tilemap, tileX, tileY);
-			real32 gray = 0.5f;
-			if (tileID == 1) {
-				gray = 1.0f;
-			}
+	int32 highlightAbsTileX = getAbsTileX(world, gameState->playerPos);
+	int32 highlightAbsTileY = getAbsTileY(world, gameState->playerPos);
+	renderVisibleTiles(backbuffer, world, gameState->cameraPos,
+					   highlightAbsTileX, highlightAbsTileY);
+
+	real32 playerScreenX;
+	real32 playerScreenY;
+	getScreenPosition(backbuffer, world, gameState->cameraPos,
+					  renderPlayerPos, &playerScreenX, &playerScreenY);
+	real32 playerLeft =
+		playerScreenX - 0.5f * world->metersToPixels * playerWidth;
+	real32 playerTop =
+		playerScreenY - 0.5f * world->metersToPixels * playerHeight;
+	real32 playerRight = playerLeft + world->metersToPixels * playerWidth;
+	real32 playerBottom = playerTop + world->metersToPixels * playerHeight;
+	renderRectangle(backbuffer, playerLeft, playerTop, playerRight,
+					playerBottom, playerR, playerG, playerB);
+}
 
+// NOTE(bruno): called from the platform audio thread whenever the device
+// wants more samples, so this must only touch the audio state and the
+// consumer side of the command ring
+void gameGetSoundSamples(GameMemory *gameMemory, GameSoundBuffer *soundBuffer) {
 #if HANDMADE_INTERNAL
-			if (tileX == gameState->playerPos.tileX &&
-				tileY == gameState->playerPos.tileY) {
-				gray = 0.0f;
-			}
+	globalDebugTable = gameMemory->debugTable;
 #endif
+	TIMED_FUNCTION();
 
-			real32 minX = tileX * world.tileSideInPixels;
-			real32 minY = tileY * world.tileSideInPixels;
-			real32 maxX = minX + world.tileSideInPixels;
-			real32 maxY = minY + world.tileSideInPixels;
-			renderRectangle(backbuffer, minX, minY, maxX, maxY, gray, gray,
-							gray);
-		}
+	GameState *gameState = (GameState *)gameMemory->permanentStorage;
+	GameAudioState *audio = &gameState->audio;
+	if (!audio->isInitialized) {
+		audio->tsine = 0.0f;
+		audio->toneHz = 0.0f;
+		audio->toneVolume = 0.0f;
+		audio->playingSoundCount = 0;
+		audio->playingStreamCount = 0;
+		audio->isInitialized = true;
 	}
 
-	real32 playerLeft = world.tileSideInPixels * gameState->playerPos.tileX +
-						world.metersToPixels * gameState->playerPos.tileRelX -
-						0.5f * world.metersToPixels * playerWidth;
-	real32 playerTop = world.tileSideInPixels * gameState->playerPos.tileY +
-					   world.metersToPixels * gameState->playerPos.tileRelY -
-					   0.5f * world.metersToPixels * playerHeight;
-	real32 playerRight = playerLeft + world.metersToPixels * playerWidth;
-	real32 playerBottom = playerTop + world.metersToPixels * playerHeight;
-	renderRectangle(backbuffer, playerLeft, playerTop, playerRight,
-					playerBottom, playerR, playerG, playerB);
+	applySoundCommands(&gameState->soundCommands, audio);
+	gameOutputSound(soundBuffer, audio);
 }
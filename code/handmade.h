@@ -14,6 +14,7 @@ typedef uint16_t uint16;
 typedef uint32_t uint32;
 typedef uint64_t uint64;
 
+#if HANDMADE_SLOW
 #define assert(expression)                                                     \
 	if (!(expression)) {                                                       \
 		_Pragma("GCC diagnostic push")                                         \
@@ -21,6 +22,10 @@ typedef uint64_t uint64;
 			(int *)0 = 0;                                                      \
 		_Pragma("GCC diagnostic pop")                                          \
 	}
+#else
+// NOTE(bruno): release builds, the expression is not evaluated at all
+#define assert(expression)
+#endif
 
 #define arraylength(array) (sizeof(array) / sizeof((array)[0]))
 
@@ -49,6 +54,71 @@ typedef void (*DEBUGPlatformFreeFileMemoryFunc)(void *);
 typedef bool (*DEBUGPlatformWriteEntireFileFunc)(const char *, uint32, void *);
 #endif
 
+// NOTE(bruno): reads go to explicit offsets, so several threads can read
+// from the same handle at once
+struct PlatformFileHandle {
+	bool isValid;
+	uint64 size;
+	int64 platformHandle;
+};
+
+typedef PlatformFileHandle (*PlatformOpenFileFunc)(const char *filename);
+typedef bool (*PlatformReadDataFromFileFunc)(PlatformFileHandle *handle,
+											 uint64 offset, uint64 size,
+											 void *dest);
+typedef void (*PlatformCloseFileFunc)(PlatformFileHandle *handle);
+
+// NOTE(bruno): read only and never unmapped, the mapping belongs to the
+// platform so it survives game code reloads. Touching pages that were never
+// prefetched blocks on the disk, so prefetch whatever is about to be used
+struct PlatformMappedFile {
+	bool isValid;
+	uint64 size;
+	void *memory;
+};
+
+typedef PlatformMappedFile (*PlatformMapFileFunc)(const char *filename);
+typedef void (*PlatformPrefetchMemoryFunc)(void *memory, uint64 size);
+typedef void (*PlatformEvictMemoryFunc)(void *memory, uint64 size);
+
+enum PlatformFileReadState {
+	PlatformFileRead_Pending,
+	PlatformFileRead_Done,
+	PlatformFileRead_Failed,
+};
+
+// NOTE(bruno): owned by the caller, and it has to stay put (along with the
+// file handle and dest) until state stops being Pending. The platform writes
+// straight into dest, which is usually arena memory. Poll state with an
+// atomic load, Done means all of dest is there
+struct PlatformFileRead {
+	PlatformFileHandle *file;
+	uint64 offset;
+	uint64 size;
+	void *dest;
+
+	uint32 volatile state;
+	// NOTE(bruno): platform only, how far along a read split in parts is
+	uint64 bytesRead;
+};
+
+typedef void (*PlatformSubmitFileReadFunc)(PlatformFileRead *read);
+
+struct PlatformWorkQueue;
+struct DebugTable;
+typedef void (*PlatformWorkQueueCallback)(PlatformWorkQueue *queue,
+										  void *data);
+typedef void (*PlatformAddWorkEntryFunc)(PlatformWorkQueue *queue,
+										 PlatformWorkQueueCallback callback,
+										 void *data);
+typedef void (*PlatformCompleteAllWorkFunc)(PlatformWorkQueue *queue);
+
+// NOTE(bruno): fixed simulation rate, independent from the display refresh
+// rate. Steps past the max in a single frame are dropped so a long stall
+// (debugger, window drag) doesn't turn into a burst of catch up steps
+#define GAME_SIMULATION_HZ 60
+#define GAME_MAX_SIMULATION_STEPS_PER_FRAME 8
+
 //  NOTE(bruno): services that the game layer provides to the platform layer
 //  -----------------------------------------------------------------
 //  -----------------------------------------------------------------
@@ -62,9 +132,41 @@ struct GameMemory {
 
 	bool isInitialized;
 
+#if HANDMADE_INTERNAL
 	DEBUGPlatformReadEntireFileFunc DEBUGPlatformReadEntireFile;
 	DEBUGPlatformFreeFileMemoryFunc DEBUGPlatformFreeFileMemory;
 	DEBUGPlatformWriteEntireFileFunc DEBUGPlatformWriteEntireFile;
+#endif
+
+	PlatformOpenFileFunc platformOpenFile;
+	PlatformReadDataFromFileFunc platformReadDataFromFile;
+	PlatformCloseFileFunc platformCloseFile;
+	PlatformSubmitFileReadFunc platformSubmitFileRead;
+	PlatformMapFileFunc platformMapFile;
+	PlatformPrefetchMemoryFunc platformPrefetchMemory;
+	PlatformEvictMemoryFunc platformEvictMemory;
+
+	// NOTE(bruno): work added to the background queue runs on background
+	// threads, the game must never wait on it from the frame. The high
+	// priority queue has a worker per core and is meant for work the frame
+	// fans out and then waits on with platformCompleteAllWork
+	PlatformWorkQueue *backgroundQueue;
+	PlatformWorkQueue *highPriorityQueue;
+	PlatformAddWorkEntryFunc platformAddWorkEntry;
+	PlatformCompleteAllWorkFunc platformCompleteAllWork;
+
+	// NOTE(bruno): the profiler's table, owned by the platform. Null when the
+	// profiler is compiled out
+	DebugTable *debugTable;
+};
+
+// NOTE(bruno): the order of the bytes in a pixel, from the top one down. The
+// alpha byte always sits on top and is never read as a color
+enum BackbufferFormat {
+	BackbufferFormat_ARGB8888,
+	BackbufferFormat_ABGR8888,
+
+	BackbufferFormat_Count,
 };
 
 struct GameBackbuffer {
@@ -72,6 +174,7 @@ struct GameBackbuffer {
 	int height;
 	int pitch;
 	void *memory;
+	BackbufferFormat format;
 };
 
 struct GameSoundBuffer {
@@ -83,6 +186,9 @@ struct GameSoundBuffer {
 struct GameButtonState {
 	int halfTransitionCount;
 	bool endedDown;
+	// NOTE(bruno): how long before the platform latched the input the last
+	// transition happened, only means something with halfTransitionCount
+	real32 transitionSeconds;
 };
 
 struct GameControllerInput {
@@ -122,7 +228,14 @@ struct GameInput {
 	GameButtonState mouseButtons[5];
 	int32 mouseX, mouseY, mouseZ;
 
+	// NOTE(bruno): the simulation always steps by deltaTime. The platform
+	// measures the real frame time and tells us how many steps fit in it, and
+	// how far into the next step we are so rendering can blend between the
+	// last two simulated states
 	real32 deltaTime;
+	uint32 simulationStepCount;
+	real32 interpolation;
+
 	GameControllerInput controllers[MAX_CONTROLLERS + 1];
 };
 
@@ -135,25 +248,132 @@ struct WorldPosition {
 	real32 tileRelY;
 };
 
-struct GameState {
-	real32 tsine;
-	WorldPosition playerPos;
+struct TilePosition {
+	int32 tilemapX;
+	int32 tilemapY;
+	int32 tileX;
+	int32 tileY;
+};
+
+// NOTE(bruno): inclusive on both ends
+struct TileRange {
+	int32 minAbsTileX;
+	int32 minAbsTileY;
+	int32 maxAbsTileX;
+	int32 maxAbsTileY;
+};
+
+enum TilemapState {
+	TilemapState_Unloaded,
+	TilemapState_Queued,
+	TilemapState_Generated,
+	TilemapState_Ready,
 };
 
 struct Tilemap {
+	int32 tilemapX;
+	int32 tilemapY;
+
+	// NOTE(bruno): written by the generation worker (Queued -> Generated) and
+	// by the main thread otherwise, the tiles are only safe to read once the
+	// main thread has seen Generated and promoted the tilemap to Ready
+	uint32 volatile state;
 	uint32 *tiles;
+
+	Tilemap *nextInHash;
 };
 
+// NOTE(bruno): the world is unbounded, tilemaps live in a fixed pool and get
+// generated around the player and evicted once they fall far enough behind
+#define WORLD_MAX_TILEMAPS 64
+#define WORLD_TILEMAP_HASH_SIZE 256
+
 struct World {
-	Tilemap *tilemaps;
 	real32 tileSideInMeters;
 	uint32 tileSideInPixels;
 	real32 metersToPixels;
 
-	int32 width;
-	int32 height;
 	int32 tilemapWidth;
 	int32 tilemapHeight;
+
+	uint32 seed;
+
+	Tilemap tilemaps[WORLD_MAX_TILEMAPS];
+	Tilemap *tilemapHash[WORLD_TILEMAP_HASH_SIZE];
+	Tilemap *firstFreeTilemap;
+};
+
+// NOTE(bruno): for every table keyed by tilemap coordinates, hashSize must be
+// a power of two
+inline uint32 getTilemapHashSlot(int32 tilemapX, int32 tilemapY,
+								 uint32 hashSize) {
+	// TODO(bruno): better hash function
+	uint32 hashValue = (uint32)(19 * tilemapX + 7 * tilemapY);
+	return hashValue & (hashSize - 1);
+}
+
+struct MemoryArena {
+	size_t size;
+	uint8 *base;
+	size_t used;
+};
+
+inline void initializeArena(MemoryArena *arena, size_t size, void *base) {
+	arena->size = size;
+	arena->base = (uint8 *)base;
+	arena->used = 0;
+}
+
+#define pushSize(arena, size) pushSize_(arena, size)
+#define pushStruct(arena, type) (type *)pushSize_(arena, sizeof(type))
+#define pushArray(arena, count, type)                                         \
+	(type *)pushSize_(arena, (count) * sizeof(type))
+inline void *pushSize_(MemoryArena *arena, size_t size) {
+	assert(arena->used + size <= arena->size);
+	void *result = arena->base + arena->used;
+	arena->used += size;
+	return result;
+}
+
+#include "handmade_audio.h"
+#include "handmade_asset.h"
+#include "handmade_flowfield.h"
+#include "handmade_worldgen.h"
+#include "handmade_render.h"
+
+struct GameState {
+	// NOTE(bruno): the player before the last simulation step, rendering
+	// blends from here to playerPos
+	WorldPosition previousPlayerPos;
+	WorldPosition playerPos;
+	WorldPosition cameraPos;
+
+	MemoryArena worldArena;
+	World *world;
+	TilemapGenerationWork tilemapGenerationWork[WORLD_MAX_TILEMAPS];
+
+	FlowField flowField;
+
+	// NOTE(bruno): the audio state belongs to the audio thread, the frame
+	// thread only talks to it through the command ring
+	SoundCommandRing soundCommands;
+	GameAudioState audio;
+};
+
+// NOTE(bruno): lives at the start of the transient storage, nothing in here
+// gets saved with the memory snapshots
+struct TransientState {
+	bool isInitialized;
+	MemoryArena transientArena;
+
+	Assets assets;
+	uint32 doorAsset;
+
+	// NOTE(bruno): only used when the door sound isn't in the pack
+	LoadedSound doorSound;
+	PendingSoundLoad doorSoundLoad;
+	StreamingSound music;
+	bool musicIsOpen;
 };
 
 inline GameControllerInput *gameGetController(GameInput *input, size_t index) {
@@ -168,6 +388,17 @@ inline GameControllerInput *gameGetController(GameInput *input, size_t index) {
 	return controller;
 }
 
+// NOTE(bruno): whether the button was down some time before the latch. Only
+// the last transition has a time, so a tap that starts and ends between two
+// steps doesn't show up here, halfTransitionCount still has it
+inline bool wasButtonDown(GameButtonState *button, real32 secondsBeforeLatch) {
+	if (button->halfTransitionCount &&
+		secondsBeforeLatch > button->transitionSeconds) {
+		return !button->endedDown;
+	}
+	return button->endedDown;
+}
+
 inline uint32 safeTruncateUint64(uint64 value) {
 	assert(value <=
 		   0xFFFFFFFF); // TODO(bruno): defines for max values like u_int32_max
@@ -178,11 +409,13 @@ inline uint32 safeTruncateUint64(uint64 value) {
 // TODO(bruno): work with stubs so that platform can still boot if no game code
 // is found
 typedef void (*GAME_UPDATE_AND_RENDER)(GameMemory *, GameBackbuffer *,
-									   GameSoundBuffer *, GameInput *);
+									   GameInput *);
+typedef void (*GAME_GET_SOUND_SAMPLES)(GameMemory *, GameSoundBuffer *);
 
 extern "C" {
 void gameUpdateAndRender(GameMemory *gameMemory, GameBackbuffer *backbuffer,
-						 GameSoundBuffer *soundBuffer, GameInput *input);
+						 GameInput *input);
+void gameGetSoundSamples(GameMemory *gameMemory, GameSoundBuffer *soundBuffer);
 }
 
 #define HANDMADE_H
@@ -0,0 +1,213 @@
+#include "handmade_asset.h"
+
+inline bool isAssetPackRangeValid(PlatformMappedFile *pack, uint64 offset,
+								  uint64 size) {
+	return offset <= pack->size && size <= pack->size - offset;
+}
+
+bool isAssetPackAssetValid(PlatformMappedFile *pack, AssetPackAsset *asset) {
+	if (!isAssetPackRangeValid(pack, asset->dataOffset, asset->dataSize)) {
+		return false;
+	}
+	if (asset->dataOffset % ASSET_PACK_ALIGNMENT) return false;
+
+	switch (asset->kind) {
+		case AssetKind_None: {
+			return true;
+		}
+		case AssetKind_Sound: {
+			AssetPackSound *sound = &asset->sound;
+			if (sound->channelCount < 1 || sound->channelCount > 2) {
+				return false;
+			}
+			return asset->dataSize ==
+				   sound->channelCount *
+					   getAssetPackChannelStride(sound->sampleCount);
+		}
+	}
+	return false;
+}
+
+void initializeAssetMemory(Assets *assets, size_t residentBudget) {
+	AssetSlot *usedSentinel = &assets->usedSentinel;
+	usedSentinel->prevUsed = usedSentinel;
+	usedSentinel->nextUsed = usedSentinel;
+
+	assets->residentBudget = residentBudget;
+	assets->residentSize = 0;
+}
+
+// NOTE(bruno): checks the whole directory once here so the lookups after
+// this can trust it. A missing or broken pack leaves the assets empty and
+// every lookup comes back with the null asset
+bool openAssetPack(GameMemory *gameMemory, Assets *assets, MemoryArena *arena,
+				   const char *filename, size_t residentBudget) {
+	*assets = {};
+	initializeAssetMemory(assets, residentBudget);
+
+	PlatformMappedFile pack = gameMemory->platformMapFile(filename);
+	if (!pack.isValid) return false;
+	if (pack.size < sizeof(AssetPackHeader)) return false;
+
+	uint8 *base = (uint8 *)pack.memory;
+	AssetPackHeader *header = (AssetPackHeader *)base;
+	if (header->magicValue != ASSET_PACK_MAGIC_VALUE ||
+		header->version != ASSET_PACK_VERSION) {
+		return false;
+	}
+
+	if (!isAssetPackRangeValid(&pack, header->types,
+							   header->typeCount * sizeof(AssetPackType)) ||
+		!isAssetPackRangeValid(&pack, header->assets,
+							   header->assetCount * sizeof(AssetPackAsset))) {
+		return false;
+	}
+
+	gameMemory->platformPrefetchMemory(
+		base, header->assets + header->assetCount * sizeof(AssetPackAsset));
+
+	AssetPackType *types = (AssetPackType *)(base + header->types);
+	AssetPackAsset *packAssets = (AssetPackAsset *)(base + header->assets);
+	for (uint32 i = 0; i < header->typeCount; i++) {
+		if (types[i].firstAssetIndex > types[i].onePastLastAssetIndex ||
+			types[i].onePastLastAssetIndex > header->assetCount) {
+			return false;
+		}
+	}
+	for (uint32 i = 0; i < header->assetCount; i++) {
+		if (!isAssetPackAssetValid(&pack, &packAssets[i])) return false;
+	}
+
+	assets->pack = pack;
+	// NOTE(bruno): a pack built before a type was added just has no assets
+	// of that type, one built after only has extra types we ignore
+	assets->typeCount = header->typeCount < Asset_Count ? header->typeCount
+														: (uint32)Asset_Count;
+	assets->types = types;
+	assets->assetCount = header->assetCount;
+	assets->assets = packAssets;
+	assets->slots = pushArray(arena, header->assetCount, AssetSlot);
+	for (uint32 i = 0; i < header->assetCount; i++) {
+		assets->slots[i] = {};
+	}
+	return true;
+}
+
+// NOTE(bruno): 0 is the null asset, it means the pack has none of that type
+uint32 getFirstAsset(Assets *assets, AssetTypeID typeID) {
+	if ((uint32)typeID >= assets->typeCount) return 0;
+
+	AssetPackType *type = &assets->types[typeID];
+	if (type->firstAssetIndex == type->onePastLastAssetIndex) return 0;
+	return type->firstAssetIndex;
+}
+
+inline void unlinkUsedAsset(AssetSlot *slot) {
+	slot->prevUsed->nextUsed = slot->nextUsed;
+	slot->nextUsed->prevUsed = slot->prevUsed;
+}
+
+inline void linkUsedAsset(Assets *assets, AssetSlot *slot) {
+	AssetSlot *sentinel = &assets->usedSentinel;
+	slot->prevUsed = sentinel;
+	slot->nextUsed = sentinel->nextUsed;
+	slot->nextUsed->prevUsed = slot;
+	sentinel->nextUsed = slot;
+}
+
+// NOTE(bruno): only Loaded assets the audio thread is done with can go,
+// Queued ones still have a worker touching their pages
+bool evictLeastRecentlyUsedAsset(GameMemory *gameMemory, Assets *assets) {
+	AssetSlot *sentinel = &assets->usedSentinel;
+	for (AssetSlot *slot = sentinel->prevUsed; slot != sentinel;
+		 slot = slot->prevUsed) {
+		if (slot->state != AssetState_Loaded) continue;
+		if (isSoundPlaying(&slot->sound)) continue;
+
+		unlinkUsedAsset(slot);
+		gameMemory->platformEvictMemory(slot->source, slot->size);
+		assets->residentSize -= slot->size;
+		slot->sound = {};
+		slot->state = AssetState_Unloaded;
+		assets->evictionCount++;
+		return true;
+	}
+	return false;
+}
+
+void loadAssetWork(PlatformWorkQueue *queue, void *data) {
+	TIMED_FUNCTION();
+
+	AssetSlot *slot = (AssetSlot *)data;
+	assert(slot->state == AssetState_Queued);
+
+	// NOTE(bruno): a byte per page is enough to fault the whole payload in,
+	// the sum only keeps the compiler from dropping the reads
+	uint8 volatile *source = (uint8 volatile *)slot->source;
+	uint32 sum = 0;
+	for (uint64 i = 0; i < slot->size; i += ASSET_PAGE_SIZE) {
+		sum += source[i];
+	}
+	sum += source[slot->size - 1];
+	(void)sum;
+
+	atomicStoreUInt32(&slot->state, AssetState_Loaded);
+}
+
+// NOTE(bruno): never blocks. Makes room in the budget if it has to and
+// hands the paging in to the background queue, if even evicting everything we
+// are allowed to doesn't make room the asset stays unloaded and the next
+// request tries again
+void loadAsset(GameMemory *gameMemory, Assets *assets, uint32 assetIndex) {
+	AssetSlot *slot = &assets->slots[assetIndex];
+	AssetPackAsset *asset = &assets->assets[assetIndex];
+
+	while (assets->residentSize + asset->dataSize > assets->residentBudget) {
+		if (!evictLeastRecentlyUsedAsset(gameMemory, assets)) return;
+	}
+
+	slot->source = (uint8 *)assets->pack.memory + asset->dataOffset;
+	slot->size = asset->dataSize;
+	assets->residentSize += slot->size;
+
+	if (asset->kind == AssetKind_Sound) {
+		uint8 *data = (uint8 *)slot->source;
+		uint64 stride = getAssetPackChannelStride(asset->sound.sampleCount);
+
+		slot->sound.sampleCount = asset->sound.sampleCount;
+		slot->sound.channelCount = asset->sound.channelCount;
+		for (uint32 channel = 0; channel < slot->sound.channelCount;
+			 channel++) {
+			slot->sound.samples[channel] = (int16 *)(data + channel * stride);
+		}
+	}
+
+	linkUsedAsset(assets, slot);
+	slot->state = AssetState_Queued;
+	gameMemory->platformPrefetchMemory(slot->source, slot->size);
+	gameMemory->platformAddWorkEntry(gameMemory->backgroundQueue,
+									 loadAssetWork, slot);
+}
+
+// NOTE(bruno): frame thread only. Returns the sound if it is loaded and
+// the placeholder (an empty sound) otherwise, starting the load if nobody
+// asked for it yet. Every request counts as a use for the eviction order
+LoadedSound *getSound(GameMemory *gameMemory, Assets *assets,
+					  uint32 assetIndex) {
+	if (assetIndex == 0 || assetIndex >= assets->assetCount ||
+		assets->assets[assetIndex].kind != AssetKind_Sound) {
+		return &assets->placeholderSound;
+	}
+
+	AssetSlot *slot = &assets->slots[assetIndex];
+	uint32 state = atomicLoadUInt32(&slot->state);
+	if (state == AssetState_Unloaded) {
+		loadAsset(gameMemory, assets, assetIndex);
+		return &assets->placeholderSound;
+	}
+
+	unlinkUsedAsset(slot);
+	linkUsedAsset(assets, slot);
+	if (state == AssetState_Queued) return &assets->placeholderSound;
+	return &slot->sound;
+}
@@ -0,0 +1,144 @@
+#ifndef HANDMADE_ASSET_H
+
+// NOTE(bruno): all the assets live in a single pack file that the packer
+// builds offline. The platform maps the whole file and the game reads the
+// directory and the payloads in place, there is no per asset open, read or
+// copy. Layout:
+//
+//   AssetPackHeader
+//   AssetPackType[typeCount]     indexed by AssetTypeID
+//   AssetPackAsset[assetCount]   asset 0 is the null asset
+//   payloads, each starting on an ASSET_PACK_ALIGNMENT boundary
+
+#define ASSET_PACK_CODE(a, b, c, d)                                            \
+	(((uint32)(a) << 0) | ((uint32)(b) << 8) | ((uint32)(c) << 16) |           \
+	 ((uint32)(d) << 24))
+
+#define ASSET_PACK_MAGIC_VALUE ASSET_PACK_CODE('h', 'm', 'p', 'k')
+#define ASSET_PACK_VERSION 1
+
+// NOTE(bruno): a cache line, so the mixer (and later on the renderer) can
+// load straight from the mapping with aligned SIMD loads
+#define ASSET_PACK_ALIGNMENT 64
+
+// NOTE(bruno): new types go at the end, the pack directory is indexed by
+// these values
+enum AssetTypeID {
+	Asset_None,
+	Asset_DoorSound,
+
+	Asset_Count,
+};
+
+enum AssetKind {
+	AssetKind_None,
+	AssetKind_Sound,
+};
+
+#pragma pack(push, 1)
+struct AssetPackHeader {
+	uint32 magicValue;
+	uint32 version;
+
+	uint32 typeCount;
+	uint32 assetCount;
+
+	// NOTE(bruno): offsets from the start of the file
+	uint64 types;
+	uint64 assets;
+};
+
+struct AssetPackType {
+	uint32 firstAssetIndex;
+	uint32 onePastLastAssetIndex;
+};
+
+// NOTE(bruno): the channels of a sound follow each other, every channel
+// starts on an aligned boundary and ends with the same 4 samples of zero
+// padding LoadedSound has
+struct AssetPackSound {
+	uint32 sampleCount;
+	uint32 channelCount;
+};
+
+struct AssetPackAsset {
+	uint64 dataOffset;
+	uint64 dataSize;
+
+	uint32 kind;
+	union {
+		AssetPackSound sound;
+	};
+};
+#pragma pack(pop)
+
+inline uint64 alignAssetPackOffset(uint64 offset) {
+	return (offset + ASSET_PACK_ALIGNMENT - 1) &
+		   ~(uint64)(ASSET_PACK_ALIGNMENT - 1);
+}
+
+inline uint64 getAssetPackChannelStride(uint32 sampleCount) {
+	return alignAssetPackOffset(((uint64)sampleCount + 4) * sizeof(int16));
+}
+
+// NOTE(bruno): the game plays and draws straight from the mapping, nothing
+// gets copied. What we manage is which payloads are paged in: the first time
+// an asset is asked for the background queue touches its pages, so the page
+// faults happen on a worker and never on the frame or the audio thread. The
+// budget caps how many bytes of the pack we keep paged in, when it is full
+// the least recently used assets get their pages handed back to the kernel.
+// That bounds our resident size, not memory we own: the file data stays in
+// the page cache and the assets take no transient storage at all. The
+// mapping stays for the life of the process, so no asset has to outlive it
+#define ASSET_DEFAULT_RESIDENT_BUDGET Megabytes(64)
+
+// NOTE(bruno): the worker reads a byte every this many, any smaller page size
+// just means some pages fault on first use
+#define ASSET_PAGE_SIZE Kilobytes(4)
+
+enum AssetState {
+	AssetState_Unloaded,
+	AssetState_Queued,
+	AssetState_Loaded,
+};
+
+struct AssetSlot {
+	// NOTE(bruno): the worker only ever moves this from Queued to Loaded,
+	// every other change happens on the frame thread
+	uint32 volatile state;
+
+	// NOTE(bruno): the payload, in the mapping
+	void *source;
+	uint64 size;
+
+	LoadedSound sound;
+
+	// NOTE(bruno): every resident slot is in this list, the most recently used
+	// one first
+	AssetSlot *prevUsed;
+	AssetSlot *nextUsed;
+};
+
+struct Assets {
+	PlatformMappedFile pack;
+
+	uint32 typeCount;
+	AssetPackType *types;
+
+	uint32 assetCount;
+	AssetPackAsset *assets;
+	AssetSlot *slots;
+
+	uint64 residentBudget;
+	// NOTE(bruno): the payloads of every slot in the used list
+	uint64 residentSize;
+	AssetSlot usedSentinel;
+
+	// NOTE(bruno): what getSound hands out while the real one loads
+	LoadedSound placeholderSound;
+
+	uint32 evictionCount;
+};
+
+#define HANDMADE_ASSET_H
+#endif // HANDMADE_ASSET_H
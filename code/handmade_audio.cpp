@@ -0,0 +1,564 @@
+#include "handmade_audio.h"
+
+// NOTE(bruno): frame thread only. Returns false when the audio thread has
+// fallen so far behind that the ring is full, the command is dropped
+bool pushSoundCommand(SoundCommandRing *ring, SoundCommand command) {
+	uint32 writeIndex = ring->writeIndex;
+	uint32 readIndex = atomicLoadUInt32(&ring->readIndex);
+	if (writeIndex - readIndex == SOUND_COMMAND_RING_SIZE) return false;
+
+	if (command.type == SoundCommand_PlaySound && command.sound) {
+		command.sound->playCount++;
+	}
+	ring->commands[writeIndex & (SOUND_COMMAND_RING_SIZE - 1)] = command;
+	atomicStoreUInt32(&ring->writeIndex, writeIndex + 1);
+	return true;
+}
+
+// NOTE(bruno): frame thread only
+inline bool isSoundPlaying(LoadedSound *sound) {
+	return sound->playCount != atomicLoadUInt32(&sound->finishedPlayCount);
+}
+
+// NOTE(bruno): audio thread only
+bool popSoundCommand(SoundCommandRing *ring, SoundCommand *command) {
+	uint32 readIndex = ring->readIndex;
+	uint32 writeIndex = atomicLoadUInt32(&ring->writeIndex);
+	if (readIndex == writeIndex) return false;
+
+	*command = ring->commands[readIndex & (SOUND_COMMAND_RING_SIZE - 1)];
+	atomicStoreUInt32(&ring->readIndex, readIndex + 1);
+	return true;
+}
+
+#pragma pack(push, 1)
+struct WaveHeader {
+	uint32 riffID;
+	uint32 size;
+	uint32 waveID;
+};
+
+struct WaveChunk {
+	uint32 id;
+	uint32 size;
+};
+
+struct WaveFmt {
+	uint16 formatTag;
+	uint16 channelCount;
+	uint32 samplesPerSecond;
+	uint32 averageBytesPerSecond;
+	uint16 blockAlign;
+	uint16 bitsPerSample;
+};
+#pragma pack(pop)
+
+#define RIFF_CODE(a, b, c, d)                                                  \
+	(((uint32)(a) << 0) | ((uint32)(b) << 8) | ((uint32)(c) << 16) |           \
+	 ((uint32)(d) << 24))
+
+enum {
+	WaveChunkID_fmt = RIFF_CODE('f', 'm', 't', ' '),
+	WaveChunkID_data = RIFF_CODE('d', 'a', 't', 'a'),
+	WaveChunkID_RIFF = RIFF_CODE('R', 'I', 'F', 'F'),
+	WaveChunkID_WAVE = RIFF_CODE('W', 'A', 'V', 'E'),
+};
+
+// NOTE(bruno): only 16 bit PCM, mono or stereo. The sample rate is not
+// converted, files are expected to match the output (48000 Hz)
+inline bool isPlayableWaveFormat(WaveFmt *fmt) {
+	return (fmt->formatTag == 1 && fmt->bitsPerSample == 16 &&
+			(fmt->channelCount == 1 || fmt->channelCount == 2));
+}
+
+// NOTE(bruno): also writes the 4 samples of zero padding after each channel
+void deinterleaveSamples(int16 *source, uint32 channelCount,
+						 uint32 sampleCount, int16 **dest) {
+	for (uint32 channel = 0; channel < channelCount; channel++) {
+		int16 *channelDest = dest[channel];
+		for (uint32 i = 0; i < sampleCount; i++) {
+			channelDest[i] = source[i * channelCount + channel];
+		}
+		for (uint32 i = sampleCount; i < sampleCount + 4; i++) {
+			channelDest[i] = 0;
+		}
+	}
+}
+
+// NOTE(bruno): anything we can't play comes back with sampleCount 0
+LoadedSound parseWAV(MemoryArena *arena, void *fileData, size_t fileSize) {
+	LoadedSound result = {};
+	if (fileSize < sizeof(WaveHeader)) return result;
+
+	WaveHeader *header = (WaveHeader *)fileData;
+	if (header->riffID != WaveChunkID_RIFF ||
+		header->waveID != WaveChunkID_WAVE) {
+		return result;
+	}
+
+	uint8 *at = (uint8 *)(header + 1);
+	uint8 *end = (uint8 *)fileData + fileSize;
+
+	WaveFmt *fmt = 0;
+	int16 *sampleData = 0;
+	uint32 sampleDataSize = 0;
+	while (at + sizeof(WaveChunk) <= end) {
+		WaveChunk *chunk = (WaveChunk *)at;
+		uint8 *chunkData = (uint8 *)(chunk + 1);
+		if (chunkData + chunk->size > end) break;
+
+		if (chunk->id == WaveChunkID_fmt && chunk->size >= sizeof(WaveFmt)) {
+			fmt = (WaveFmt *)chunkData;
+		} else if (chunk->id == WaveChunkID_data) {
+			sampleData = (int16 *)chunkData;
+			sampleDataSize = chunk->size;
+		}
+
+		// NOTE(bruno): chunks are padded to an even size
+		at = chunkData + ((chunk->size + 1) & ~1);
+	}
+
+	if (!fmt || !sampleData || !isPlayableWaveFormat(fmt)) return result;
+
+	uint32 channelCount = fmt->channelCount;
+	uint32 sampleCount = sampleDataSize / (channelCount * sizeof(int16));
+
+	result.sampleCount = sampleCount;
+	result.channelCount = channelCount;
+	for (uint32 channel = 0; channel < channelCount; channel++) {
+		result.samples[channel] = pushArray(arena, sampleCount + 4, int16);
+	}
+	deinterleaveSamples(sampleData, channelCount, sampleCount, result.samples);
+
+	return result;
+}
+
+// NOTE(bruno): the sound stays empty until updateLoadingWAV sees the read
+// finish, and empty sounds are never played
+void beginLoadingWAV(GameMemory *gameMemory, MemoryArena *arena,
+					 PendingSoundLoad *load, LoadedSound *sound,
+					 const char *filename) {
+	*load = {};
+	*sound = {};
+	load->sound = sound;
+
+	load->file = gameMemory->platformOpenFile(filename);
+	if (!load->file.isValid) return;
+
+	load->read.file = &load->file;
+	load->read.offset = 0;
+	load->read.size = load->file.size;
+	load->read.dest = pushSize(arena, load->file.size);
+	load->isPending = true;
+	gameMemory->platformSubmitFileRead(&load->read);
+}
+
+void updateLoadingWAV(GameMemory *gameMemory, MemoryArena *arena,
+					  PendingSoundLoad *load) {
+	if (!load->isPending) return;
+
+	uint32 state = atomicLoadUInt32(&load->read.state);
+	if (state == PlatformFileRead_Pending) return;
+
+	if (state == PlatformFileRead_Done) {
+		*load->sound = parseWAV(arena, load->read.dest, load->read.size);
+	}
+	gameMemory->platformCloseFile(&load->file);
+	load->isPending = false;
+}
+
+// NOTE(bruno): only reads the headers, the samples are read later by the
+// background queue. Returns false if the file is missing or can't be played
+bool openStreamingWAV(GameMemory *gameMemory, MemoryArena *arena,
+					  StreamingSound *stream, const char *filename,
+					  bool loop) {
+	*stream = {};
+
+	PlatformFileHandle file = gameMemory->platformOpenFile(filename);
+	if (!file.isValid) return false;
+
+	WaveHeader header;
+	bool isWave = gameMemory->platformReadDataFromFile(&file, 0, sizeof(header),
+													   &header) &&
+				  header.riffID == WaveChunkID_RIFF &&
+				  header.waveID == WaveChunkID_WAVE;
+
+	WaveFmt fmt = {};
+	bool foundFmt = false;
+	uint64 dataOffset = 0;
+	uint32 dataSize = 0;
+	uint64 offset = sizeof(header);
+	while (isWave && offset + sizeof(WaveChunk) <= file.size) {
+		WaveChunk chunk;
+		if (!gameMemory->platformReadDataFromFile(&file, offset, sizeof(chunk),
+												  &chunk)) {
+			break;
+		}
+
+		uint64 chunkDataOffset = offset + sizeof(chunk);
+		if (chunk.id == WaveChunkID_fmt && chunk.size >= sizeof(WaveFmt)) {
+			foundFmt = gameMemory->platformReadDataFromFile(
+				&file, chunkDataOffset, sizeof(fmt), &fmt);
+		} else if (chunk.id == WaveChunkID_data) {
+			dataOffset = chunkDataOffset;
+			dataSize = chunk.size;
+			// NOTE(bruno): some writers leave the data size at 0 or at max
+			// when they stream out the file, trust the file size instead
+			if (dataOffset + dataSize > file.size) {
+				dataSize = (uint32)(file.size - dataOffset);
+			}
+		}
+
+		offset = chunkDataOffset + ((chunk.size + 1) & ~1);
+	}
+
+	if (!foundFmt || !dataOffset || !isPlayableWaveFormat(&fmt)) {
+		gameMemory->platformCloseFile(&file);
+		return false;
+	}
+
+	stream->file = file;
+	stream->dataOffset = dataOffset;
+	stream->channelCount = fmt.channelCount;
+	stream->sampleCount = dataSize / (fmt.channelCount * sizeof(int16));
+	stream->loop = loop;
+	if (stream->sampleCount == 0) {
+		gameMemory->platformCloseFile(&stream->file);
+		return false;
+	}
+
+	for (uint32 i = 0; i < STREAM_BUFFER_COUNT; i++) {
+		StreamBuffer *buffer = &stream->buffers[i];
+		buffer->fileData = pushArray(
+			arena, STREAM_BUFFER_SAMPLES * stream->channelCount, int16);
+		for (uint32 channel = 0; channel < stream->channelCount; channel++) {
+			buffer->samples[channel] =
+				pushArray(arena, STREAM_BUFFER_SAMPLES + 4, int16);
+		}
+	}
+
+	return true;
+}
+
+void loadStreamBufferWork(PlatformWorkQueue *queue, void *data) {
+	TIMED_FUNCTION();
+
+	StreamLoadWork *work = (StreamLoadWork *)data;
+	StreamingSound *stream = work->stream;
+	StreamBuffer *buffer = work->buffer;
+
+	assert(buffer->state == StreamBuffer_Loading);
+	uint64 size = work->sampleCount * stream->channelCount * sizeof(int16);
+	if (work->readDataFromFile(&stream->file, work->fileOffset, size,
+							   buffer->fileData)) {
+		deinterleaveSamples(buffer->fileData, stream->channelCount,
+							work->sampleCount, buffer->samples);
+		buffer->sampleCount = work->sampleCount;
+	} else {
+		// NOTE(bruno): the file went away under us, end the track here
+		buffer->sampleCount = 0;
+		buffer->isLast = true;
+	}
+
+	atomicStoreUInt32(&buffer->state, StreamBuffer_Full);
+}
+
+// NOTE(bruno): frame thread, once per frame. Hands every buffer the mixer is
+// done with back to the background queue, in ring order, so the mixer can
+// just walk the ring
+void updateStreamingSound(GameMemory *gameMemory, StreamingSound *stream) {
+	while (!stream->finishedLoading) {
+		uint32 bufferIndex = stream->nextBufferToLoad;
+		StreamBuffer *buffer = &stream->buffers[bufferIndex];
+		if (atomicLoadUInt32(&buffer->state) != StreamBuffer_Empty) break;
+
+		uint32 samplesLeft = stream->sampleCount - stream->nextSampleToLoad;
+		uint32 sampleCount = samplesLeft < STREAM_BUFFER_SAMPLES
+								 ? samplesLeft
+								 : STREAM_BUFFER_SAMPLES;
+
+		StreamLoadWork *work = &stream->loadWork[bufferIndex];
+		work->stream = stream;
+		work->buffer = buffer;
+		work->fileOffset =
+			stream->dataOffset + (uint64)stream->nextSampleToLoad *
+									 stream->channelCount * sizeof(int16);
+		work->sampleCount = sampleCount;
+		work->readDataFromFile = gameMemory->platformReadDataFromFile;
+
+		stream->nextSampleToLoad += sampleCount;
+		buffer->isLast = false;
+		if (stream->nextSampleToLoad >= stream->sampleCount) {
+			if (stream->loop) {
+				stream->nextSampleToLoad = 0;
+			} else {
+				buffer->isLast = true;
+				stream->finishedLoading = true;
+			}
+		}
+
+		buffer->state = StreamBuffer_Loading;
+		stream->nextBufferToLoad = (bufferIndex + 1) % STREAM_BUFFER_COUNT;
+		gameMemory->platformAddWorkEntry(gameMemory->backgroundQueue,
+										 loadStreamBufferWork, work);
+	}
+}
+
+// NOTE(bruno): constant power pan, so a sound keeps its loudness as it moves
+// across
+inline void getPanVolumes(SoundCommand *command, real32 *volume) {
+	real32 angle = (command->pan + 1.0f) * 0.25f * PI;
+	volume[0] = command->volume * cos(angle);
+	volume[1] = command->volume * sin(angle);
+}
+
+// NOTE(bruno): audio thread only, after this the frame thread is free to let
+// go of the samples
+inline void finishPlayingSound(LoadedSound *sound) {
+	atomicStoreUInt32(&sound->finishedPlayCount,
+					  sound->finishedPlayCount + 1);
+}
+
+void startPlayingSound(GameAudioState *audio, SoundCommand *command) {
+	if (!command->sound) return;
+	// TODO(bruno): steal the quietest voice instead of dropping the new one
+	if (command->sound->sampleCount == 0 ||
+		audio->playingSoundCount >= arraylength(audio->playingSounds)) {
+		finishPlayingSound(command->sound);
+		return;
+	}
+
+	PlayingSound *playingSound =
+		&audio->playingSounds[audio->playingSoundCount++];
+	playingSound->sound = command->sound;
+	playingSound->samplesPlayed = 0;
+	getPanVolumes(command, playingSound->volume);
+}
+
+void startPlayingStream(GameAudioState *audio, SoundCommand *command) {
+	if (!command->stream) return;
+	if (audio->playingStreamCount >= arraylength(audio->playingStreams)) {
+		return;
+	}
+
+	PlayingStream *playingStream =
+		&audio->playingStreams[audio->playingStreamCount++];
+	playingStream->stream = command->stream;
+	getPanVolumes(command, playingStream->volume);
+}
+
+void applySoundCommands(SoundCommandRing *ring, GameAudioState *audio) {
+	SoundCommand command;
+	while (popSoundCommand(ring, &command)) {
+		switch (command.type) {
+			case SoundCommand_SetTone: {
+				audio->toneHz = command.toneHz;
+				audio->toneVolume = command.toneVolume;
+			} break;
+			case SoundCommand_PlaySound: {
+				startPlayingSound(audio, &command);
+			} break;
+			case SoundCommand_PlayStream: {
+				startPlayingStream(audio, &command);
+			} break;
+		}
+	}
+}
+
+// NOTE(bruno): sign extends four int16 into four floats
+inline __m128 loadSamples4(int16 *samples) {
+	__m128i packed = _mm_loadl_epi64((__m128i *)samples);
+	__m128i widened = _mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16);
+	return _mm_cvtepi32_ps(widened);
+}
+
+// NOTE(bruno): works in groups of 4, so it reads up to 3 samples past
+// sampleCount from the sources and adds them up to 3 samples past sampleCount
+// in the destination. Those either come from the zero padding or land past
+// the end of the chunk, where nobody reads them. The destination does not
+// have to be aligned, streams start mixing wherever a buffer ran out
+void mixSamples(real32 *dest0, real32 *dest1, int16 *source0, int16 *source1,
+				uint32 sampleCount, real32 *volume) {
+	uint32 sampleCount4 = (sampleCount + 3) & ~3;
+
+	__m128 volume0 = _mm_set1_ps(volume[0]);
+	__m128 volume1 = _mm_set1_ps(volume[1]);
+	for (uint32 i = 0; i < sampleCount4; i += 4) {
+		__m128 sample0 = loadSamples4(source0 + i);
+		__m128 sample1 = loadSamples4(source1 + i);
+		_mm_storeu_ps(dest0 + i, _mm_add_ps(_mm_loadu_ps(dest0 + i),
+											_mm_mul_ps(sample0, volume0)));
+		_mm_storeu_ps(dest1 + i, _mm_add_ps(_mm_loadu_ps(dest1 + i),
+											_mm_mul_ps(sample1, volume1)));
+	}
+}
+
+void mixPlayingSounds(GameAudioState *audio, uint32 sampleCount) {
+	TIMED_FUNCTION();
+
+	for (uint32 soundIndex = 0; soundIndex < audio->playingSoundCount;) {
+		PlayingSound *playingSound = &audio->playingSounds[soundIndex];
+		LoadedSound *sound = playingSound->sound;
+
+		uint32 samplesLeft = sound->sampleCount - playingSound->samplesPlayed;
+		uint32 samplesToMix =
+			samplesLeft < sampleCount ? samplesLeft : sampleCount;
+
+		int16 *source0 = sound->samples[0] + playingSound->samplesPlayed;
+		int16 *source1 = source0;
+		if (sound->channelCount == 2) {
+			source1 = sound->samples[1] + playingSound->samplesPlayed;
+		}
+
+		mixSamples(audio->mixChannel0, audio->mixChannel1, source0, source1,
+				   samplesToMix, playingSound->volume);
+
+		playingSound->samplesPlayed += samplesToMix;
+		if (playingSound->samplesPlayed >= sound->sampleCount) {
+			finishPlayingSound(sound);
+			*playingSound =
+				audio->playingSounds[--audio->playingSoundCount];
+		} else {
+			soundIndex++;
+		}
+	}
+}
+
+// NOTE(bruno): returns false once the last buffer of the track is done
+bool mixStreamingSound(GameAudioState *audio, PlayingStream *playingStream,
+					   uint32 sampleCount) {
+	StreamingSound *stream = playingStream->stream;
+
+	uint32 samplesMixed = 0;
+	while (samplesMixed < sampleCount) {
+		StreamBuffer *buffer = &stream->buffers[stream->readBuffer];
+		if (atomicLoadUInt32(&buffer->state) != StreamBuffer_Full) {
+			// NOTE(bruno): never wait on the loads from the audio thread,
+			// the rest of this chunk is silence for this stream
+			stream->starvedSampleCount += sampleCount - samplesMixed;
+			break;
+		}
+
+		uint32 samplesLeft = buffer->sampleCount - stream->readSampleIndex;
+		uint32 samplesToMix = sampleCount - samplesMixed;
+		if (samplesToMix > samplesLeft) samplesToMix = samplesLeft;
+
+		int16 *source0 = buffer->samples[0] + stream->readSampleIndex;
+		int16 *source1 = source0;
+		if (stream->channelCount == 2) {
+			source1 = buffer->samples[1] + stream->readSampleIndex;
+		}
+
+		mixSamples(audio->mixChannel0 + samplesMixed,
+				   audio->mixChannel1 + samplesMixed, source0, source1,
+				   samplesToMix, playingStream->volume);
+
+		samplesMixed += samplesToMix;
+		stream->readSampleIndex += samplesToMix;
+		if (stream->readSampleIndex >= buffer->sampleCount) {
+			bool isLast = buffer->isLast;
+			stream->readSampleIndex = 0;
+			stream->readBuffer = (stream->readBuffer + 1) % STREAM_BUFFER_COUNT;
+			atomicStoreUInt32(&buffer->state, StreamBuffer_Empty);
+			if (isLast) return false;
+		}
+	}
+
+	return true;
+}
+
+void mixPlayingStreams(GameAudioState *audio, uint32 sampleCount) {
+	TIMED_FUNCTION();
+
+	for (uint32 streamIndex = 0; streamIndex < audio->playingStreamCount;) {
+		PlayingStream *playingStream = &audio->playingStreams[streamIndex];
+		if (mixStreamingSound(audio, playingStream, sampleCount)) {
+			streamIndex++;
+		} else {
+			*playingStream =
+				audio->playingStreams[--audio->playingStreamCount];
+		}
+	}
+}
+
+void clearMixChannels(GameAudioState *audio, uint32 sampleCount) {
+	assert(sampleCount <= AUDIO_MIX_CHUNK_SAMPLES);
+
+	// NOTE(bruno): clears the spill area past the chunk too, so whatever
+	// lands there never piles up across chunks
+	uint32 sampleCount4 = ((sampleCount + 3) & ~3) + 4;
+	__m128 zero = _mm_setzero_ps();
+	for (uint32 i = 0; i < sampleCount4; i += 4) {
+		_mm_store_ps(audio->mixChannel0 + i, zero);
+		_mm_store_ps(audio->mixChannel1 + i, zero);
+	}
+}
+
+void mixTone(GameAudioState *audio, int sampleRate, uint32 sampleCount) {
+	if (audio->toneHz <= 0.0f) return;
+
+	real32 wavePeriod = (real32)sampleRate / audio->toneHz;
+	for (uint32 i = 0; i < sampleCount; i++) {
+		// TODO(bruno): ditch this compile-time flag once we stop debugging
+		// audio with a sine wave
+#if ENABLE_SINE_WAVE
+		real32 sampleValue = sin(audio->tsine) * audio->toneVolume;
+		audio->mixChannel0[i] += sampleValue;
+		audio->mixChannel1[i] += sampleValue;
+#endif
+
+		audio->tsine += 2.0f * PI * 1.0f / wavePeriod;
+		if (audio->tsine > 2.0f * PI) {
+			audio->tsine -= 2.0f * PI;
+		}
+	}
+}
+
+// NOTE(bruno): rounds, saturates to int16 and interleaves the two channels
+void writeMixedSamples(GameAudioState *audio, int16 *sampleOut,
+					   uint32 sampleCount) {
+	uint32 sampleCount4 = sampleCount & ~3;
+	for (uint32 i = 0; i < sampleCount4; i += 4) {
+		__m128i left = _mm_cvtps_epi32(_mm_load_ps(audio->mixChannel0 + i));
+		__m128i right = _mm_cvtps_epi32(_mm_load_ps(audio->mixChannel1 + i));
+		__m128i left16 = _mm_packs_epi32(left, left);
+		__m128i right16 = _mm_packs_epi32(right, right);
+		_mm_storeu_si128((__m128i *)sampleOut,
+						 _mm_unpacklo_epi16(left16, right16));
+		sampleOut += 8;
+	}
+
+	for (uint32 i = sampleCount4; i < sampleCount; i++) {
+		real32 channels[2] = {audio->mixChannel0[i], audio->mixChannel1[i]};
+		for (uint32 channel = 0; channel < 2; channel++) {
+			real32 value = channels[channel];
+			if (value > 32767.0f) value = 32767.0f;
+			if (value < -32768.0f) value = -32768.0f;
+			// NOTE(bruno): same round to nearest even as the vector path
+			*sampleOut++ = (int16)_mm_cvtss_si32(_mm_set_ss(value));
+		}
+	}
+}
+
+void gameOutputSound(GameSoundBuffer *soundBuffer, GameAudioState *audio) {
+	TIMED_FUNCTION();
+
+	int16 *sampleOut = soundBuffer->samples;
+	uint32 samplesRemaining = (uint32)soundBuffer->sampleCount;
+
+	while (samplesRemaining) {
+		uint32 chunkSampleCount = samplesRemaining;
+		if (chunkSampleCount > AUDIO_MIX_CHUNK_SAMPLES) {
+			chunkSampleCount = AUDIO_MIX_CHUNK_SAMPLES;
+		}
+
+		clearMixChannels(audio, chunkSampleCount);
+		mixPlayingSounds(audio, chunkSampleCount);
+		mixPlayingStreams(audio, chunkSampleCount);
+		mixTone(audio, soundBuffer->sampleRate, chunkSampleCount);
+		writeMixedSamples(audio, sampleOut, chunkSampleCount);
+
+		sampleOut += 2 * chunkSampleCount;
+		samplesRemaining -= chunkSampleCount;
+	}
+}
@@ -0,0 +1,159 @@
+#ifndef HANDMADE_AUDIO_H
+
+// NOTE(bruno): gameGetSoundSamples runs on the platform audio thread while
+// gameUpdateAndRender runs on the frame thread. The frame thread never touches
+// GameAudioState, it only pushes commands into the ring, and the audio thread
+// drains the ring before it mixes.
+
+// NOTE(bruno): samples are stored per channel so the mixer can read four at a
+// time. Every channel has at least 4 zeroed samples past sampleCount, so the
+// mixer can read a whole group of 4 at the end without checking bounds
+struct LoadedSound {
+	uint32 sampleCount;
+	uint32 channelCount;
+	int16 *samples[2];
+
+	// NOTE(bruno): the frame thread counts the plays it hands over and the
+	// audio thread the ones it is done with, the samples are in use while the
+	// two differ
+	uint32 playCount;
+	uint32 volatile finishedPlayCount;
+};
+
+// NOTE(bruno): a sound file being read in the background. The whole file
+// lands in arena memory and gets parsed once the read is done
+struct PendingSoundLoad {
+	bool isPending;
+	PlatformFileHandle file;
+	PlatformFileRead read;
+	LoadedSound *sound;
+};
+
+// NOTE(bruno): long tracks are never loaded whole. The background queue reads
+// them a chunk at a time into a small ring of buffers and the mixer plays the
+// buffers in order, handing each one back once it is done with it. At 48000
+// Hz a buffer is about a third of a second, so the ring holds about a second
+#define STREAM_BUFFER_COUNT 3
+#define STREAM_BUFFER_SAMPLES 16384
+
+enum StreamBufferState {
+	StreamBuffer_Empty,
+	StreamBuffer_Loading,
+	StreamBuffer_Full,
+};
+
+struct StreamBuffer {
+	uint32 volatile state;
+
+	uint32 sampleCount;
+	bool isLast;
+	// NOTE(bruno): per channel with the same zero padding as LoadedSound
+	int16 *samples[2];
+	// NOTE(bruno): interleaved, straight from the file
+	int16 *fileData;
+};
+
+struct StreamingSound;
+
+struct StreamLoadWork {
+	StreamingSound *stream;
+	StreamBuffer *buffer;
+	uint64 fileOffset;
+	uint32 sampleCount;
+	PlatformReadDataFromFileFunc readDataFromFile;
+};
+
+struct StreamingSound {
+	PlatformFileHandle file;
+	uint64 dataOffset;
+	uint32 sampleCount;
+	uint32 channelCount;
+	bool loop;
+
+	// NOTE(bruno): frame thread only
+	uint32 nextSampleToLoad;
+	uint32 nextBufferToLoad;
+	bool finishedLoading;
+	StreamLoadWork loadWork[STREAM_BUFFER_COUNT];
+
+	// NOTE(bruno): audio thread only
+	uint32 readBuffer;
+	uint32 readSampleIndex;
+	// NOTE(bruno): samples we had to replace with silence because the loads
+	// fell behind
+	uint32 starvedSampleCount;
+
+	StreamBuffer buffers[STREAM_BUFFER_COUNT];
+};
+
+enum SoundCommandType {
+	SoundCommand_SetTone,
+	SoundCommand_PlaySound,
+	SoundCommand_PlayStream,
+};
+
+struct SoundCommand {
+	SoundCommandType type;
+
+	real32 toneHz;
+	real32 toneVolume;
+
+	// NOTE(bruno): the sound data has to stay put while it plays, the audio
+	// thread holds on to this pointer
+	LoadedSound *sound;
+	StreamingSound *stream;
+	real32 volume;
+	// NOTE(bruno): -1 is full left, 1 is full right
+	real32 pan;
+};
+
+// NOTE(bruno): must be a power of two, the indices run freely and wrap
+#define SOUND_COMMAND_RING_SIZE 64
+
+// NOTE(bruno): single producer (frame thread), single consumer (audio thread)
+struct SoundCommandRing {
+	uint32 volatile readIndex;
+	uint32 volatile writeIndex;
+	SoundCommand commands[SOUND_COMMAND_RING_SIZE];
+};
+
+struct PlayingSound {
+	LoadedSound *sound;
+	uint32 samplesPlayed;
+	real32 volume[2];
+};
+
+struct PlayingStream {
+	StreamingSound *stream;
+	real32 volume[2];
+};
+
+#define MAX_PLAYING_SOUNDS 64
+#define MAX_PLAYING_STREAMS 4
+// NOTE(bruno): must be a multiple of 4, the mixer works in groups of 4
+#define AUDIO_MIX_CHUNK_SAMPLES 1024
+// NOTE(bruno): a group of 4 that starts at the end of a chunk spills up to 3
+// samples past it
+#define AUDIO_MIX_CHANNEL_SAMPLES (AUDIO_MIX_CHUNK_SAMPLES + 4)
+
+struct GameAudioState {
+	bool isInitialized;
+
+	real32 tsine;
+	real32 toneHz;
+	real32 toneVolume;
+
+	uint32 playingSoundCount;
+	PlayingSound playingSounds[MAX_PLAYING_SOUNDS];
+
+	uint32 playingStreamCount;
+	PlayingStream playingStreams[MAX_PLAYING_STREAMS];
+
+	// NOTE(bruno): sounds get summed here in float and only clamped back to
+	// int16 once everything is mixed
+	alignas(16) real32 mixChannel0[AUDIO_MIX_CHANNEL_SAMPLES];
+	alignas(16) real32 mixChannel1[AUDIO_MIX_CHANNEL_SAMPLES];
+};
+
+#define HANDMADE_AUDIO_H
+#endif // HANDMADE_AUDIO_H
@@ -0,0 +1,389 @@
+#include "handmade_debug.h"
+
+// NOTE(bruno): collation, only ever called from one thread (the platform's
+// main thread). Nothing in here runs when the profiler is compiled out
+
+inline void copyDebugString(char *dest, uint32 destSize, const char *source) {
+	uint32 i = 0;
+	for (; i < destSize - 1 && source[i]; i++) {
+		dest[i] = source[i];
+	}
+	dest[i] = 0;
+}
+
+// NOTE(bruno): the record might hold a truncated copy, so only the part that
+// fit has to match
+inline bool isDebugStringEqual(const char *record, uint32 recordSize,
+							   const char *source) {
+	for (uint32 i = 0; i < recordSize - 1; i++) {
+		if (record[i] != source[i]) return false;
+		if (!record[i]) return true;
+	}
+	return true;
+}
+
+void resetDebugFrame(DebugFrame *frame, uint64 beginClock) {
+	frame->beginClock = beginClock;
+	frame->endClock = 0;
+	frame->droppedEventCount = 0;
+	frame->nodeCount = 1;
+	frame->nodes[0] = {};
+	frame->nodes[0].siteIndex = DEBUG_NO_SITE;
+	for (uint32 i = 0; i < DEBUG_MAX_THREADS; i++) {
+		frame->threadRoots[i] = 0;
+	}
+}
+
+void initializeDebugTable(DebugTable *table) {
+	resetDebugFrame(&table->frames[0], __rdtsc());
+}
+
+inline DebugFrame *getCollatingDebugFrame(DebugTable *table) {
+	return &table->frames[table->frameCount % DEBUG_FRAME_COUNT];
+}
+
+// NOTE(bruno): the most recent frame that is done, 0 before the first one
+DebugFrame *getLastDebugFrame(DebugTable *table) {
+	if (table->frameCount == 0) return 0;
+	return &table->frames[(table->frameCount - 1) % DEBUG_FRAME_COUNT];
+}
+
+// NOTE(bruno): the first time we see a site pointer we match it against the
+// sites we already know by name, so a site keeps its index across reloads
+uint32 getDebugSiteIndex(DebugTable *table, DebugSite *site) {
+	uint32 slot = (uint32)(((uint64)site * 0x9E3779B97F4A7C15ull) >> 32) &
+				  (DEBUG_SITE_CACHE_SIZE - 1);
+	for (uint32 probe = 0; probe < DEBUG_SITE_CACHE_SIZE; probe++) {
+		DebugSiteCacheEntry *entry = &table->siteCache[slot];
+		if (entry->source == site) return entry->siteIndex;
+		if (!entry->source) break;
+		slot = (slot + 1) & (DEBUG_SITE_CACHE_SIZE - 1);
+	}
+
+	uint32 siteIndex = DEBUG_NO_SITE;
+	for (uint32 i = 0; i < table->siteCount; i++) {
+		DebugSiteRecord *record = &table->sites[i];
+		if (record->line == site->line &&
+			isDebugStringEqual(record->name, sizeof(record->name),
+							   site->name) &&
+			isDebugStringEqual(record->file, sizeof(record->file),
+							   site->file)) {
+			siteIndex = i;
+			break;
+		}
+	}
+	if (siteIndex == DEBUG_NO_SITE) {
+		if (table->siteCount == DEBUG_MAX_SITES) return DEBUG_NO_SITE;
+
+		siteIndex = table->siteCount++;
+		DebugSiteRecord *record = &table->sites[siteIndex];
+		copyDebugString(record->file, sizeof(record->file), site->file);
+		copyDebugString(record->name, sizeof(record->name), site->name);
+		record->line = site->line;
+	}
+
+	// NOTE(bruno): a full cache only means we keep matching by name
+	if (!table->siteCache[slot].source) {
+		table->siteCache[slot].source = site;
+		table->siteCache[slot].siteIndex = siteIndex;
+	}
+	return siteIndex;
+}
+
+// NOTE(bruno): call before the game library is unloaded and after every
+// event it recorded has been collated, its site pointers are about to dangle
+void forgetDebugSitePointers(DebugTable *table) {
+	for (uint32 i = 0; i < DEBUG_SITE_CACHE_SIZE; i++) {
+		table->siteCache[i] = {};
+	}
+}
+
+uint32 addDebugNode(DebugFrame *frame, uint32 parent, uint32 siteIndex) {
+	if (frame->nodeCount == DEBUG_MAX_NODES_PER_FRAME) return 0;
+
+	uint32 nodeIndex = frame->nodeCount++;
+	DebugNode *node = &frame->nodes[nodeIndex];
+	*node = {};
+	node->siteIndex = siteIndex;
+	node->parent = parent;
+	if (parent) {
+		node->nextSibling = frame->nodes[parent].firstChild;
+		frame->nodes[parent].firstChild = nodeIndex;
+	}
+	return nodeIndex;
+}
+
+uint32 getDebugThreadRoot(DebugFrame *frame, uint32 threadIndex) {
+	if (!frame->threadRoots[threadIndex]) {
+		frame->threadRoots[threadIndex] = addDebugNode(frame, 0, DEBUG_NO_SITE);
+	}
+	return frame->threadRoots[threadIndex];
+}
+
+uint32 getDebugChildNode(DebugFrame *frame, uint32 parent, uint32 siteIndex) {
+	if (!parent) return 0;
+
+	for (uint32 child = frame->nodes[parent].firstChild; child;
+		 child = frame->nodes[child].nextSibling) {
+		if (frame->nodes[child].siteIndex == siteIndex) return child;
+	}
+	return addDebugNode(frame, parent, siteIndex);
+}
+
+// NOTE(bruno): a full ring drops the record, the capture carries on
+void pushDebugTraceRecord(DebugTraceRing *ring, uint64 clock,
+						  uint32 siteIndex, DebugTraceRecordType type,
+						  uint32 threadIndex) {
+	uint32 writeIndex = ring->writeIndex;
+	uint32 readIndex = atomicLoadUInt32(&ring->readIndex);
+	if (writeIndex - readIndex == DEBUG_TRACE_RING_SIZE) {
+		ring->droppedCount++;
+		return;
+	}
+
+	DebugTraceRecord *record =
+		&ring->records[writeIndex & (DEBUG_TRACE_RING_SIZE - 1)];
+	record->clock = clock;
+	record->siteIndex = siteIndex;
+	record->type = (uint8)type;
+	record->threadIndex = (uint8)threadIndex;
+	atomicStoreUInt32(&ring->writeIndex, writeIndex + 1);
+}
+
+void collateDebugEvent(DebugTable *table, DebugFrame *frame,
+					   uint32 threadIndex, DebugEvent *event) {
+	DebugThreadState *state = &table->threadStates[threadIndex];
+
+	if (event->type == DebugEvent_BeginBlock) {
+		uint32 siteIndex = getDebugSiteIndex(table, event->site);
+		if (table->trace) {
+			pushDebugTraceRecord(table->trace, event->clock, siteIndex,
+								 DebugTrace_BeginBlock, threadIndex);
+		}
+
+		if (state->depth == DEBUG_MAX_DEPTH) {
+			state->skippedDepth++;
+			return;
+		}
+
+		uint32 parent = state->depth
+							? state->stack[state->depth - 1].node
+							: getDebugThreadRoot(frame, threadIndex);
+
+		DebugOpenBlock *block = &state->stack[state->depth++];
+		block->siteIndex = siteIndex;
+		block->node = getDebugChildNode(frame, parent, siteIndex);
+		block->beginClock = event->clock;
+	} else {
+		if (table->trace) {
+			pushDebugTraceRecord(table->trace, event->clock, DEBUG_NO_SITE,
+								 DebugTrace_EndBlock, threadIndex);
+		}
+
+		if (state->skippedDepth) {
+			state->skippedDepth--;
+			return;
+		}
+		// NOTE(bruno): the block began before we had a table to record into
+		if (state->depth == 0) return;
+
+		DebugOpenBlock *block = &state->stack[--state->depth];
+		if (block->node) {
+			DebugNode *node = &frame->nodes[block->node];
+			node->cycles += event->clock - block->beginClock;
+			node->hitCount++;
+		}
+	}
+}
+
+// NOTE(bruno): swaps every thread over to its other buffer and folds the one
+// it was recording into into the frame being filled
+void collateDebugEvents(DebugTable *table) {
+	DebugFrame *frame = getCollatingDebugFrame(table);
+
+	for (uint32 threadIndex = 0; threadIndex < DEBUG_MAX_THREADS;
+		 threadIndex++) {
+		DebugThreadEvents *thread = &table->threads[threadIndex];
+		if (!atomicLoadUInt64(&thread->threadID)) continue;
+
+		// NOTE(bruno): each thread flips its own buffer instead of all of
+		// them following a global one, a thread that got its slot between
+		// two swaps starts on whichever buffer its slot was left on
+		uint64 current = atomicLoadUInt64(&thread->arrayIndexEventIndex);
+		uint32 arrayIndex = (uint32)(current >> 32);
+		uint64 swapped = atomicExchangeUInt64(&thread->arrayIndexEventIndex,
+											  (uint64)(arrayIndex ^ 1) << 32);
+		arrayIndex = (uint32)(swapped >> 32);
+		uint32 reservedCount = (uint32)swapped;
+
+		// NOTE(bruno): a thread can be halfway through writing its last
+		// event, that only ever takes a few instructions
+		while (atomicLoadUInt32(&thread->committedCount[arrayIndex]) !=
+			   reservedCount) {
+			_mm_pause();
+		}
+		atomicStoreUInt32(&thread->committedCount[arrayIndex], 0);
+
+		uint32 eventCount = reservedCount;
+		if (eventCount > DEBUG_MAX_EVENTS_PER_THREAD) {
+			frame->droppedEventCount +=
+				eventCount - DEBUG_MAX_EVENTS_PER_THREAD;
+			eventCount = DEBUG_MAX_EVENTS_PER_THREAD;
+		}
+
+		for (uint32 i = 0; i < eventCount; i++) {
+			collateDebugEvent(table, frame, threadIndex,
+							  &thread->events[arrayIndex][i]);
+		}
+	}
+}
+
+void computeDebugSelfCycles(DebugFrame *frame) {
+	for (uint32 i = 1; i < frame->nodeCount; i++) {
+		frame->nodes[i].selfCycles = frame->nodes[i].cycles;
+	}
+	for (uint32 i = 1; i < frame->nodeCount; i++) {
+		DebugNode *node = &frame->nodes[i];
+		if (!node->parent) continue;
+
+		DebugNode *parent = &frame->nodes[node->parent];
+		if (parent->siteIndex == DEBUG_NO_SITE) {
+			parent->cycles += node->cycles;
+		} else {
+			parent->selfCycles -= node->cycles;
+		}
+	}
+}
+
+// NOTE(bruno): blocks still open when the frame ends get the part of them
+// that falls inside it and carry on into the next frame, so a long block
+// shows up in every frame it spans instead of as one spike at the end
+void endDebugFrame(DebugTable *table) {
+	collateDebugEvents(table);
+
+	uint64 endClock = __rdtsc();
+	DebugFrame *frame = getCollatingDebugFrame(table);
+	frame->endClock = endClock;
+
+	for (uint32 threadIndex = 0; threadIndex < DEBUG_MAX_THREADS;
+		 threadIndex++) {
+		DebugThreadState *state = &table->threadStates[threadIndex];
+		for (uint32 i = 0; i < state->depth; i++) {
+			DebugOpenBlock *block = &state->stack[i];
+			if (block->node) {
+				frame->nodes[block->node].cycles +=
+					endClock - block->beginClock;
+			}
+			block->beginClock = endClock;
+		}
+	}
+	computeDebugSelfCycles(frame);
+	if (table->trace) {
+		pushDebugTraceRecord(table->trace, endClock, (uint32)table->frameCount,
+							 DebugTrace_FrameEnd, 0);
+	}
+
+	table->frameCount++;
+	DebugFrame *nextFrame = getCollatingDebugFrame(table);
+	resetDebugFrame(nextFrame, endClock);
+
+	for (uint32 threadIndex = 0; threadIndex < DEBUG_MAX_THREADS;
+		 threadIndex++) {
+		DebugThreadState *state = &table->threadStates[threadIndex];
+		if (!state->depth) continue;
+
+		uint32 parent = getDebugThreadRoot(nextFrame, threadIndex);
+		for (uint32 i = 0; i < state->depth; i++) {
+			DebugOpenBlock *block = &state->stack[i];
+			block->node =
+				getDebugChildNode(nextFrame, parent, block->siteIndex);
+			parent = block->node;
+		}
+	}
+}
+
+// NOTE(bruno): 0 if parent has no child by that name
+uint32 findDebugChildNode(DebugTable *table, DebugFrame *frame, uint32 parent,
+						  const char *name) {
+	if (!parent) return 0;
+
+	for (uint32 child = frame->nodes[parent].firstChild; child;
+		 child = frame->nodes[child].nextSibling) {
+		uint32 siteIndex = frame->nodes[child].siteIndex;
+		if (siteIndex < table->siteCount &&
+			isDebugStringEqual(table->sites[siteIndex].name,
+							   sizeof(table->sites[0].name), name)) {
+			return child;
+		}
+	}
+	return 0;
+}
+
+// NOTE(bruno): the sites with the most self cycles in the frame, the hottest
+// first. A site that shows up under several parents counts once with all of
+// them summed up. Returns how many it found, up to maxCount
+uint32 getHottestDebugSites(DebugTable *table, DebugFrame *frame,
+							DebugSiteTotal *hottest, uint32 maxCount) {
+	DebugSiteTotal totals[DEBUG_MAX_SITES];
+	uint32 siteCount = table->siteCount;
+	for (uint32 i = 0; i < siteCount; i++) {
+		totals[i] = {};
+		totals[i].siteIndex = i;
+	}
+	for (uint32 i = 1; i < frame->nodeCount; i++) {
+		DebugNode *node = &frame->nodes[i];
+		if (node->siteIndex >= siteCount) continue;
+		totals[node->siteIndex].hitCount += node->hitCount;
+		totals[node->siteIndex].selfCycles += node->selfCycles;
+	}
+
+	uint32 count = 0;
+	for (uint32 i = 0; i < siteCount; i++) {
+		DebugSiteTotal *total = &totals[i];
+		if (!total->selfCycles) continue;
+
+		uint32 at = count < maxCount ? count++ : maxCount;
+		while (at > 0 && hottest[at - 1].selfCycles < total->selfCycles) {
+			if (at < maxCount) hottest[at] = hottest[at - 1];
+			at--;
+		}
+		if (at < maxCount) hottest[at] = *total;
+	}
+	return count;
+}
+
+void printDebugNodes(DebugTable *table, DebugFrame *frame, uint32 parent,
+					 uint32 depth, uint32 maxDepth) {
+	for (uint32 child = frame->nodes[parent].firstChild; child;
+		 child = frame->nodes[child].nextSibling) {
+		DebugNode *node = &frame->nodes[child];
+		const char *name = node->siteIndex < table->siteCount
+							   ? table->sites[node->siteIndex].name
+							   : "?";
+		printf("%*s%-*s %9.3f Mcycles  self %9.3f  hits %u\n", 2 * depth,
+			   "", 32 - 2 * depth, name, (real64)node->cycles / 1000000.0,
+			   (real64)node->selfCycles / 1000000.0, node->hitCount);
+		if (depth + 1 < maxDepth) {
+			printDebugNodes(table, frame, child, depth + 1, maxDepth);
+		}
+	}
+}
+
+void printLastDebugFrame(DebugTable *table, uint32 maxDepth) {
+	DebugFrame *frame = getLastDebugFrame(table);
+	if (!frame) return;
+
+	printf("frame %lu: %.3f Mcycles, %u nodes, %u events dropped\n",
+		   (unsigned long)(table->frameCount - 1),
+		   (real64)(frame->endClock - frame->beginClock) / 1000000.0,
+		   frame->nodeCount, frame->droppedEventCount);
+	for (uint32 threadIndex = 0; threadIndex < DEBUG_MAX_THREADS;
+		 threadIndex++) {
+		uint32 root = frame->threadRoots[threadIndex];
+		if (!root) continue;
+
+		printf("thread %u: %.3f Mcycles\n", threadIndex,
+			   (real64)frame->nodes[root].cycles / 1000000.0);
+		printDebugNodes(table, frame, root, 1, maxDepth + 1);
+	}
+}
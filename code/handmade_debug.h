@@ -0,0 +1,255 @@
+#ifndef HANDMADE_DEBUG_H
+
+#include "handmade_intrinsics.h"
+
+// NOTE(bruno): TIMED_BLOCK and TIMED_FUNCTION record a begin and an end event
+// with the cycle counter into a buffer that belongs to the calling thread, so
+// threads never fight over a cache line while they record. Once a frame the
+// platform swaps every thread over to its other buffer and folds what was
+// recorded into a per frame call hierarchy, see handmade_debug.cpp.
+//
+// The table lives in platform memory and both layers point at it, the game
+// gets it through GameMemory on every call. Sites are identified by their
+// DebugSite, which lives inside whichever module recorded it, so the platform
+// folds everything in before the game library goes away and only keeps
+// copies of the names after that.
+
+#define DEBUG_MAX_THREADS 32
+#define DEBUG_MAX_EVENTS_PER_THREAD 16384
+#define DEBUG_MAX_SITES 512
+// NOTE(bruno): must be a power of two
+#define DEBUG_SITE_CACHE_SIZE 1024
+#define DEBUG_MAX_NODES_PER_FRAME 2048
+#define DEBUG_MAX_DEPTH 64
+#define DEBUG_FRAME_COUNT 128
+
+#define DEBUG_NO_SITE 0xFFFFFFFF
+
+struct DebugSite {
+	const char *file;
+	const char *name;
+	int32 line;
+};
+
+enum DebugEventType {
+	DebugEvent_BeginBlock,
+	DebugEvent_EndBlock,
+};
+
+struct DebugEvent {
+	uint64 clock;
+	DebugSite *site;
+	uint8 type;
+};
+
+struct DebugThreadEvents {
+	// NOTE(bruno): whatever the thread pointer of the owning thread is, 0
+	// while the slot is free. Slots are claimed on a thread's first event and
+	// kept for good
+	uint64 volatile threadID;
+	// NOTE(bruno): set by the platform for its own threads, has to be a
+	// string that outlives the game library
+	const char *volatile name;
+
+	// NOTE(bruno): the high half is the buffer the thread records into, the
+	// low half how many events have been reserved in it. Reserving and
+	// swapping are both one atomic operation on this, so an event can never
+	// land in a buffer that was already swapped out
+	uint64 volatile arrayIndexEventIndex;
+	// NOTE(bruno): bumped once an event is fully written, the platform waits
+	// for this to catch up with the reservations before it reads a buffer
+	uint32 volatile committedCount[2];
+
+	DebugEvent events[2][DEBUG_MAX_EVENTS_PER_THREAD];
+};
+
+struct DebugSiteRecord {
+	char file[96];
+	char name[64];
+	int32 line;
+};
+
+struct DebugSiteCacheEntry {
+	DebugSite *source;
+	uint32 siteIndex;
+};
+
+// NOTE(bruno): node 0 of every frame is a sink for whatever didn't fit, node
+// indices of 0 mean none
+struct DebugNode {
+	uint32 siteIndex;
+	uint32 parent;
+	uint32 firstChild;
+	uint32 nextSibling;
+
+	uint32 hitCount;
+	uint64 cycles;
+	// NOTE(bruno): cycles minus the cycles of the children, filled in when
+	// the frame ends
+	uint64 selfCycles;
+};
+
+struct DebugFrame {
+	uint64 beginClock;
+	uint64 endClock;
+
+	uint32 droppedEventCount;
+	uint32 nodeCount;
+	// NOTE(bruno): one root per thread that recorded anything, its cycles are
+	// the sum of its top level blocks
+	uint32 threadRoots[DEBUG_MAX_THREADS];
+	DebugNode nodes[DEBUG_MAX_NODES_PER_FRAME];
+};
+
+struct DebugOpenBlock {
+	uint32 siteIndex;
+	uint32 node;
+	uint64 beginClock;
+};
+
+struct DebugThreadState {
+	uint32 depth;
+	// NOTE(bruno): blocks nested deeper than the stack are only counted so
+	// their ends can be matched
+	uint32 skippedDepth;
+	DebugOpenBlock stack[DEBUG_MAX_DEPTH];
+};
+
+struct DebugSiteTotal {
+	uint32 siteIndex;
+	uint32 hitCount;
+	uint64 selfCycles;
+};
+
+enum DebugTraceRecordType {
+	DebugTrace_BeginBlock,
+	DebugTrace_EndBlock,
+	DebugTrace_FrameEnd,
+};
+
+// NOTE(bruno): what collation hands to the trace writer while a capture is
+// running. Names stay in the site table, which only ever grows
+struct DebugTraceRecord {
+	uint64 clock;
+	// NOTE(bruno): the frame number for FrameEnd
+	uint32 siteIndex;
+	uint8 type;
+	uint8 threadIndex;
+};
+
+// NOTE(bruno): must be a power of two. A few frames worth of events, the
+// writer drains it every frame
+#define DEBUG_TRACE_RING_SIZE (1 << 20)
+
+// NOTE(bruno): single producer (collation), single consumer (the writer)
+struct DebugTraceRing {
+	uint32 volatile readIndex;
+	uint32 volatile writeIndex;
+	uint32 droppedCount;
+	DebugTraceRecord records[DEBUG_TRACE_RING_SIZE];
+};
+
+struct DebugTable {
+	DebugThreadEvents threads[DEBUG_MAX_THREADS];
+
+	// NOTE(bruno): everything below belongs to the thread that collates
+	DebugThreadState threadStates[DEBUG_MAX_THREADS];
+
+	uint32 siteCount;
+	DebugSiteRecord sites[DEBUG_MAX_SITES];
+	DebugSiteCacheEntry siteCache[DEBUG_SITE_CACHE_SIZE];
+
+	// NOTE(bruno): frames[frameCount % DEBUG_FRAME_COUNT] is the one being
+	// filled, the ones before it are done
+	uint64 frameCount;
+	DebugFrame frames[DEBUG_FRAME_COUNT];
+
+	// NOTE(bruno): only set while a trace capture is running
+	DebugTraceRing *trace;
+};
+
+#if HANDMADE_INTERNAL
+
+// NOTE(bruno): one per module, the game sets its own from GameMemory
+global_variable DebugTable *globalDebugTable;
+
+inline uint64 getThreadID() {
+	uint64 threadID;
+	asm volatile("mov %%fs:0, %0" : "=r"(threadID));
+	return threadID;
+}
+
+inline DebugThreadEvents *getDebugThreadEvents(DebugTable *table) {
+	uint64 threadID = getThreadID();
+	uint32 slot =
+		(uint32)((threadID * 0x9E3779B97F4A7C15ull) >> 32) % DEBUG_MAX_THREADS;
+
+	for (uint32 probe = 0; probe < DEBUG_MAX_THREADS; probe++) {
+		DebugThreadEvents *thread = &table->threads[slot];
+		uint64 owner = thread->threadID;
+		if (owner == threadID) return thread;
+		if (owner == 0) {
+			owner = atomicCompareExchangeUInt64(&thread->threadID, threadID, 0);
+			if (owner == 0) return thread;
+		}
+		slot = (slot + 1) % DEBUG_MAX_THREADS;
+	}
+	return 0;
+}
+
+inline void recordDebugEvent(DebugSite *site, DebugEventType type) {
+	DebugTable *table = globalDebugTable;
+	if (!table) return;
+
+	DebugThreadEvents *thread = getDebugThreadEvents(table);
+	if (!thread) return;
+
+	uint64 reserved = atomicAddUInt64(&thread->arrayIndexEventIndex, 1);
+	uint32 arrayIndex = (uint32)(reserved >> 32);
+	uint32 eventIndex = (uint32)reserved;
+	if (eventIndex < DEBUG_MAX_EVENTS_PER_THREAD) {
+		DebugEvent *event = &thread->events[arrayIndex][eventIndex];
+		event->site = site;
+		event->type = (uint8)type;
+		event->clock = __rdtsc();
+	}
+	atomicAddUInt32(&thread->committedCount[arrayIndex], 1);
+}
+
+inline void nameDebugThread(const char *name) {
+	DebugTable *table = globalDebugTable;
+	if (!table) return;
+
+	DebugThreadEvents *thread = getDebugThreadEvents(table);
+	if (thread && !thread->name) thread->name = name;
+}
+
+struct DebugTimedBlock {
+	DebugSite *site;
+
+	DebugTimedBlock(DebugSite *blockSite) {
+		site = blockSite;
+		recordDebugEvent(site, DebugEvent_BeginBlock);
+	}
+	~DebugTimedBlock() { recordDebugEvent(site, DebugEvent_EndBlock); }
+};
+
+#define TIMED_BLOCK__(blockName, number)                                       \
+	local_persist DebugSite debugSite##number = {__FILE__, blockName,          \
+												 __LINE__};                    \
+	DebugTimedBlock timedBlock##number(&debugSite##number)
+#define TIMED_BLOCK_(blockName, number) TIMED_BLOCK__(blockName, number)
+#define TIMED_BLOCK(blockName) TIMED_BLOCK_(blockName, __COUNTER__)
+#define TIMED_FUNCTION() TIMED_BLOCK_(__func__, __COUNTER__)
+#define DEBUG_NAME_THREAD(name) nameDebugThread(name)
+
+#else
+
+#define TIMED_BLOCK(blockName)
+#define TIMED_FUNCTION()
+#define DEBUG_NAME_THREAD(name)
+
+#endif
+
+#define HANDMADE_DEBUG_H
+#endif // HANDMADE_DEBUG_H
@@ -0,0 +1,430 @@
+#include "handmade_flowfield.h"
+
+// NOTE(bruno): the four neighbors of a cell, the direction a neighbor takes to
+// come back to the cell, and the direction the cell takes to get to it
+global_variable const int32 flowFieldOffsetX[] = {0, 0, -1, 1};
+global_variable const int32 flowFieldOffsetY[] = {-1, 1, 0, 0};
+global_variable const uint8 flowFieldStepBack[] = {
+	FlowDirection_Down, FlowDirection_Up, FlowDirection_Right,
+	FlowDirection_Left};
+global_variable const uint8 flowFieldStepTowards[] = {
+	FlowDirection_Up, FlowDirection_Down, FlowDirection_Left,
+	FlowDirection_Right};
+
+void initializeFlowField(FlowField *field, World *world, MemoryArena *arena) {
+	*field = {};
+
+	size_t tilesPerChunk = world->tilemapWidth * world->tilemapHeight;
+	for (uint32 i = 0; i < arraylength(field->chunks); i++) {
+		field->chunks[i].distances = pushArray(arena, tilesPerChunk, uint16);
+		field->chunks[i].directions = pushArray(arena, tilesPerChunk, uint8);
+	}
+
+	// NOTE(bruno): the amount of tiles within FLOW_FIELD_MAX_DISTANCE steps
+	// (a diamond) is the most the search can ever enqueue
+	field->queueCapacity =
+		2 * FLOW_FIELD_MAX_DISTANCE * FLOW_FIELD_MAX_DISTANCE +
+		2 * FLOW_FIELD_MAX_DISTANCE + 1;
+	field->queue = pushArray(arena, field->queueCapacity, FlowFieldCell);
+	field->touched = pushArray(arena, field->queueCapacity, FlowFieldCell);
+	field->seeds = pushArray(arena, field->queueCapacity, FlowFieldCell);
+	field->sortedSeeds = pushArray(arena, field->queueCapacity, FlowFieldCell);
+}
+
+FlowFieldChunk *getFlowFieldChunk(FlowField *field, int32 tilemapX,
+								  int32 tilemapY) {
+	uint32 slot =
+		getTilemapHashSlot(tilemapX, tilemapY, FLOW_FIELD_HASH_SIZE);
+	for (FlowFieldChunk *chunk = field->hash[slot]; chunk;
+		 chunk = chunk->nextInHash) {
+		if (chunk->tilemapX == tilemapX && chunk->tilemapY == tilemapY) {
+			return chunk;
+		}
+	}
+	return 0;
+}
+
+FlowFieldChunk *addFlowFieldChunk(FlowField *field, World *world,
+								  int32 tilemapX, int32 tilemapY) {
+	// NOTE(bruno): running out of chunks just shrinks the horizon, tiles in
+	// chunks we could not get are treated as unreached
+	if (field->chunkCount >= arraylength(field->chunks)) {
+		field->ranOutOfChunks = true;
+		return 0;
+	}
+
+	FlowFieldChunk *chunk = &field->chunks[field->chunkCount++];
+	chunk->tilemapX = tilemapX;
+	chunk->tilemapY = tilemapY;
+	chunk->isDirty = false;
+
+	size_t tilesPerChunk = world->tilemapWidth * world->tilemapHeight;
+	for (size_t i = 0; i < tilesPerChunk; i++) {
+		chunk->distances[i] = FLOW_FIELD_UNREACHED;
+		chunk->directions[i] = FlowDirection_None;
+	}
+
+	uint32 slot =
+		getTilemapHashSlot(tilemapX, tilemapY, FLOW_FIELD_HASH_SIZE);
+	chunk->nextInHash = field->hash[slot];
+	field->hash[slot] = chunk;
+
+	return chunk;
+}
+
+struct FlowFieldTile {
+	FlowFieldChunk *chunk;
+	uint32 index;
+};
+
+// NOTE(bruno): a null chunk means the tile is unreached, and with
+// shouldCreate that we ran out of chunks
+FlowFieldTile getFlowFieldTile(FlowField *field, World *world, int32 absTileX,
+							   int32 absTileY, bool shouldCreate) {
+	TilePosition position = getTilePosition(world, absTileX, absTileY);
+	FlowFieldTile tile = {};
+	tile.chunk =
+		getFlowFieldChunk(field, position.tilemapX, position.tilemapY);
+	if (!tile.chunk && shouldCreate) {
+		tile.chunk = addFlowFieldChunk(field, world, position.tilemapX,
+									   position.tilemapY);
+	}
+	tile.index = position.tileY * world->tilemapWidth + position.tileX;
+	return tile;
+}
+
+// NOTE(bruno): offers every open neighbor one step more than the cell, the
+// ones that take it point back at the cell and go on the queue
+void relaxFlowFieldNeighbors(FlowField *field, World *world,
+							 FlowFieldCell cell, uint32 *tail) {
+	if (cell.distance >= FLOW_FIELD_MAX_DISTANCE) return;
+
+	uint16 distance = (uint16)(cell.distance + 1);
+	for (uint32 i = 0; i < arraylength(flowFieldOffsetX); i++) {
+		int32 absTileX = cell.absTileX + flowFieldOffsetX[i];
+		int32 absTileY = cell.absTileY + flowFieldOffsetY[i];
+		if (!isAbsTilePointEmpty(world, absTileX, absTileY)) continue;
+
+		FlowFieldTile tile =
+			getFlowFieldTile(field, world, absTileX, absTileY, true);
+		if (!tile.chunk) continue;
+		if (tile.chunk->distances[tile.index] <= distance) continue;
+
+		tile.chunk->distances[tile.index] = distance;
+		tile.chunk->directions[tile.index] = flowFieldStepBack[i];
+		field->writtenCellCount++;
+
+		assert(*tail < field->queueCapacity);
+		field->queue[(*tail)++] = {absTileX, absTileY, distance};
+	}
+}
+
+void buildFlowField(FlowField *field, World *world) {
+	TIMED_FUNCTION();
+
+	field->chunkCount = 0;
+	for (uint32 i = 0; i < arraylength(field->hash); i++) {
+		field->hash[i] = 0;
+	}
+	field->hasDirtyChunks = false;
+	field->ranOutOfChunks = false;
+	field->rebuildCount++;
+
+	if (!isAbsTilePointEmpty(world, field->targetAbsTileX,
+							 field->targetAbsTileY)) {
+		return;
+	}
+
+	FlowFieldTile target = getFlowFieldTile(
+		field, world, field->targetAbsTileX, field->targetAbsTileY, true);
+	target.chunk->distances[target.index] = 0;
+	field->writtenCellCount++;
+
+	uint32 head = 0;
+	uint32 tail = 0;
+	field->queue[tail++] = {field->targetAbsTileX, field->targetAbsTileY, 0};
+	while (head < tail) {
+		relaxFlowFieldNeighbors(field, world, field->queue[head++], &tail);
+	}
+}
+
+inline bool pushFlowFieldCell(FlowFieldCell *cells, uint32 *count,
+							  uint32 capacity, FlowFieldCell cell) {
+	if (*count >= capacity) return false;
+	cells[(*count)++] = cell;
+	return true;
+}
+
+// NOTE(bruno): takes the distance away from the cell and from everything
+// whose path to the target went through it, following the directions back
+// out. All of them end up in touched so they can be offered a distance again
+bool raiseFlowFieldCell(FlowField *field, World *world, int32 absTileX,
+						int32 absTileY) {
+	FlowFieldTile tile =
+		getFlowFieldTile(field, world, absTileX, absTileY, false);
+	if (!tile.chunk) return true;
+	if (tile.chunk->distances[tile.index] == FLOW_FIELD_UNREACHED) return true;
+
+	tile.chunk->distances[tile.index] = FLOW_FIELD_UNREACHED;
+	tile.chunk->directions[tile.index] = FlowDirection_None;
+	uint32 head = field->touchedCount;
+	if (!pushFlowFieldCell(field->touched, &field->touchedCount,
+						   field->queueCapacity, {absTileX, absTileY})) {
+		return false;
+	}
+
+	while (head < field->touchedCount) {
+		FlowFieldCell cell = field->touched[head++];
+		for (uint32 i = 0; i < arraylength(flowFieldOffsetX); i++) {
+			int32 childX = cell.absTileX + flowFieldOffsetX[i];
+			int32 childY = cell.absTileY + flowFieldOffsetY[i];
+			FlowFieldTile child =
+				getFlowFieldTile(field, world, childX, childY, false);
+			if (!child.chunk) continue;
+			if (child.chunk->distances[child.index] == FLOW_FIELD_UNREACHED ||
+				child.chunk->directions[child.index] != flowFieldStepBack[i]) {
+				continue;
+			}
+
+			child.chunk->distances[child.index] = FLOW_FIELD_UNREACHED;
+			child.chunk->directions[child.index] = FlowDirection_None;
+			if (!pushFlowFieldCell(field->touched, &field->touchedCount,
+								   field->queueCapacity, {childX, childY})) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// NOTE(bruno): every open touched cell gets offered a distance by each of its
+// neighbors that still has one
+bool seedTouchedFlowFieldCells(FlowField *field, World *world) {
+	for (uint32 touchedIndex = 0; touchedIndex < field->touchedCount;
+		 touchedIndex++) {
+		FlowFieldCell cell = field->touched[touchedIndex];
+		if (!isAbsTilePointEmpty(world, cell.absTileX, cell.absTileY)) {
+			continue;
+		}
+
+		for (uint32 i = 0; i < arraylength(flowFieldOffsetX); i++) {
+			FlowFieldTile neighbor = getFlowFieldTile(
+				field, world, cell.absTileX + flowFieldOffsetX[i],
+				cell.absTileY + flowFieldOffsetY[i], false);
+			if (!neighbor.chunk) continue;
+			uint16 distance = neighbor.chunk->distances[neighbor.index];
+			if (distance >= FLOW_FIELD_MAX_DISTANCE) continue;
+
+			FlowFieldCell seed = {cell.absTileX, cell.absTileY,
+								  (uint16)(distance + 1),
+								  flowFieldStepTowards[i]};
+			if (!pushFlowFieldCell(field->seeds, &field->seedCount,
+								   field->queueCapacity, seed)) {
+				return false;
+			}
+		}
+	}
+	field->touchedCount = 0;
+	return true;
+}
+
+// NOTE(bruno): Dijkstra from seeds at different distances. Every step costs
+// the same, so the queue stays in order by itself and the seeds only need
+// to be sorted and merged into it. Seeds win ties, that way a cell is only
+// queued once
+void propagateFlowFieldSeeds(FlowField *field, World *world) {
+	uint32 offsets[FLOW_FIELD_MAX_DISTANCE + 2] = {};
+	for (uint32 i = 0; i < field->seedCount; i++) {
+		offsets[field->seeds[i].distance + 1]++;
+	}
+	for (uint32 i = 1; i < arraylength(offsets); i++) {
+		offsets[i] += offsets[i - 1];
+	}
+	for (uint32 i = 0; i < field->seedCount; i++) {
+		FlowFieldCell seed = field->seeds[i];
+		field->sortedSeeds[offsets[seed.distance]++] = seed;
+	}
+
+	uint32 nextSeed = 0;
+	uint32 head = 0;
+	uint32 tail = 0;
+	while (nextSeed < field->seedCount || head < tail) {
+		FlowFieldCell cell;
+		if (nextSeed < field->seedCount &&
+			(head == tail ||
+			 field->sortedSeeds[nextSeed].distance <=
+				 field->queue[head].distance)) {
+			cell = field->sortedSeeds[nextSeed++];
+			FlowFieldTile tile = getFlowFieldTile(field, world, cell.absTileX,
+												  cell.absTileY, true);
+			if (!tile.chunk) continue;
+			if (tile.chunk->distances[tile.index] <= cell.distance) continue;
+
+			tile.chunk->distances[tile.index] = cell.distance;
+			tile.chunk->directions[tile.index] = cell.direction;
+			field->writtenCellCount++;
+		} else {
+			cell = field->queue[head++];
+			// NOTE(bruno): a seed got there first with something shorter
+			FlowFieldTile tile = getFlowFieldTile(field, world, cell.absTileX,
+												  cell.absTileY, false);
+			if (tile.chunk->distances[tile.index] != cell.distance) continue;
+		}
+		relaxFlowFieldNeighbors(field, world, cell, &tail);
+	}
+	field->seedCount = 0;
+}
+
+// NOTE(bruno): the target is already set to the new one. Cells that got
+// closer are pulled in by the new target first, which also points them all
+// at it, so whatever still leads to the old target got further away and has
+// to be raised and offered distances again by its neighbors. Tiles of dirty
+// chunks that turned solid get raised the same way, and the ones that opened
+// up get offered distances. Returns false when the field has to be built from
+// scratch instead
+bool repairFlowField(FlowField *field, World *world, int32 oldTargetAbsTileX,
+					 int32 oldTargetAbsTileY) {
+	TIMED_FUNCTION();
+
+	field->ranOutOfChunks = false;
+	field->touchedCount = 0;
+	field->seedCount = 0;
+
+	// NOTE(bruno): an old target on a wall left nothing to repair, and a new
+	// one on a wall leaves nothing at all, building handles both
+	FlowFieldTile oldTarget = getFlowFieldTile(
+		field, world, oldTargetAbsTileX, oldTargetAbsTileY, false);
+	if (!oldTarget.chunk || oldTarget.chunk->distances[oldTarget.index] != 0 ||
+		!isAbsTilePointEmpty(world, field->targetAbsTileX,
+							 field->targetAbsTileY)) {
+		return false;
+	}
+
+	if (field->targetAbsTileX != oldTargetAbsTileX ||
+		field->targetAbsTileY != oldTargetAbsTileY) {
+		field->seeds[field->seedCount++] = {field->targetAbsTileX,
+											field->targetAbsTileY, 0,
+											FlowDirection_None};
+		propagateFlowFieldSeeds(field, world);
+		if (!raiseFlowFieldCell(field, world, oldTargetAbsTileX,
+								oldTargetAbsTileY)) {
+			return false;
+		}
+	}
+
+	for (uint32 chunkIndex = 0; chunkIndex < field->chunkCount; chunkIndex++) {
+		FlowFieldChunk *chunk = &field->chunks[chunkIndex];
+		if (!chunk->isDirty) continue;
+		chunk->isDirty = false;
+
+		int32 firstAbsTileX = chunk->tilemapX * world->tilemapWidth;
+		int32 firstAbsTileY = chunk->tilemapY * world->tilemapHeight;
+		for (int32 tileY = 0; tileY < world->tilemapHeight; tileY++) {
+			for (int32 tileX = 0; tileX < world->tilemapWidth; tileX++) {
+				int32 absTileX = firstAbsTileX + tileX;
+				int32 absTileY = firstAbsTileY + tileY;
+				bool isEmpty = isAbsTilePointEmpty(world, absTileX, absTileY);
+				bool isReached =
+					chunk->distances[tileY * world->tilemapWidth + tileX] !=
+					FLOW_FIELD_UNREACHED;
+
+				if (!isEmpty && isReached) {
+					if (!raiseFlowFieldCell(field, world, absTileX,
+											absTileY)) {
+						return false;
+					}
+				} else if (isEmpty && !isReached) {
+					if (!pushFlowFieldCell(field->touched,
+										   &field->touchedCount,
+										   field->queueCapacity,
+										   {absTileX, absTileY})) {
+						return false;
+					}
+				}
+			}
+		}
+	}
+	field->hasDirtyChunks = false;
+
+	if (!seedTouchedFlowFieldCells(field, world)) return false;
+	propagateFlowFieldSeeds(field, world);
+
+	return !field->ranOutOfChunks;
+}
+
+void updateFlowField(FlowField *field, World *world, int32 targetAbsTileX,
+					 int32 targetAbsTileY) {
+	int32 oldTargetAbsTileX = field->targetAbsTileX;
+	int32 oldTargetAbsTileY = field->targetAbsTileY;
+	if (field->isValid && !field->hasDirtyChunks &&
+		oldTargetAbsTileX == targetAbsTileX &&
+		oldTargetAbsTileY == targetAbsTileY) {
+		return;
+	}
+
+	field->targetAbsTileX = targetAbsTileX;
+	field->targetAbsTileY = targetAbsTileY;
+	field->writtenCellCount = 0;
+
+	int32 stepsX = targetAbsTileX - oldTargetAbsTileX;
+	int32 stepsY = targetAbsTileY - oldTargetAbsTileY;
+	if (stepsX < 0) stepsX = -stepsX;
+	if (stepsY < 0) stepsY = -stepsY;
+
+	if (!field->isValid || stepsX + stepsY > FLOW_FIELD_MAX_REPAIR_STEPS ||
+		!repairFlowField(field, world, oldTargetAbsTileX, oldTargetAbsTileY)) {
+		buildFlowField(field, world);
+	}
+	field->isValid = true;
+}
+
+// NOTE(bruno): call this whenever tiles of a chunk change. Only chunks that
+// overlap the horizon around the current target can change the field, so
+// anything further away is ignored. The rest get repaired on the next update
+void invalidateFlowFieldChunk(FlowField *field, World *world, int32 tilemapX,
+							  int32 tilemapY) {
+	if (!field->isValid) return;
+
+	int32 chunkMinX = tilemapX * world->tilemapWidth;
+	int32 chunkMinY = tilemapY * world->tilemapHeight;
+	int32 chunkMaxX = chunkMinX + world->tilemapWidth - 1;
+	int32 chunkMaxY = chunkMinY + world->tilemapHeight - 1;
+
+	// NOTE(bruno): the search also looks at the walls one step past the
+	// horizon, so those count as inside
+	int32 reach = FLOW_FIELD_MAX_DISTANCE + 1;
+	if (chunkMaxX < field->targetAbsTileX - reach ||
+		chunkMinX > field->targetAbsTileX + reach ||
+		chunkMaxY < field->targetAbsTileY - reach ||
+		chunkMinY > field->targetAbsTileY + reach) {
+		return;
+	}
+
+	FlowFieldChunk *chunk = getFlowFieldChunk(field, tilemapX, tilemapY);
+	if (!chunk) chunk = addFlowFieldChunk(field, world, tilemapX, tilemapY);
+	if (!chunk) {
+		field->isValid = false;
+		return;
+	}
+	chunk->isDirty = true;
+	field->hasDirtyChunks = true;
+}
+
+uint16 getFlowFieldDistance(FlowField *field, World *world, int32 absTileX,
+							int32 absTileY) {
+	TilePosition tile = getTilePosition(world, absTileX, absTileY);
+	FlowFieldChunk *chunk =
+		getFlowFieldChunk(field, tile.tilemapX, tile.tilemapY);
+	if (!chunk) return FLOW_FIELD_UNREACHED;
+	return chunk->distances[tile.tileY * world->tilemapWidth + tile.tileX];
+}
+
+FlowDirection getFlowFieldDirection(FlowField *field, World *world,
+									int32 absTileX, int32 absTileY) {
+	TilePosition tile = getTilePosition(world, absTileX, absTileY);
+	FlowFieldChunk *chunk =
+		getFlowFieldChunk(field, tile.tilemapX, tile.tilemapY);
+	if (!chunk) return FlowDirection_None;
+	return (FlowDirection)
+		chunk->directions[tile.tileY * world->tilemapWidth + tile.tileX];
+}
@@ -0,0 +1,82 @@
+#ifndef HANDMADE_FLOWFIELD_H
+
+// NOTE(bruno): the flow field is a Dijkstra map rooted at a single target tile
+// (usually the player), and every entity chasing that target reads its next
+// step with a single lookup. When the target steps onto a nearby tile or
+// tiles inside the horizon change, the field is repaired from the distances
+// it already has: only cells whose distance actually changes get written,
+// and only the chunks marked dirty get looked at again. It is built from
+// scratch when the target jumps, or when a repair runs out of room.
+
+// NOTE(bruno): the search stops at this many steps from the target, so the
+// rebuild cost depends on the horizon and not on how big the world is
+#define FLOW_FIELD_MAX_DISTANCE 32
+#define FLOW_FIELD_MAX_CHUNKS 64
+#define FLOW_FIELD_HASH_SIZE 128
+#define FLOW_FIELD_UNREACHED 0xFFFF
+// NOTE(bruno): further than this and most of the field changes anyway
+#define FLOW_FIELD_MAX_REPAIR_STEPS 2
+
+enum FlowDirection {
+	FlowDirection_None,
+	FlowDirection_Up,
+	FlowDirection_Down,
+	FlowDirection_Left,
+	FlowDirection_Right,
+};
+
+struct FlowFieldChunk {
+	int32 tilemapX;
+	int32 tilemapY;
+
+	uint16 *distances;
+	uint8 *directions;
+
+	// NOTE(bruno): tiles changed since the last update
+	bool isDirty;
+
+	FlowFieldChunk *nextInHash;
+};
+
+struct FlowFieldCell {
+	int32 absTileX;
+	int32 absTileY;
+	uint16 distance;
+	// NOTE(bruno): only used by seeds, the step the cell takes to get to the
+	// distance it is offered
+	uint8 direction;
+};
+
+struct FlowField {
+	bool isValid;
+	int32 targetAbsTileX;
+	int32 targetAbsTileY;
+
+	uint32 chunkCount;
+	FlowFieldChunk chunks[FLOW_FIELD_MAX_CHUNKS];
+	FlowFieldChunk *hash[FLOW_FIELD_HASH_SIZE];
+
+	bool hasDirtyChunks;
+	// NOTE(bruno): set when a chunk was needed and there were none left, a
+	// repair that hits it gives up and the field gets built from scratch
+	bool ranOutOfChunks;
+
+	// NOTE(bruno): how often the field was built from scratch, and how many
+	// cells the last update wrote a distance to
+	uint32 rebuildCount;
+	uint32 writtenCellCount;
+
+	// NOTE(bruno): all of these hold up to queueCapacity cells. Touched are
+	// the cells a repair took the distance away from, seeds the distances
+	// their neighbors offer them
+	uint32 queueCapacity;
+	FlowFieldCell *queue;
+	uint32 touchedCount;
+	FlowFieldCell *touched;
+	uint32 seedCount;
+	FlowFieldCell *seeds;
+	FlowFieldCell *sortedSeeds;
+};
+
+#define HANDMADE_FLOWFIELD_H
+#endif // HANDMADE_FLOWFIELD_H
@@ -3,6 +3,7 @@
 #include "handmade.h"
 // TODO(bruno): stop using cmath for these functions and implement them
 #include <cmath>
+#include <x86intrin.h>
 
 inline int32 roundReal32ToInt32(real32 value) { return (int32)(value + 0.5f); }
 inline uint32 roundReal32ToUInt32(real32 value) {
@@ -10,10 +11,48 @@ inline uint32 roundReal32ToUInt32(real32 value) {
 }
 inline int32 floorReal32ToInt32(real32 value) { return floorf(value); }
 inline uint32 floorReal32ToUInt32(real32 value) { return floorf(value); }
+inline int32 ceilReal32ToInt32(real32 value) { return ceilf(value); }
+inline real32 squareRoot(real32 value) { return sqrtf(value); }
+
+global_variable const real32 PI = 3.14159265359f;
 
 inline real32 sin(real32 angle) { return sinf(angle); }
 inline real32 cos(real32 angle) { return cosf(angle); }
 inline real32 atan2(real32 y, real32 x) { return atan2f(y, x); }
 
+// NOTE(bruno): loads acquire and stores release, so whatever was written
+// before a store is visible to whoever loads the stored value
+inline uint32 atomicLoadUInt32(uint32 volatile *value) {
+	return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+inline void atomicStoreUInt32(uint32 volatile *value, uint32 newValue) {
+	__atomic_store_n(value, newValue, __ATOMIC_RELEASE);
+}
+inline uint32 atomicAddUInt32(uint32 volatile *value, uint32 addend) {
+	return __atomic_fetch_add(value, addend, __ATOMIC_ACQ_REL);
+}
+// NOTE(bruno): returns the value that was there before the exchange
+inline uint32 atomicCompareExchangeUInt32(uint32 volatile *value,
+										  uint32 newValue, uint32 expected) {
+	__atomic_compare_exchange_n(value, &expected, newValue, false,
+								__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+	return expected;
+}
+inline uint64 atomicLoadUInt64(uint64 volatile *value) {
+	return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+inline uint64 atomicAddUInt64(uint64 volatile *value, uint64 addend) {
+	return __atomic_fetch_add(value, addend, __ATOMIC_ACQ_REL);
+}
+inline uint64 atomicExchangeUInt64(uint64 volatile *value, uint64 newValue) {
+	return __atomic_exchange_n(value, newValue, __ATOMIC_ACQ_REL);
+}
+inline uint64 atomicCompareExchangeUInt64(uint64 volatile *value,
+										  uint64 newValue, uint64 expected) {
+	__atomic_compare_exchange_n(value, &expected, newValue, false,
+								__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+	return expected;
+}
+
 #define HANDMADE_INTRINSICS_H
 #endif
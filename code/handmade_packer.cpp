@@ -0,0 +1,164 @@
+// NOTE(bruno): offline tool, builds the asset pack the game maps at startup.
+// Run it from the repository root:
+//
+//   ./target/handmade_packer [output]
+//
+// The sources below are read relative to the current directory, the pack
+// goes to data/assets.hmp unless an output is given. Missing sources are
+// skipped with a warning so a partial pack still builds.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "handmade.h"
+#include "handmade_intrinsics.h"
+#include "handmade_debug.h"
+#include "handmade_audio.cpp"
+
+struct AssetSource {
+	AssetTypeID typeID;
+	const char *filename;
+};
+
+// NOTE(bruno): grouped by type, the directory needs all assets of a type to
+// be next to each other
+global_variable AssetSource sources[] = {
+	{Asset_DoorSound, "data/door.wav"},
+};
+
+#define PACKER_MAX_ASSETS (arraylength(sources) + 1)
+
+struct PackerAsset {
+	AssetPackAsset packAsset;
+	LoadedSound sound;
+};
+
+bool readEntireFile(const char *filename, MemoryArena *arena, void **data,
+					size_t *size) {
+	FILE *file = fopen(filename, "rb");
+	if (!file) return false;
+
+	fseek(file, 0, SEEK_END);
+	long fileSize = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if (fileSize <= 0 || arena->used + fileSize > arena->size) {
+		fclose(file);
+		return false;
+	}
+
+	*data = pushSize(arena, (size_t)fileSize);
+	*size = (size_t)fileSize;
+	bool ok = fread(*data, 1, *size, file) == *size;
+	fclose(file);
+	return ok;
+}
+
+bool writePadding(FILE *out, uint64 *offset, uint64 alignedOffset) {
+	uint8 zero[ASSET_PACK_ALIGNMENT] = {};
+	uint64 padding = alignedOffset - *offset;
+	*offset = alignedOffset;
+	return fwrite(zero, 1, padding, out) == padding;
+}
+
+int main(int argc, char **argv) {
+	const char *outputFilename = argc > 1 ? argv[1] : "data/assets.hmp";
+
+	size_t arenaSize = Megabytes(256);
+	MemoryArena arena;
+	initializeArena(&arena, arenaSize, malloc(arenaSize));
+
+	static PackerAsset assets[PACKER_MAX_ASSETS] = {};
+	AssetPackType types[Asset_Count] = {};
+	uint32 assetCount = 1;
+
+	for (uint32 typeID = 0; typeID < Asset_Count; typeID++) {
+		types[typeID].firstAssetIndex = assetCount;
+		for (uint32 i = 0; i < arraylength(sources); i++) {
+			AssetSource *source = &sources[i];
+			if (source->typeID != typeID) continue;
+
+			void *fileData;
+			size_t fileSize;
+			if (!readEntireFile(source->filename, &arena, &fileData,
+								&fileSize)) {
+				printf("skipping %s: can't read it\n", source->filename);
+				continue;
+			}
+
+			LoadedSound sound = parseWAV(&arena, fileData, fileSize);
+			if (!sound.sampleCount) {
+				printf("skipping %s: not 16 bit PCM mono or stereo\n",
+					   source->filename);
+				continue;
+			}
+
+			PackerAsset *asset = &assets[assetCount++];
+			asset->sound = sound;
+			asset->packAsset.kind = AssetKind_Sound;
+			asset->packAsset.sound.sampleCount = sound.sampleCount;
+			asset->packAsset.sound.channelCount = sound.channelCount;
+			asset->packAsset.dataSize =
+				sound.channelCount *
+				getAssetPackChannelStride(sound.sampleCount);
+		}
+		types[typeID].onePastLastAssetIndex = assetCount;
+	}
+
+	AssetPackHeader header = {};
+	header.magicValue = ASSET_PACK_MAGIC_VALUE;
+	header.version = ASSET_PACK_VERSION;
+	header.typeCount = Asset_Count;
+	header.assetCount = assetCount;
+	header.types = sizeof(header);
+	header.assets = header.types + sizeof(types);
+
+	uint64 dataOffset = header.assets + assetCount * sizeof(AssetPackAsset);
+	for (uint32 i = 1; i < assetCount; i++) {
+		dataOffset = alignAssetPackOffset(dataOffset);
+		assets[i].packAsset.dataOffset = dataOffset;
+		dataOffset += assets[i].packAsset.dataSize;
+	}
+
+	FILE *out = fopen(outputFilename, "wb");
+	if (!out) {
+		printf("can't open %s for writing\n", outputFilename);
+		return 1;
+	}
+
+	bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+	ok = ok && fwrite(types, sizeof(types), 1, out) == 1;
+	for (uint32 i = 0; ok && i < assetCount; i++) {
+		ok = fwrite(&assets[i].packAsset, sizeof(AssetPackAsset), 1, out) == 1;
+	}
+
+	uint64 offset = header.assets + assetCount * sizeof(AssetPackAsset);
+	for (uint32 i = 1; ok && i < assetCount; i++) {
+		PackerAsset *asset = &assets[i];
+		ok = writePadding(out, &offset, asset->packAsset.dataOffset);
+
+		uint64 stride = getAssetPackChannelStride(asset->sound.sampleCount);
+		for (uint32 channel = 0; ok && channel < asset->sound.channelCount;
+			 channel++) {
+			// NOTE(bruno): parseWAV already put the zero padding after the
+			// samples
+			uint64 channelSize = (asset->sound.sampleCount + 4) * sizeof(int16);
+			ok = fwrite(asset->sound.samples[channel], 1, channelSize, out) ==
+				 channelSize;
+			offset += channelSize;
+			ok = ok && writePadding(out, &offset,
+									asset->packAsset.dataOffset +
+										(channel + 1) * stride);
+		}
+	}
+
+	ok = fclose(out) == 0 && ok;
+	if (!ok) {
+		printf("failed writing %s\n", outputFilename);
+		return 1;
+	}
+
+	printf("wrote %s: %u assets, %llu bytes\n", outputFilename,
+		   assetCount - 1, (unsigned long long)offset);
+	return 0;
+}
@@ -0,0 +1,390 @@
+#include "handmade_render.h"
+
+template <BackbufferFormat format>
+inline uint32 packPixel(uint32 r, uint32 g, uint32 b, uint32 a);
+
+template <>
+inline uint32 packPixel<BackbufferFormat_ARGB8888>(uint32 r, uint32 g, uint32 b,
+												   uint32 a) {
+	return (a << 24) | (r << 16) | (g << 8) | (b << 0);
+}
+
+template <>
+inline uint32 packPixel<BackbufferFormat_ABGR8888>(uint32 r, uint32 g, uint32 b,
+												   uint32 a) {
+	return (a << 24) | (b << 16) | (g << 8) | (r << 0);
+}
+
+// NOTE(bruno): a pixel splits into two pairs of channels, the low and third
+// byte and the second and top byte, each pair sitting in its own 16 bit lane
+// so one multiply weighs both. Which color is in which lane depends on the
+// format, but the math is the same for every channel so it never matters
+#define RENDER_LANE_MASK 0x00FF00FF
+
+// NOTE(bruno): exact for anything up to 255 * 255 in each lane
+inline uint32 divideLanesBy255(uint32 lanes) {
+	lanes += 0x00800080;
+	return ((lanes + ((lanes >> 8) & RENDER_LANE_MASK)) >> 8) &
+		   RENDER_LANE_MASK;
+}
+
+// NOTE(bruno): per byte add that sticks at 255 instead of wrapping into the
+// byte above it
+inline uint32 addBytesSaturated(uint32 a, uint32 b) {
+	uint32 lowSum = (a & 0x7F7F7F7F) + (b & 0x7F7F7F7F);
+	uint32 carry = ((a & b) | ((a | b) & lowSum)) & 0x80808080;
+	uint32 sum = lowSum ^ ((a ^ b) & 0x80808080);
+	return sum | ((carry << 1) - (carry >> 7));
+}
+
+// NOTE(bruno): everything about the source that doesn't change from pixel to
+// pixel, worked out once per draw
+struct RenderBlendSource {
+	uint32 pixel;
+	uint32 weightedLow;
+	uint32 weightedHigh;
+	uint32 inverseAlpha;
+};
+
+template <RenderBlendMode blend, BackbufferFormat format>
+inline RenderBlendSource prepareBlendSource(RenderColor color) {
+	RenderBlendSource source = {};
+	if (blend == RenderBlend_Additive) {
+		// NOTE(bruno): premultiplied, with nothing added to the alpha byte
+		source.pixel = packPixel<format>(color.r * color.a / 255,
+										 color.g * color.a / 255,
+										 color.b * color.a / 255, 0);
+	} else {
+		// NOTE(bruno): an alpha byte of 255 blends the dest alpha towards
+		// covered, the same way the colors blend towards the source
+		source.pixel = packPixel<format>(color.r, color.g, color.b, 255);
+	}
+	source.weightedLow = (source.pixel & RENDER_LANE_MASK) * color.a;
+	source.weightedHigh = ((source.pixel >> 8) & RENDER_LANE_MASK) * color.a;
+	source.inverseAlpha = 255 - color.a;
+	return source;
+}
+
+template <RenderBlendMode blend>
+inline uint32 blendPixel(uint32 dest, RenderBlendSource *source);
+
+template <>
+inline uint32 blendPixel<RenderBlend_Opaque>(uint32 dest,
+											 RenderBlendSource *source) {
+	return source->pixel;
+}
+
+template <>
+inline uint32 blendPixel<RenderBlend_Alpha>(uint32 dest,
+											RenderBlendSource *source) {
+	uint32 low =
+		source->weightedLow + (dest & RENDER_LANE_MASK) * source->inverseAlpha;
+	uint32 high = source->weightedHigh +
+				  ((dest >> 8) & RENDER_LANE_MASK) * source->inverseAlpha;
+	return divideLanesBy255(low) | (divideLanesBy255(high) << 8);
+}
+
+template <>
+inline uint32 blendPixel<RenderBlend_Additive>(uint32 dest,
+											   RenderBlendSource *source) {
+	return addBytesSaturated(dest, source->pixel);
+}
+
+// NOTE(bruno): without needsClip the rect has to be inside the buffer and not
+// empty, the dispatcher makes sure of that
+template <RenderBlendMode blend, BackbufferFormat format, bool needsClip>
+void rasterizeRectangle(GameBackbuffer *buffer, RenderRect rect,
+						RenderColor color) {
+	if (needsClip) {
+		if (rect.minX < 0) rect.minX = 0;
+		if (rect.minY < 0) rect.minY = 0;
+		if (rect.maxX > buffer->width) rect.maxX = buffer->width;
+		if (rect.maxY > buffer->height) rect.maxY = buffer->height;
+		if (rect.minX >= rect.maxX || rect.minY >= rect.maxY) return;
+	}
+
+	RenderBlendSource source = prepareBlendSource<blend, format>(color);
+	int32 width = rect.maxX - rect.minX;
+
+	uint8 *row = (uint8 *)buffer->memory + rect.minX * sizeof(uint32) +
+				 rect.minY * buffer->pitch;
+	for (int32 y = rect.minY; y < rect.maxY; y++) {
+		uint32 *pixel = (uint32 *)row;
+		for (int32 x = 0; x < width; x++) {
+			pixel[x] = blendPixel<blend>(pixel[x], &source);
+		}
+		row += buffer->pitch;
+	}
+}
+
+#define RECTANGLE_RASTERIZERS(blend, format)                                   \
+	{rasterizeRectangle<blend, format, false>,                                 \
+	 rasterizeRectangle<blend, format, true>}
+
+#define RECTANGLE_RASTERIZERS_FOR_FORMAT(format)                               \
+	{RECTANGLE_RASTERIZERS(RenderBlend_Opaque, format),                        \
+	 RECTANGLE_RASTERIZERS(RenderBlend_Alpha, format),                         \
+	 RECTANGLE_RASTERIZERS(RenderBlend_Additive, format)}
+
+// NOTE(bruno): indexed by format, blend mode and whether it needs clipping
+global_variable const RectangleRasterizer
+	globalRectangleRasterizers[BackbufferFormat_Count][RenderBlend_Count][2] = {
+		RECTANGLE_RASTERIZERS_FOR_FORMAT(BackbufferFormat_ARGB8888),
+		RECTANGLE_RASTERIZERS_FOR_FORMAT(BackbufferFormat_ABGR8888),
+};
+
+void dispatchRectangle(GameBackbuffer *buffer, real32 minXf, real32 minYf,
+					   real32 maxXf, real32 maxYf, real32 R, real32 G,
+					   real32 B, real32 A, RenderBlendMode blend) {
+	RenderRect rect;
+	rect.minX = roundReal32ToInt32(minXf);
+	rect.minY = roundReal32ToInt32(minYf);
+	rect.maxX = roundReal32ToInt32(maxXf);
+	rect.maxY = roundReal32ToInt32(maxYf);
+	if (rect.minX >= rect.maxX || rect.minY >= rect.maxY) return;
+
+	if (A < 0.0f) A = 0.0f;
+	if (A > 1.0f) A = 1.0f;
+	RenderColor color;
+	color.r = roundReal32ToUInt32(R * 255.0f);
+	color.g = roundReal32ToUInt32(G * 255.0f);
+	color.b = roundReal32ToUInt32(B * 255.0f);
+	color.a = roundReal32ToUInt32(A * 255.0f);
+
+	if (blend != RenderBlend_Opaque) {
+		if (color.a == 0) return;
+		if (blend == RenderBlend_Alpha && color.a == 255) {
+			blend = RenderBlend_Opaque;
+		}
+	}
+
+	bool needsClip = rect.minX < 0 || rect.minY < 0 ||
+					 rect.maxX > buffer->width || rect.maxY > buffer->height;
+
+	assert(buffer->format < BackbufferFormat_Count);
+	RectangleRasterizer rasterizer =
+		globalRectangleRasterizers[buffer->format][blend][needsClip];
+	rasterizer(buffer, rect, color);
+}
+
+void renderRectangle(GameBackbuffer *buffer, real32 minXf, real32 minYf,
+					 real32 maxXf, real32 maxYf, real32 R, real32 G, real32 B) {
+	TIMED_FUNCTION();
+
+	dispatchRectangle(buffer, minXf, minYf, maxXf, maxYf, R, G, B, 1.0f,
+					  RenderBlend_Opaque);
+}
+
+void renderBlendedRectangle(GameBackbuffer *buffer, real32 minXf,
+							real32 minYf, real32 maxXf, real32 maxYf, real32 R,
+							real32 G, real32 B, real32 A,
+							RenderBlendMode blend) {
+	TIMED_FUNCTION();
+
+	dispatchRectangle(buffer, minXf, minYf, maxXf, maxYf, R, G, B, A, blend);
+}
+
+// NOTE(bruno): byte 0 to 3 of four pixels as floats from 0 to 255, 3 is alpha
+struct RenderPixels4 {
+	__m128 channels[4];
+};
+
+inline RenderPixels4 unpackPixels4(__m128i pixels) {
+	__m128i byteMask = _mm_set1_epi32(0xFF);
+
+	RenderPixels4 result;
+	result.channels[0] = _mm_cvtepi32_ps(_mm_and_si128(pixels, byteMask));
+	result.channels[1] =
+		_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, 8), byteMask));
+	result.channels[2] =
+		_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, 16), byteMask));
+	result.channels[3] = _mm_cvtepi32_ps(_mm_srli_epi32(pixels, 24));
+	return result;
+}
+
+inline __m128i packPixels4(RenderPixels4 *pixels) {
+	__m128 zero = _mm_setzero_ps();
+	__m128 maxChannel = _mm_set1_ps(255.0f);
+
+	__m128i channels[4];
+	for (uint32 i = 0; i < 4; i++) {
+		__m128 channel =
+			_mm_min_ps(_mm_max_ps(pixels->channels[i], zero), maxChannel);
+		channels[i] = _mm_cvtps_epi32(channel);
+	}
+	return _mm_or_si128(
+		_mm_or_si128(channels[0], _mm_slli_epi32(channels[1], 8)),
+		_mm_or_si128(_mm_slli_epi32(channels[2], 16),
+					 _mm_slli_epi32(channels[3], 24)));
+}
+
+inline __m128 lerp4(__m128 a, __m128 t, __m128 b) {
+	return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+}
+
+// NOTE(bruno): draws the bitmap stretched over the parallelogram with corners
+// origin, origin + xAxis, origin + yAxis and origin + xAxis + yAxis, so any
+// rotation, scale or skew at any subpixel position. Four pixels at a time,
+// each sampled at its center with bilinear filtering and blended as
+// premultiplied alpha, scaled by alpha as a whole. The blend treats every
+// channel the same, so the bitmap only has to be in the backbuffer's format.
+// TODO(bruno): eight wide once builds target AVX
+void renderTexturedQuad(GameBackbuffer *buffer, Vector2 origin, Vector2 xAxis,
+						Vector2 yAxis, LoadedBitmap *bitmap, real32 alpha) {
+	TIMED_FUNCTION();
+
+	real32 determinant = xAxis.x * yAxis.y - xAxis.y * yAxis.x;
+	if (determinant == 0.0f || bitmap->width < 1 || bitmap->height < 1) {
+		return;
+	}
+	if (alpha <= 0.0f) return;
+	if (alpha > 1.0f) alpha = 1.0f;
+
+	real32 cornersX[4] = {origin.x, origin.x + xAxis.x, origin.x + yAxis.x,
+						  origin.x + xAxis.x + yAxis.x};
+	real32 cornersY[4] = {origin.y, origin.y + xAxis.y, origin.y + yAxis.y,
+						  origin.y + xAxis.y + yAxis.y};
+	real32 minXf = cornersX[0], maxXf = cornersX[0];
+	real32 minYf = cornersY[0], maxYf = cornersY[0];
+	for (uint32 i = 1; i < 4; i++) {
+		if (cornersX[i] < minXf) minXf = cornersX[i];
+		if (cornersX[i] > maxXf) maxXf = cornersX[i];
+		if (cornersY[i] < minYf) minYf = cornersY[i];
+		if (cornersY[i] > maxYf) maxYf = cornersY[i];
+	}
+
+	int32 minX = floorReal32ToInt32(minXf);
+	int32 minY = floorReal32ToInt32(minYf);
+	int32 maxX = ceilReal32ToInt32(maxXf);
+	int32 maxY = ceilReal32ToInt32(maxYf);
+	if (minX < 0) minX = 0;
+	if (minY < 0) minY = 0;
+	if (maxX > buffer->width) maxX = buffer->width;
+	if (maxY > buffer->height) maxY = buffer->height;
+	if (minX >= maxX || minY >= maxY) return;
+
+	// NOTE(bruno): u and v solve origin + u * xAxis + v * yAxis = p. Each is
+	// the edge function of one edge of the quad, scaled so the opposite edge
+	// sits at 1, so a pixel is inside when both are in [0, 1)
+	real32 inverseDeterminant = 1.0f / determinant;
+	__m128 uFromX = _mm_set1_ps(yAxis.y * inverseDeterminant);
+	__m128 uFromY = _mm_set1_ps(-yAxis.x * inverseDeterminant);
+	__m128 vFromX = _mm_set1_ps(-xAxis.y * inverseDeterminant);
+	__m128 vFromY = _mm_set1_ps(xAxis.x * inverseDeterminant);
+
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 half = _mm_set1_ps(0.5f);
+	__m128 alpha4 = _mm_set1_ps(alpha);
+	__m128 inverse255 = _mm_set1_ps(1.0f / 255.0f);
+	__m128 bitmapWidth = _mm_set1_ps((real32)bitmap->width);
+	__m128 bitmapHeight = _mm_set1_ps((real32)bitmap->height);
+	__m128 maxTexelX = _mm_set1_ps((real32)(bitmap->width - 1));
+	__m128 maxTexelY = _mm_set1_ps((real32)(bitmap->height - 1));
+	__m128 pixelCenters = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+	uint8 *row = (uint8 *)buffer->memory + minY * buffer->pitch;
+	for (int32 y = minY; y < maxY; y++) {
+		__m128 offsetY = _mm_set1_ps((real32)y + 0.5f - origin.y);
+		__m128 uRow = _mm_mul_ps(offsetY, uFromY);
+		__m128 vRow = _mm_mul_ps(offsetY, vFromY);
+
+		for (int32 x = minX; x < maxX; x += 4) {
+			__m128 offsetX = _mm_add_ps(_mm_set1_ps((real32)x - origin.x),
+										pixelCenters);
+			__m128 u = _mm_add_ps(uRow, _mm_mul_ps(offsetX, uFromX));
+			__m128 v = _mm_add_ps(vRow, _mm_mul_ps(offsetX, vFromX));
+
+			__m128 inside = _mm_and_ps(
+				_mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmplt_ps(u, one)),
+				_mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmplt_ps(v, one)));
+			// NOTE(bruno): most of the bounds of a rotated quad is outside
+			if (_mm_movemask_ps(inside) == 0) continue;
+
+			// NOTE(bruno): the last few pixels of a row go through a copy so
+			// we never touch memory past the end of the row
+			uint32 *pixel = (uint32 *)row + x;
+			int32 count = maxX - x;
+			uint32 tail[4] = {};
+			uint32 *dest = pixel;
+			if (count < 4) {
+				for (int32 i = 0; i < count; i++) tail[i] = pixel[i];
+				dest = tail;
+			}
+
+			// NOTE(bruno): texel centers sit half a texel in from the edges,
+			// past them the edge texel is stretched
+			__m128 texelX = _mm_sub_ps(_mm_mul_ps(u, bitmapWidth), half);
+			__m128 texelY = _mm_sub_ps(_mm_mul_ps(v, bitmapHeight), half);
+			texelX = _mm_min_ps(_mm_max_ps(texelX, zero), maxTexelX);
+			texelY = _mm_min_ps(_mm_max_ps(texelY, zero), maxTexelY);
+
+			__m128i texelX0 = _mm_cvttps_epi32(texelX);
+			__m128i texelY0 = _mm_cvttps_epi32(texelY);
+			__m128 fractionX = _mm_sub_ps(texelX, _mm_cvtepi32_ps(texelX0));
+			__m128 fractionY = _mm_sub_ps(texelY, _mm_cvtepi32_ps(texelY0));
+
+			// NOTE(bruno): no gathers before AVX2, so the fetches are scalar
+			int32 texelXs[4];
+			int32 texelYs[4];
+			_mm_storeu_si128((__m128i *)texelXs, texelX0);
+			_mm_storeu_si128((__m128i *)texelYs, texelY0);
+			uint32 samples[4][4];
+			for (uint32 i = 0; i < 4; i++) {
+				int32 x0 = texelXs[i];
+				int32 y0 = texelYs[i];
+				int32 x1 = x0 + (x0 + 1 < bitmap->width);
+				int32 y1 = y0 + (y0 + 1 < bitmap->height);
+				uint32 *row0 =
+					(uint32 *)((uint8 *)bitmap->memory + y0 * bitmap->pitch);
+				uint32 *row1 =
+					(uint32 *)((uint8 *)bitmap->memory + y1 * bitmap->pitch);
+				samples[0][i] = row0[x0];
+				samples[1][i] = row0[x1];
+				samples[2][i] = row1[x0];
+				samples[3][i] = row1[x1];
+			}
+
+			RenderPixels4 texelA =
+				unpackPixels4(_mm_loadu_si128((__m128i *)samples[0]));
+			RenderPixels4 texelB =
+				unpackPixels4(_mm_loadu_si128((__m128i *)samples[1]));
+			RenderPixels4 texelC =
+				unpackPixels4(_mm_loadu_si128((__m128i *)samples[2]));
+			RenderPixels4 texelD =
+				unpackPixels4(_mm_loadu_si128((__m128i *)samples[3]));
+
+			__m128i destPixels = _mm_loadu_si128((__m128i *)dest);
+			RenderPixels4 result = unpackPixels4(destPixels);
+
+			__m128 texelAlpha =
+				lerp4(lerp4(texelA.channels[3], fractionX, texelB.channels[3]),
+					  fractionY,
+					  lerp4(texelC.channels[3], fractionX, texelD.channels[3]));
+			texelAlpha = _mm_mul_ps(texelAlpha, alpha4);
+			__m128 destWeight =
+				_mm_sub_ps(one, _mm_mul_ps(texelAlpha, inverse255));
+
+			for (uint32 i = 0; i < 4; i++) {
+				__m128 texel = lerp4(
+					lerp4(texelA.channels[i], fractionX, texelB.channels[i]),
+					fractionY,
+					lerp4(texelC.channels[i], fractionX, texelD.channels[i]));
+				texel = _mm_mul_ps(texel, alpha4);
+				result.channels[i] = _mm_add_ps(
+					texel, _mm_mul_ps(result.channels[i], destWeight));
+			}
+
+			__m128i insideMask = _mm_castps_si128(inside);
+			__m128i blended = _mm_or_si128(
+				_mm_and_si128(insideMask, packPixels4(&result)),
+				_mm_andnot_si128(insideMask, destPixels));
+			_mm_storeu_si128((__m128i *)dest, blended);
+
+			if (count < 4) {
+				for (int32 i = 0; i < count; i++) pixel[i] = tail[i];
+			}
+		}
+		row += buffer->pitch;
+	}
+}
@@ -0,0 +1,53 @@
+#ifndef HANDMADE_RENDER_H
+
+// NOTE(bruno): every draw goes through a dispatcher that looks at the command
+// once, picks the blend mode, whether it needs clipping and the backbuffer
+// format, and hands it to the rasterizer compiled for exactly that. The
+// inner loops never branch on any of it.
+
+enum RenderBlendMode {
+	// NOTE(bruno): dest = source
+	RenderBlend_Opaque,
+	// NOTE(bruno): dest = source * alpha + dest * (1 - alpha)
+	RenderBlend_Alpha,
+	// NOTE(bruno): dest = dest + source * alpha, saturating
+	RenderBlend_Additive,
+
+	RenderBlend_Count,
+};
+
+// NOTE(bruno): whole pixels, max is one past the last pixel
+struct RenderRect {
+	int32 minX;
+	int32 minY;
+	int32 maxX;
+	int32 maxY;
+};
+
+// NOTE(bruno): 0 to 255, not premultiplied
+struct RenderColor {
+	uint32 r;
+	uint32 g;
+	uint32 b;
+	uint32 a;
+};
+
+struct Vector2 {
+	real32 x;
+	real32 y;
+};
+
+// NOTE(bruno): premultiplied alpha, in the same format as the backbuffer it
+// gets drawn into, top row first
+struct LoadedBitmap {
+	int32 width;
+	int32 height;
+	int32 pitch;
+	void *memory;
+};
+
+typedef void (*RectangleRasterizer)(GameBackbuffer *buffer, RenderRect rect,
+									RenderColor color);
+
+#define HANDMADE_RENDER_H
+#endif // HANDMADE_RENDER_H
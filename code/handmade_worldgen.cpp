@@ -0,0 +1,170 @@
+#include "handmade_worldgen.h"
+
+#define WORLDGEN_SALT_VERTICAL_DOOR 1
+#define WORLDGEN_SALT_HORIZONTAL_DOOR 2
+#define WORLDGEN_SALT_OBSTACLE 3
+
+#define WORLDGEN_OBSTACLE_PERCENT 15
+
+inline uint32 mixWorldgenHash(uint32 value) {
+	value ^= value >> 16;
+	value *= 0x85EBCA6B;
+	value ^= value >> 13;
+	value *= 0xC2B2AE35;
+	value ^= value >> 16;
+	return value;
+}
+
+inline uint32 getWorldgenHash(uint32 seed, int32 x, int32 y, uint32 salt) {
+	uint32 result = mixWorldgenHash(seed ^ (salt * 0x9E3779B9));
+	result = mixWorldgenHash(result ^ (uint32)x);
+	result = mixWorldgenHash(result ^ (uint32)y);
+	return result;
+}
+
+// NOTE(bruno): doors belong to the edge between two tilemaps, not to either
+// of them, so both sides agree on where the door is without having to look
+// at each other
+inline int32 getVerticalDoorRow(World *world, int32 leftTilemapX,
+								int32 tilemapY) {
+	uint32 hashValue = getWorldgenHash(world->seed, leftTilemapX, tilemapY,
+									   WORLDGEN_SALT_VERTICAL_DOOR);
+	return 1 + (int32)(hashValue % (uint32)(world->tilemapHeight - 2));
+}
+
+inline int32 getHorizontalDoorColumn(World *world, int32 tilemapX,
+									 int32 topTilemapY) {
+	uint32 hashValue = getWorldgenHash(world->seed, tilemapX, topTilemapY,
+									   WORLDGEN_SALT_HORIZONTAL_DOOR);
+	return 1 + (int32)(hashValue % (uint32)(world->tilemapWidth - 2));
+}
+
+void generateTilemapTiles(World *world, int32 tilemapX, int32 tilemapY,
+						  uint32 *tiles) {
+	int32 width = world->tilemapWidth;
+	int32 height = world->tilemapHeight;
+	int32 centerX = width / 2;
+	int32 centerY = height / 2;
+
+	int32 doorLeft = getVerticalDoorRow(world, tilemapX - 1, tilemapY);
+	int32 doorRight = getVerticalDoorRow(world, tilemapX, tilemapY);
+	int32 doorTop = getHorizontalDoorColumn(world, tilemapX, tilemapY - 1);
+	int32 doorBottom = getHorizontalDoorColumn(world, tilemapX, tilemapY);
+
+	for (int32 tileY = 0; tileY < height; tileY++) {
+		for (int32 tileX = 0; tileX < width; tileX++) {
+			uint32 tileID = 0;
+
+			bool onBorder = (tileX == 0 || tileY == 0 || tileX == width - 1 ||
+							 tileY == height - 1);
+			if (onBorder) {
+				tileID = 1;
+				if (tileX == 0 && tileY == doorLeft) tileID = 0;
+				if (tileX == width - 1 && tileY == doorRight) tileID = 0;
+				if (tileY == 0 && tileX == doorTop) tileID = 0;
+				if (tileY == height - 1 && tileX == doorBottom) tileID = 0;
+			} else {
+				// NOTE(bruno): the middle row and column are always open and
+				// every door has a clear lane into them, so whatever the
+				// obstacles end up being, all doors stay connected
+				bool onPath =
+					(tileY == centerY) || (tileX == centerX) ||
+					(tileY == doorLeft && tileX <= centerX) ||
+					(tileY == doorRight && tileX >= centerX) ||
+					(tileX == doorTop && tileY <= centerY) ||
+					(tileX == doorBottom && tileY >= centerY);
+
+				if (!onPath) {
+					uint32 hashValue = getWorldgenHash(
+						world->seed, tilemapX * width + tileX,
+						tilemapY * height + tileY, WORLDGEN_SALT_OBSTACLE);
+					if (hashValue % 100 < WORLDGEN_OBSTACLE_PERCENT) {
+						tileID = 1;
+					}
+				}
+			}
+
+			tiles[tileY * width + tileX] = tileID;
+		}
+	}
+}
+
+void generateTilemapWork(PlatformWorkQueue *queue, void *data) {
+	TIMED_FUNCTION();
+
+	TilemapGenerationWork *work = (TilemapGenerationWork *)data;
+	Tilemap *tilemap = work->tilemap;
+
+	assert(tilemap->state == TilemapState_Queued);
+	generateTilemapTiles(work->world, tilemap->tilemapX, tilemap->tilemapY,
+						 tilemap->tiles);
+
+	atomicStoreUInt32(&tilemap->state, TilemapState_Generated);
+}
+
+inline int32 getTilemapDistance(Tilemap *tilemap, int32 tilemapX,
+								int32 tilemapY) {
+	int32 distanceX = tilemap->tilemapX - tilemapX;
+	int32 distanceY = tilemap->tilemapY - tilemapY;
+	if (distanceX < 0) distanceX = -distanceX;
+	if (distanceY < 0) distanceY = -distanceY;
+	return distanceX > distanceY ? distanceX : distanceY;
+}
+
+// NOTE(bruno): never waits on the workers. Finished tilemaps get picked up on
+// the first frame we notice them, anything not ready yet reads as solid
+void updateWorldStreaming(GameState *gameState, GameMemory *gameMemory,
+						  int32 centerTilemapX, int32 centerTilemapY) {
+	TIMED_FUNCTION();
+
+	World *world = gameState->world;
+
+	for (uint32 i = 0; i < arraylength(world->tilemaps); i++) {
+		Tilemap *tilemap = &world->tilemaps[i];
+		uint32 state = atomicLoadUInt32(&tilemap->state);
+
+		if (state == TilemapState_Generated) {
+			tilemap->state = TilemapState_Ready;
+			invalidateFlowFieldChunk(&gameState->flowField, world,
+									 tilemap->tilemapX, tilemap->tilemapY);
+		} else if (state == TilemapState_Ready &&
+				   getTilemapDistance(tilemap, centerTilemapX,
+									  centerTilemapY) > WORLDGEN_KEEP_RADIUS) {
+			removeTilemap(world, tilemap);
+			invalidateFlowFieldChunk(&gameState->flowField, world,
+									 tilemap->tilemapX, tilemap->tilemapY);
+		}
+	}
+
+	// NOTE(bruno): queue in rings around the center so the closest tilemaps
+	// get to the workers first
+	for (int32 radius = 0; radius <= WORLDGEN_GENERATE_RADIUS; radius++) {
+		for (int32 offsetY = -radius; offsetY <= radius; offsetY++) {
+			for (int32 offsetX = -radius; offsetX <= radius; offsetX++) {
+				if (offsetX != -radius && offsetX != radius &&
+					offsetY != -radius && offsetY != radius) {
+					continue;
+				}
+
+				int32 tilemapX = centerTilemapX + offsetX;
+				int32 tilemapY = centerTilemapY + offsetY;
+				if (findTilemap(world, tilemapX, tilemapY)) continue;
+
+				Tilemap *tilemap = addTilemap(world, tilemapX, tilemapY);
+				// NOTE(bruno): pool is full of tilemaps we still need, try
+				// again once some of them get evicted
+				if (!tilemap) return;
+
+				TilemapGenerationWork *work =
+					&gameState->tilemapGenerationWork[tilemap -
+													  world->tilemaps];
+				work->world = world;
+				work->tilemap = tilemap;
+
+				tilemap->state = TilemapState_Queued;
+				gameMemory->platformAddWorkEntry(gameMemory->backgroundQueue,
+												 generateTilemapWork, work);
+			}
+		}
+	}
+}
@@ -0,0 +1,18 @@
+#ifndef HANDMADE_WORLDGEN_H
+
+// NOTE(bruno): tilemaps are generated from the world seed and their own
+// coordinates only, so the same tilemap always comes out the same no matter
+// when or on which thread it gets generated. That is what lets us throw far
+// away tilemaps out and generate them again when the player comes back.
+
+// NOTE(bruno): radii are in tilemaps around the one the player is in
+#define WORLDGEN_GENERATE_RADIUS 2
+#define WORLDGEN_KEEP_RADIUS 3
+
+struct TilemapGenerationWork {
+	World *world;
+	Tilemap *tilemap;
+};
+
+#define HANDMADE_WORLDGEN_H
+#endif // HANDMADE_WORLDGEN_H
@@ -3,9 +3,7 @@
  * - save game locations
  * - getting a handle to our own executable file
  * - asset loading path
- * - threading
  * - raw input (support multiple keyboards)
- * - sleep/timeBeginPeriod
  * - clipcursor (multimonitor support)
  * - fullscreen support
  * - wm_setcursor (control cursor visibility)
@@ -17,17 +15,42 @@
  * */
 
 #include <dlfcn.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 #include <x86intrin.h>
 
+#include "handmade_intrinsics.h"
 #include "sdl3_handmade.h"
 
-// TODO(bruno): check deadzone here
-// TODO(bruno): go back to episode 19 to improve audio and video sync
+#if HANDMADE_INTERNAL
+#include "handmade_debug.cpp"
+#endif
+
+// NOTE(bruno): of the stick's range, about what XInput recommends
+#define PLATFORM_GAMEPAD_STICK_DEADZONE 0.24f
+
+// NOTE(bruno): at 48000 Hz: 512 samples = ~10.7ms latency, 1024 = ~21.3ms
+#define PLATFORM_AUDIO_DEVICE_SAMPLE_FRAMES 512
+
+// NOTE(bruno): the margin is what we keep queued on top of what the device
+// asks for. It never goes under the floor and never over one device period
+#define PLATFORM_AUDIO_MIN_MARGIN_SAMPLES 32
+#define PLATFORM_AUDIO_MAX_MARGIN_SAMPLES PLATFORM_AUDIO_DEVICE_SAMPLE_FRAMES
+
+// NOTE(bruno): how often the debug stats and the profile get printed
+#define PLATFORM_DEBUG_REPORT_FRAMES 600
+// NOTE(bruno): per callback, at ~94 callbacks a second a spike is mostly
+// forgotten after about ten seconds
+#define PLATFORM_AUDIO_LATENESS_DECAY 0.999f
+#define PLATFORM_AUDIO_DRIFT_WINDOW_SECONDS 2.0f
 
 #define INPUT_SNAPSHOT_PATH "snapshots/handmade.hmi"
 #define MEMORY_SNAPSHOT_PATH "snapshots/handmade.hms"
@@ -42,25 +65,355 @@ global_variable PlatformBackbuffer globalBackbuffer;
 
 global_variable PlatformAudioOutput globalAudioOutput;
 
-global_variable SDL_Gamepad *GamepadHandles[MAX_CONTROLLERS] = {};
+// NOTE(bruno): slot i is game controller i + 1, the keyboard is 0
+global_variable PlatformGamepad globalGamepads[MAX_CONTROLLERS];
+
+global_variable PlatformWorkQueue globalBackgroundQueue;
+global_variable PlatformWorkQueue globalHighPriorityQueue;
+
+global_variable PlatformAsyncIO globalAsyncIO;
+
+// NOTE(bruno): SDL runs the stream callback with the stream lock held, so
+// holding it keeps the audio thread out of game memory and game code
+void platformLockAudio(PlatformAudioOutput *audioOutput) {
+	if (audioOutput->stream) SDL_LockAudioStream(audioOutput->stream);
+}
+
+void platformUnlockAudio(PlatformAudioOutput *audioOutput) {
+	if (audioOutput->stream) SDL_UnlockAudioStream(audioOutput->stream);
+}
+
+#define BACKGROUND_THREAD_COUNT 2
+// NOTE(bruno): how many times an idle worker checks for work before it goes
+// to sleep on the semaphore
+#define WORK_QUEUE_SPIN_COUNT 2000
+
+// NOTE(bruno): bounded MPMC queue in the style of Dmitry Vyukov's. Each slot
+// starts with sequence == its index. A producer that finds sequence == its
+// write index owns the slot, fills it and bumps sequence to index + 1, which
+// is what a consumer waits for. The consumer then sets it to index + size so
+// the slot is free for the producer one lap later
+bool platformTryAddWorkEntry(PlatformWorkQueue *queue,
+							 PlatformWorkQueueCallback callback, void *data) {
+	uint32 entryToWrite = atomicLoadUInt32(&queue->nextEntryToWrite);
+	for (;;) {
+		PlatformWorkQueueEntry *entry =
+			&queue->entries[entryToWrite & (PLATFORM_WORK_QUEUE_SIZE - 1)];
+		uint32 sequence = atomicLoadUInt32(&entry->sequence);
+		int32 difference = (int32)(sequence - entryToWrite);
+
+		if (difference == 0) {
+			uint32 original = atomicCompareExchangeUInt32(
+				&queue->nextEntryToWrite, entryToWrite + 1, entryToWrite);
+			if (original == entryToWrite) {
+				entry->callback = callback;
+				entry->data = data;
+				atomicStoreUInt32(&entry->sequence, entryToWrite + 1);
+				return true;
+			}
+			entryToWrite = original;
+		} else if (difference < 0) {
+			// NOTE(bruno): a whole lap behind, the queue is full
+			return false;
+		} else {
+			entryToWrite = atomicLoadUInt32(&queue->nextEntryToWrite);
+		}
+	}
+}
+
+// NOTE(bruno): returns false when there was nothing to do
+bool platformDoNextWorkQueueEntry(PlatformWorkQueue *queue) {
+	uint32 entryToRead = atomicLoadUInt32(&queue->nextEntryToRead);
+	for (;;) {
+		PlatformWorkQueueEntry *entry =
+			&queue->entries[entryToRead & (PLATFORM_WORK_QUEUE_SIZE - 1)];
+		uint32 sequence = atomicLoadUInt32(&entry->sequence);
+		int32 difference = (int32)(sequence - (entryToRead + 1));
+
+		if (difference == 0) {
+			uint32 original = atomicCompareExchangeUInt32(
+				&queue->nextEntryToRead, entryToRead + 1, entryToRead);
+			if (original == entryToRead) {
+				PlatformWorkQueueCallback callback = entry->callback;
+				void *data = entry->data;
+				atomicStoreUInt32(&entry->sequence,
+								  entryToRead + PLATFORM_WORK_QUEUE_SIZE);
+
+				{
+					TIMED_BLOCK("workQueueEntry");
+					callback(queue, data);
+				}
+				atomicAddUInt32(&queue->completionCount, 1);
+				return true;
+			}
+			entryToRead = original;
+		} else if (difference < 0) {
+			// NOTE(bruno): nobody has published this slot yet, empty
+			return false;
+		} else {
+			entryToRead = atomicLoadUInt32(&queue->nextEntryToRead);
+		}
+	}
+}
+
+void platformAddWorkEntry(PlatformWorkQueue *queue,
+						  PlatformWorkQueueCallback callback, void *data) {
+	// NOTE(bruno): counted before the entry is visible, so completing all
+	// work can never see the count catch up with a goal that is missing it
+	atomicAddUInt32(&queue->completionGoal, 1);
+
+	// NOTE(bruno): a full queue means the workers are behind, help them out
+	// instead of dropping work or blocking
+	while (!platformTryAddWorkEntry(queue, callback, data)) {
+		platformDoNextWorkQueueEntry(queue);
+	}
+
+	SDL_SignalSemaphore(queue->semaphore);
+}
+
+// NOTE(bruno): the calling thread helps out while it waits. Needed before
+// anything that would pull the rug from under a running entry, like
+// reloading the game code or overwriting game memory with a snapshot. The
+// counters are never reset, they only ever get compared for equality
+void platformCompleteAllWork(PlatformWorkQueue *queue) {
+	while (atomicLoadUInt32(&queue->completionCount) !=
+		   atomicLoadUInt32(&queue->completionGoal)) {
+		if (!platformDoNextWorkQueueEntry(queue)) _mm_pause();
+	}
+}
+
+int platformWorkerThreadProc(void *data) {
+	PlatformWorkQueue *queue = (PlatformWorkQueue *)data;
+	DEBUG_NAME_THREAD(queue->name);
+
+	for (;;) {
+		if (platformDoNextWorkQueueEntry(queue)) continue;
+
+		bool foundWork = false;
+		for (int spin = 0; spin < WORK_QUEUE_SPIN_COUNT; spin++) {
+			_mm_pause();
+			if (platformDoNextWorkQueueEntry(queue)) {
+				foundWork = true;
+				break;
+			}
+		}
+
+		if (!foundWork) SDL_WaitSemaphore(queue->semaphore);
+	}
+	return 0;
+}
+
+void platformInitializeWorkQueue(PlatformWorkQueue *queue, const char *name,
+								 int threadCount) {
+	queue->name = name;
+	queue->completionGoal = 0;
+	queue->completionCount = 0;
+	queue->nextEntryToWrite = 0;
+	queue->nextEntryToRead = 0;
+	for (uint32 i = 0; i < PLATFORM_WORK_QUEUE_SIZE; i++) {
+		queue->entries[i].sequence = i;
+	}
+	queue->semaphore = SDL_CreateSemaphore(0);
+
+	for (int i = 0; i < threadCount; i++) {
+		SDL_Thread *thread =
+			SDL_CreateThread(platformWorkerThreadProc, name, queue);
+		SDL_DetachThread(thread);
+	}
+}
+
+PlatformFileHandle platformOpenFile(const char *filename) {
+	PlatformFileHandle result = {};
+	int handle = open(filename, O_RDONLY);
+	if (handle == -1) {
+		return result;
+	}
+
+	struct stat status;
+	if (fstat(handle, &status) == -1) {
+		close(handle);
+		return result;
+	}
+
+	result.isValid = true;
+	result.size = (uint64)status.st_size;
+	result.platformHandle = handle;
+	return result;
+}
+
+// NOTE(bruno): pread leaves the file offset alone, that is what makes this
+// safe to call from several workers on the same handle
+bool platformReadDataFromFile(PlatformFileHandle *handle, uint64 offset,
+							  uint64 size, void *dest) {
+	if (!handle->isValid) return false;
+
+	uint8 *nextByteLocation = (uint8 *)dest;
+	while (size) {
+		ssize_t bytesRead =
+			pread((int)handle->platformHandle, nextByteLocation, size, offset);
+		if (bytesRead <= 0) {
+			return false;
+		}
+
+		size -= bytesRead;
+		offset += bytesRead;
+		nextByteLocation += bytesRead;
+	}
 
-// function that gets called once at startup to allocate the backbuffer
-// with fixed dimensions
-void platformResizeBackbuffer(PlatformBackbuffer *backbuffer,
-							  SDL_Renderer *renderer, int width, int height) {
+	return true;
+}
+
+void platformCloseFile(PlatformFileHandle *handle) {
+	if (handle->isValid) {
+		close((int)handle->platformHandle);
+	}
+	*handle = {};
+}
+
+// NOTE(bruno): the descriptor can go right away, the mapping keeps the file
+// alive by itself
+PlatformMappedFile platformMapFile(const char *filename) {
+	PlatformMappedFile result = {};
+	int handle = open(filename, O_RDONLY);
+	if (handle == -1) {
+		return result;
+	}
+
+	struct stat status;
+	if (fstat(handle, &status) == -1 || status.st_size == 0) {
+		close(handle);
+		return result;
+	}
+
+	void *memory = mmap(0, (size_t)status.st_size, PROT_READ, MAP_PRIVATE,
+						handle, 0);
+	close(handle);
+	if (memory == MAP_FAILED) {
+		return result;
+	}
+
+	result.isValid = true;
+	result.size = (uint64)status.st_size;
+	result.memory = memory;
+	return result;
+}
+
+// NOTE(bruno): only a hint, the kernel starts reading the pages in the
+// background and we return right away
+void platformPrefetchMemory(void *memory, uint64 size) {
+	if (!size) return;
+
+	uint64 pageSize = (uint64)sysconf(_SC_PAGESIZE);
+	uint64 start = (uint64)memory & ~(pageSize - 1);
+	uint64 end = (uint64)memory + size;
+	madvise((void *)start, (size_t)(end - start), MADV_WILLNEED);
+}
+
+// NOTE(bruno): only for read only mappings, the kernel drops the pages and the
+// next read faults them back in from the file. Pages the range only partly
+// covers stay, they may hold a neighbor's data
+void platformEvictMemory(void *memory, uint64 size) {
+	uint64 pageSize = (uint64)sysconf(_SC_PAGESIZE);
+	uint64 start = ((uint64)memory + pageSize - 1) & ~(pageSize - 1);
+	uint64 end = ((uint64)memory + size) & ~(pageSize - 1);
+	if (end <= start) return;
+
+	madvise((void *)start, (size_t)(end - start), MADV_DONTNEED);
+}
+
+#include "sdl3_handmade_io.cpp"
+#include "sdl3_handmade_input.cpp"
+
+#if HANDMADE_INTERNAL
+#include "sdl3_handmade_trace.cpp"
+#include "sdl3_handmade_overlay.cpp"
+#endif
+
+// NOTE(bruno): one worker per core, minus the one the main thread runs on.
+// The main thread works too while it waits on the queue
+int platformGetHighPriorityThreadCount() {
+	int threadCount = SDL_GetNumLogicalCPUCores() - 1;
+	if (threadCount < 1) threadCount = 1;
+	return threadCount;
+}
+
+// NOTE(bruno): everything queued can point into game memory and game code
+void platformCompleteAllQueues() {
+	platformCompleteAllWork(&globalHighPriorityQueue);
+	platformCompleteAllFileReads(&globalAsyncIO);
+	platformCompleteAllWork(&globalBackgroundQueue);
+}
+
+// NOTE(bruno): picks the backbuffer size for the window and the current mode.
+// The pool only ever holds the one backbuffer, so a new size just starts it
+// over, and nothing happens at all while the size stays the same
+void platformFitBackbuffer(PlatformBackbuffer *backbuffer, int windowWidth,
+						   int windowHeight) {
 	int bytesPerPixel = sizeof(int);
 
-	if (backbuffer->memory) free(backbuffer->memory);
+	if (windowWidth < 1) windowWidth = 1;
+	if (windowHeight < 1) windowHeight = 1;
+	backbuffer->windowWidth = windowWidth;
+	backbuffer->windowHeight = windowHeight;
+
+	// NOTE(bruno): the smallest whole scale that keeps the backbuffer at or
+	// under the scaled size
+	int scale = 1;
+	if (backbuffer->mode == BackbufferMode_Scaled) {
+		int scaleX = (windowWidth + PLATFORM_BACKBUFFER_SCALED_WIDTH - 1) /
+					 PLATFORM_BACKBUFFER_SCALED_WIDTH;
+		int scaleY = (windowHeight + PLATFORM_BACKBUFFER_SCALED_HEIGHT - 1) /
+					 PLATFORM_BACKBUFFER_SCALED_HEIGHT;
+		scale = scaleX > scaleY ? scaleX : scaleY;
+	}
+	backbuffer->scale = scale;
 
-	if (backbuffer->texture) SDL_DestroyTexture(backbuffer->texture);
+	int width = windowWidth / scale;
+	int height = windowHeight / scale;
+	if (width > PLATFORM_BACKBUFFER_MAX_WIDTH) {
+		width = PLATFORM_BACKBUFFER_MAX_WIDTH;
+	}
+	if (height > PLATFORM_BACKBUFFER_MAX_HEIGHT) {
+		height = PLATFORM_BACKBUFFER_MAX_HEIGHT;
+	}
+	if (backbuffer->memory && width == backbuffer->width &&
+		height == backbuffer->height) {
+		return;
+	}
 
 	backbuffer->width = width;
 	backbuffer->height = height;
 	backbuffer->pitch = width * bytesPerPixel;
-	backbuffer->memory = calloc(1, width * height * bytesPerPixel);
-	backbuffer->texture =
-		SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
-						  SDL_TEXTUREACCESS_STREAMING, width, height);
+	backbuffer->pool.used = 0;
+	backbuffer->memory =
+		pushSize(&backbuffer->pool, (size_t)backbuffer->pitch * height);
+}
+
+bool platformInitializeBackbuffer(PlatformBackbuffer *backbuffer,
+								  PlatformBackbufferMode mode, int windowWidth,
+								  int windowHeight) {
+	*backbuffer = {};
+
+	size_t poolSize = (size_t)PLATFORM_BACKBUFFER_MAX_WIDTH *
+					  PLATFORM_BACKBUFFER_MAX_HEIGHT * sizeof(int);
+	void *pool = mmap(0, poolSize, PROT_READ | PROT_WRITE,
+					  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (pool == MAP_FAILED) {
+		printf("Failed to reserve the backbuffer: %s\n", strerror(errno));
+		return false;
+	}
+	initializeArena(&backbuffer->pool, poolSize, pool);
+
+	backbuffer->mode = mode;
+	platformFitBackbuffer(backbuffer, windowWidth, windowHeight);
+	return true;
+}
+
+void platformToggleBackbufferMode(PlatformBackbuffer *backbuffer) {
+	backbuffer->mode = (PlatformBackbufferMode)((backbuffer->mode + 1) %
+												BackbufferMode_Count);
+	platformFitBackbuffer(backbuffer, backbuffer->windowWidth,
+						  backbuffer->windowHeight);
 }
 
 void platformStartRecordingInput(PlatformState *platformState,
@@ -102,11 +455,29 @@ void platformStartInputPlayback(PlatformState *platformState,
 	platformState->inputPlaybackHandle = handle;
 }
 
+// NOTE(bruno): the game starts fresh instead of from the memory snapshot
+// that goes with the recording, the snapshot points into the transient
+// storage of the process that recorded it. The recorded input carries the
+// simulation steps, so a replay plays out the same at any frame rate
+bool platformStartReplay(PlatformState *platformState, const char *filename) {
+	int handle = open(filename, O_RDONLY);
+	if (handle == -1) {
+		printf("Failed to open %s for replay\n", filename);
+		return false;
+	}
+
+	platformState->inputPlayingIndex = 1;
+	platformState->inputPlaybackHandle = handle;
+	platformState->isReplaying = true;
+	return true;
+}
+
 void platformStopInputPlayback(PlatformState *platformState) {
 	assert(platformState->inputPlayingIndex != 0);
 
 	close(platformState->inputPlaybackHandle);
 	platformState->inputPlayingIndex = 0;
+	platformState->isReplaying = false;
 }
 
 void platformClearInputButtonStates(GameInput *input) {
@@ -141,15 +512,24 @@ void platformRecordInput(PlatformState platformState, GameInput input) {
 }
 
 void platformReadMemorySnapshot(void *memory, size_t memorySize, int index) {
+	// NOTE(bruno): workers write into game memory, let them finish before we
+	// overwrite it
+	platformCompleteAllQueues();
+
 	int handle = open(MEMORY_SNAPSHOT_PATH, O_RDONLY);
 	if (handle == -1) {
 		assert(!"Failed to open memory snapshot file for reading");
 	}
+
+	// NOTE(bruno): the audio thread reads game memory too
+	platformLockAudio(&globalAudioOutput);
+
 	ssize_t bytesToRead = memorySize;
 	uint8 *nextByteLocation = (uint8 *)memory;
 	while (bytesToRead) {
 		ssize_t bytesRead = read(handle, nextByteLocation, bytesToRead);
 		if (bytesRead == -1) {
+			platformUnlockAudio(&globalAudioOutput);
 			close(handle);
 			return;
 		}
@@ -161,144 +541,398 @@ void platformReadMemorySnapshot(void *memory, size_t memorySize, int index) {
 		bytesToRead -= bytesRead;
 		nextByteLocation += bytesRead;
 	}
+
+	platformUnlockAudio(&globalAudioOutput);
 	close(handle);
 }
 
-void platformPlaybackInput(PlatformState *platformState, GameInput *input) {
+// NOTE(bruno): false once a replay has run out of input
+bool platformPlaybackInput(PlatformState *platformState, GameInput *input) {
 	ssize_t bytesToRead = sizeof(*input);
 	uint8 *nextByteLocation = (uint8 *)input;
 	while (bytesToRead) {
 		ssize_t bytesRead = read(platformState->inputPlaybackHandle,
 								 nextByteLocation, bytesToRead);
 		if (bytesRead == 0) {
+			if (platformState->isReplaying) {
+				return false;
+			}
 			lseek(platformState->inputPlaybackHandle, 0, SEEK_SET);
 			platformReadMemorySnapshot(platformState->gamePermanentStorage,
 									   platformState->permanentStorageSize, 1);
 		}
 		if (bytesRead == -1) {
-			return;
+			return !platformState->isReplaying;
 		}
 
 		bytesToRead -= bytesRead;
 		nextByteLocation += bytesRead;
 	}
+	return true;
 }
 
-void platformProcessKeypress(GameButtonState *newState, bool isDown) {
+void platformProcessKeypress(GameButtonState *newState, bool isDown,
+							 real32 secondsBeforeLatch) {
 	assert(newState->endedDown != isDown);
 	newState->endedDown = isDown;
 	newState->halfTransitionCount++;
+	newState->transitionSeconds = secondsBeforeLatch;
 }
 
 void platformWriteMemorySnapshot(void *memory, size_t memorySize, int index) {
+	// NOTE(bruno): otherwise the snapshot could hold work that is half done
+	// and that nobody is going to finish after it gets restored
+	platformCompleteAllQueues();
+
 	int handle = open(MEMORY_SNAPSHOT_PATH, O_WRONLY | O_CREAT | O_TRUNC,
 					  S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
 	if (handle == -1) {
 		assert(!"Failed to open memory snapshot file for writing");
 	}
+
+	platformLockAudio(&globalAudioOutput);
+
 	ssize_t bytesToWrite = memorySize;
 	uint8 *nextByteLocation = (uint8 *)memory;
 	while (bytesToWrite) {
 		ssize_t bytesWritten = write(handle, nextByteLocation, bytesToWrite);
 		if (bytesWritten == -1) {
-			return;
+			break;
 		}
 
 		bytesToWrite -= bytesWritten;
 		nextByteLocation += bytesWritten;
 	}
+
+	platformUnlockAudio(&globalAudioOutput);
 	close(handle);
 }
 
-bool platformProcessEvents(PlatformBackbuffer *backbuffer,
-						   GameControllerInput *keyboardInput, GameInput *input,
-						   PlatformState *platformState) {
+// NOTE(bruno): radial, the dead zone is a circle around the center so
+// small diagonal pushes don't snap to an axis. Past it the magnitude is
+// rescaled to start from 0, so there is no jump at the edge, and clamped to
+// the unit circle
+void platformNormalizeStick(int16 rawX, int16 rawY, real32 *stickX,
+							real32 *stickY) {
+	real32 x = (real32)rawX / (rawX < 0 ? 32768.0f : 32767.0f);
+	real32 y = (real32)rawY / (rawY < 0 ? 32768.0f : 32767.0f);
+
+	real32 magnitude = squareRoot(x * x + y * y);
+	if (magnitude <= PLATFORM_GAMEPAD_STICK_DEADZONE) {
+		*stickX = 0.0f;
+		*stickY = 0.0f;
+		return;
+	}
 
-	SDL_Event event;
-	while (SDL_PollEvent(&event)) {
-		if (event.type == SDL_EVENT_QUIT) {
-			return false;
+	real32 clamped = magnitude > 1.0f ? 1.0f : magnitude;
+	real32 scale = (clamped - PLATFORM_GAMEPAD_STICK_DEADZONE) /
+				   (1.0f - PLATFORM_GAMEPAD_STICK_DEADZONE) / magnitude;
+	*stickX = x * scale;
+	*stickY = y * scale;
+}
+
+int platformFindGamepadSlot(SDL_JoystickID id) {
+	for (int i = 0; i < MAX_CONTROLLERS; i++) {
+		if (globalGamepads[i].pad && globalGamepads[i].id == id) return i;
+	}
+	return -1;
+}
+
+// NOTE(bruno): pads past MAX_CONTROLLERS stay closed, removing one of the
+// others picks them up
+void platformAddGamepad(SDL_JoystickID id, GameInput *input) {
+	if (platformFindGamepadSlot(id) >= 0) return;
+
+	for (int i = 0; i < MAX_CONTROLLERS; i++) {
+		PlatformGamepad *gamepad = &globalGamepads[i];
+		if (gamepad->pad) continue;
+
+		gamepad->pad = SDL_OpenGamepad(id);
+		if (!gamepad->pad) {
+			printf("Failed to open gamepad: %s\n", SDL_GetError());
+			return;
 		}
-		if (event.type == SDL_EVENT_KEY_UP ||
-			event.type == SDL_EVENT_KEY_DOWN) {
-			// TODO(bruno): handle key wasdown and isdown
-			if (event.key.key == SDLK_ESCAPE) return false;
+		gamepad->id = id;
+		gamepad->stickX = 0;
+		gamepad->stickY = 0;
+		input->controllers[i + 1].isConnected = true;
+		return;
+	}
+}
 
-			if (event.key.repeat) continue;
+// NOTE(bruno): SDL sends an added event for every pad that is already
+// plugged in too, opening them here only means the first frame has them.
+// Pads that are already open are skipped
+void platformLoadControllers(GameInput *input) {
+	int gamepadCount;
+	SDL_JoystickID *ids = SDL_GetGamepads(&gamepadCount);
+	if (!ids) return;
 
-			bool isDown = (event.type == SDL_EVENT_KEY_DOWN);
+	for (int i = 0; i < gamepadCount; i++) {
+		platformAddGamepad(ids[i], input);
+	}
+	SDL_free(ids);
+}
 
-			if (!platformState->inputPlayingIndex) {
-				if (event.key.key == SDLK_W)
-					platformProcessKeypress(&keyboardInput->moveUp, isDown);
-				if (event.key.key == SDLK_A)
-					platformProcessKeypress(&keyboardInput->moveLeft, isDown);
-				if (event.key.key == SDLK_S)
-					platformProcessKeypress(&keyboardInput->moveDown, isDown);
-				if (event.key.key == SDLK_D)
-					platformProcessKeypress(&keyboardInput->moveRight, isDown);
-			}
+// NOTE(bruno): nothing stays held on a pad that is gone. The freed slot goes
+// to a pad that didn't fit when it was plugged in, if there is one
+void platformRemoveGamepad(SDL_JoystickID id, GameInput *input) {
+	int slot = platformFindGamepadSlot(id);
+	if (slot < 0) return;
 
-			if (event.key.key == SDLK_L && isDown) {
-				if (!platformState->inputRecordingIndex &&
-					!platformState->inputPlayingIndex) {
-					platformStartRecordingInput(platformState, 1);
-					platformWriteMemorySnapshot(
-						platformState->gamePermanentStorage,
-						platformState->permanentStorageSize, 1);
-				} else if (platformState->inputRecordingIndex) {
-					platformEndRecordingInput(platformState);
-					platformReadMemorySnapshot(
-						platformState->gamePermanentStorage,
-						platformState->permanentStorageSize, 1);
-					platformStartInputPlayback(platformState, 1);
-					platformClearInputButtonStates(input);
-				} else if (platformState->inputPlayingIndex) {
-					platformStopInputPlayback(platformState);
-					platformClearInputButtonStates(input);
-				} else {
-					// TODO(bruno): probably want to handle multiple playback
-					// indexes here
-					assert(!"Impossible state in input recording/playback");
-				}
-			}
+	SDL_CloseGamepad(globalGamepads[slot].pad);
+	globalGamepads[slot] = {};
+	input->controllers[slot + 1] = {};
+	platformLoadControllers(input);
+}
+
+// NOTE(bruno): pads only send what changed, so each frame starts from the
+// state the last one ended with, minus its transitions
+void platformCarryOverGamepads(GameInput *oldInput, GameInput *newInput) {
+	for (int i = 0; i < MAX_CONTROLLERS; i++) {
+		GameControllerInput *oldController = &oldInput->controllers[i + 1];
+		GameControllerInput *newController = &newInput->controllers[i + 1];
+
+		*newController = *oldController;
+		for (size_t j = 0; j < arraylength(newController->buttons); j++) {
+			newController->buttons[j].halfTransitionCount = 0;
+			newController->buttons[j].transitionSeconds = 0.0f;
 		}
-		if (event.type == SDL_EVENT_MOUSE_BUTTON_DOWN ||
-			event.type == SDL_EVENT_MOUSE_BUTTON_UP) {
-			if (platformState->inputPlayingIndex) continue;
+	}
+}
 
-			bool isDown = (event.type == SDL_EVENT_MOUSE_BUTTON_DOWN);
+GameButtonState *platformGetGamepadButton(GameControllerInput *controller,
+										  uint8 button) {
+	switch (button) {
+	case SDL_GAMEPAD_BUTTON_DPAD_UP: return &controller->moveUp;
+	case SDL_GAMEPAD_BUTTON_DPAD_DOWN: return &controller->moveDown;
+	case SDL_GAMEPAD_BUTTON_DPAD_LEFT: return &controller->moveLeft;
+	case SDL_GAMEPAD_BUTTON_DPAD_RIGHT: return &controller->moveRight;
+	case SDL_GAMEPAD_BUTTON_NORTH: return &controller->actionUp;
+	case SDL_GAMEPAD_BUTTON_SOUTH: return &controller->actionDown;
+	case SDL_GAMEPAD_BUTTON_WEST: return &controller->actionLeft;
+	case SDL_GAMEPAD_BUTTON_EAST: return &controller->actionRight;
+	case SDL_GAMEPAD_BUTTON_LEFT_SHOULDER: return &controller->leftShoulder;
+	case SDL_GAMEPAD_BUTTON_RIGHT_SHOULDER: return &controller->rightShoulder;
+	case SDL_GAMEPAD_BUTTON_BACK: return &controller->back;
+	case SDL_GAMEPAD_BUTTON_START: return &controller->start;
+	}
+	return 0;
+}
 
-			if (event.button.button == SDL_BUTTON_LEFT) {
-				platformProcessKeypress(&input->mouseButtons[0], isDown);
-			}
-			if (event.button.button == SDL_BUTTON_MIDDLE) {
-				platformProcessKeypress(&input->mouseButtons[1], isDown);
-			}
-			if (event.button.button == SDL_BUTTON_RIGHT) {
-				platformProcessKeypress(&input->mouseButtons[2], isDown);
-			}
-			if (event.button.button == SDL_BUTTON_X1) {
-				platformProcessKeypress(&input->mouseButtons[3], isDown);
-			}
-			if (event.button.button == SDL_BUTTON_X2) {
-				platformProcessKeypress(&input->mouseButtons[4], isDown);
+inline bool platformIsDpadHeld(GameControllerInput *controller) {
+	return controller->moveUp.endedDown || controller->moveDown.endedDown ||
+		   controller->moveLeft.endedDown || controller->moveRight.endedDown;
+}
+
+// NOTE(bruno): a stick out of the dead zone makes the controller analog,
+// unless the d-pad is held
+void platformUpdateGamepadStick(PlatformGamepad *gamepad,
+								GameControllerInput *controller) {
+	platformNormalizeStick(gamepad->stickX, gamepad->stickY,
+						   &controller->stickAverageX,
+						   &controller->stickAverageY);
+	if ((controller->stickAverageX != 0.0f ||
+		 controller->stickAverageY != 0.0f) &&
+		!platformIsDpadHeld(controller)) {
+		controller->isAnalog = true;
+	}
+}
+
+// NOTE(bruno): the d-pad switches the controller to digital movement. Moving
+// the stick out of the dead zone switches it back, and so does letting go of
+// the d-pad while the stick is already out
+void platformProcessGamepadEvent(SDL_Event *event, GameInput *input,
+								 PlatformInputLatch *latch) {
+	if (event->type == SDL_EVENT_GAMEPAD_BUTTON_DOWN ||
+		event->type == SDL_EVENT_GAMEPAD_BUTTON_UP) {
+		int slot = platformFindGamepadSlot(event->gbutton.which);
+		if (slot < 0) return;
+
+		GameControllerInput *controller = &input->controllers[slot + 1];
+		GameButtonState *button =
+			platformGetGamepadButton(controller, event->gbutton.button);
+		// NOTE(bruno): a pad that got plugged in with a button held sends
+		// only its release
+		if (!button || button->endedDown == event->gbutton.down) return;
+
+		platformNoteInputEvent(latch, event);
+		platformProcessKeypress(button, event->gbutton.down,
+								platformGetInputEventAge(latch, event));
+		if (platformIsDpadHeld(controller)) {
+			controller->isAnalog = false;
+		} else if (!event->gbutton.down) {
+			platformUpdateGamepadStick(&globalGamepads[slot], controller);
+		}
+	}
+
+	if (event->type == SDL_EVENT_GAMEPAD_AXIS_MOTION) {
+		int slot = platformFindGamepadSlot(event->gaxis.which);
+		if (slot < 0) return;
+
+		PlatformGamepad *gamepad = &globalGamepads[slot];
+		if (event->gaxis.axis == SDL_GAMEPAD_AXIS_LEFTX) {
+			gamepad->stickX = event->gaxis.value;
+		} else if (event->gaxis.axis == SDL_GAMEPAD_AXIS_LEFTY) {
+			gamepad->stickY = event->gaxis.value;
+		} else {
+			return;
+		}
+
+		platformUpdateGamepadStick(gamepad, &input->controllers[slot + 1]);
+	}
+
+	// TODO(bruno): rumble
+}
+
+bool platformHandleEvent(SDL_Event *event, PlatformBackbuffer *backbuffer,
+						 GameControllerInput *keyboardInput, GameInput *input,
+						 PlatformState *platformState,
+						 PlatformInputLatch *latch) {
+	if (event->type == SDL_EVENT_QUIT) {
+		return false;
+	}
+	if (event->type == SDL_EVENT_KEY_UP || event->type == SDL_EVENT_KEY_DOWN) {
+		// TODO(bruno): handle key wasdown and isdown
+		if (event->key.key == SDLK_ESCAPE) return false;
+
+		if (event->key.repeat) return true;
+
+		bool isDown = (event->type == SDL_EVENT_KEY_DOWN);
+		real32 age = platformGetInputEventAge(latch, event);
+
+		if (!platformState->inputPlayingIndex) {
+			platformNoteInputEvent(latch, event);
+			if (event->key.key == SDLK_W)
+				platformProcessKeypress(&keyboardInput->moveUp, isDown, age);
+			if (event->key.key == SDLK_A)
+				platformProcessKeypress(&keyboardInput->moveLeft, isDown, age);
+			if (event->key.key == SDLK_S)
+				platformProcessKeypress(&keyboardInput->moveDown, isDown, age);
+			if (event->key.key == SDLK_D)
+				platformProcessKeypress(&keyboardInput->moveRight, isDown, age);
+		}
+
+#if HANDMADE_INTERNAL
+		if (event->key.key == SDLK_T && isDown) {
+			platformToggleTrace(&globalTraceCapture, globalDebugTable);
+		}
+		if (event->key.key == SDLK_F1 && isDown) {
+			globalOverlay.isVisible = !globalOverlay.isVisible;
+		}
+#endif
+
+		if (event->key.key == SDLK_F2 && isDown) {
+			platformToggleBackbufferMode(backbuffer);
+		}
+
+		if (event->key.key == SDLK_L && isDown) {
+			if (!platformState->inputRecordingIndex &&
+				!platformState->inputPlayingIndex) {
+				platformStartRecordingInput(platformState, 1);
+				platformWriteMemorySnapshot(
+					platformState->gamePermanentStorage,
+					platformState->permanentStorageSize, 1);
+			} else if (platformState->inputRecordingIndex) {
+				platformEndRecordingInput(platformState);
+				platformReadMemorySnapshot(
+					platformState->gamePermanentStorage,
+					platformState->permanentStorageSize, 1);
+				platformStartInputPlayback(platformState, 1);
+				platformClearInputButtonStates(input);
+			} else if (platformState->inputPlayingIndex) {
+				platformStopInputPlayback(platformState);
+				platformClearInputButtonStates(input);
+			} else {
+				// TODO(bruno): probably want to handle multiple playback
+				// indexes here
+				assert(!"Impossible state in input recording/playback");
 			}
 		}
-		if (event.type == SDL_EVENT_MOUSE_MOTION) {
-			if (platformState->inputPlayingIndex) continue;
-			input->mouseX = event.motion.x;
-			input->mouseY = event.motion.y;
+	}
+	if (event->type == SDL_EVENT_MOUSE_BUTTON_DOWN ||
+		event->type == SDL_EVENT_MOUSE_BUTTON_UP) {
+		if (platformState->inputPlayingIndex) return true;
+
+		bool isDown = (event->type == SDL_EVENT_MOUSE_BUTTON_DOWN);
+		real32 age = platformGetInputEventAge(latch, event);
+		platformNoteInputEvent(latch, event);
+
+		if (event->button.button == SDL_BUTTON_LEFT) {
+			platformProcessKeypress(&input->mouseButtons[0], isDown, age);
+		}
+		if (event->button.button == SDL_BUTTON_MIDDLE) {
+			platformProcessKeypress(&input->mouseButtons[1], isDown, age);
+		}
+		if (event->button.button == SDL_BUTTON_RIGHT) {
+			platformProcessKeypress(&input->mouseButtons[2], isDown, age);
 		}
-		if (event.type == SDL_EVENT_MOUSE_WHEEL) {
-			if (platformState->inputPlayingIndex) continue;
-			input->mouseZ += (int32)event.wheel.y;
+		if (event->button.button == SDL_BUTTON_X1) {
+			platformProcessKeypress(&input->mouseButtons[3], isDown, age);
 		}
-		if (event.type == SDL_EVENT_WINDOW_RESIZED) {
-			// NOTE(bruno):
-			// Allow window to resize, but don't resize the backbuffer
-			// The fixed 960x540 buffer will be rendered at 0,0 with black
-			// borders or cropped if the window is smaller
+		if (event->button.button == SDL_BUTTON_X2) {
+			platformProcessKeypress(&input->mouseButtons[4], isDown, age);
+		}
+	}
+	if (event->type == SDL_EVENT_MOUSE_MOTION) {
+		if (platformState->inputPlayingIndex) return true;
+		// NOTE(bruno): the game wants backbuffer pixels. Motion comes in
+		// window points, the backbuffer is laid out in window pixels
+		real32 density = SDL_GetWindowPixelDensity(
+			SDL_GetWindowFromID(event->motion.windowID));
+		if (density <= 0.0f) density = 1.0f;
+
+		int offsetX =
+			(backbuffer->windowWidth - backbuffer->width * backbuffer->scale) /
+			2;
+		int offsetY = (backbuffer->windowHeight -
+					   backbuffer->height * backbuffer->scale) /
+					  2;
+		int32 pixelX = floorReal32ToInt32(event->motion.x * density);
+		int32 pixelY = floorReal32ToInt32(event->motion.y * density);
+		input->mouseX = (pixelX - offsetX) / backbuffer->scale;
+		input->mouseY = (pixelY - offsetY) / backbuffer->scale;
+	}
+	if (event->type == SDL_EVENT_MOUSE_WHEEL) {
+		if (platformState->inputPlayingIndex) return true;
+		input->mouseZ += (int32)event->wheel.y;
+	}
+	if (event->type == SDL_EVENT_GAMEPAD_ADDED) {
+		platformAddGamepad(event->gdevice.which, input);
+	}
+	if (event->type == SDL_EVENT_GAMEPAD_REMOVED) {
+		platformRemoveGamepad(event->gdevice.which, input);
+	}
+	if (event->type == SDL_EVENT_GAMEPAD_BUTTON_DOWN ||
+		event->type == SDL_EVENT_GAMEPAD_BUTTON_UP ||
+		event->type == SDL_EVENT_GAMEPAD_AXIS_MOTION) {
+		if (platformState->inputPlayingIndex) return true;
+		platformProcessGamepadEvent(event, input, latch);
+	}
+	if (event->type == SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED) {
+		platformFitBackbuffer(backbuffer, event->window.data1,
+							  event->window.data2);
+	}
+	return true;
+}
+
+// NOTE(bruno): this is the input latch, whatever SDL has queued up to here
+// goes into this frame
+bool platformProcessEvents(PlatformBackbuffer *backbuffer,
+						   GameControllerInput *keyboardInput, GameInput *input,
+						   PlatformState *platformState,
+						   PlatformInputLatch *latch) {
+	TIMED_FUNCTION();
+
+	SDL_PumpEvents();
+	latch->latchTicks = SDL_GetTicksNS();
+	latch->oldestEventTicks = 0;
+
+	SDL_Event event;
+	while (SDL_PollEvent(&event)) {
+		if (!platformHandleEvent(&event, backbuffer, keyboardInput, input,
+								 platformState, latch)) {
+			return false;
 		}
 	}
 	return true;
@@ -315,26 +949,29 @@ void DEBUGplatformDrawDebugAudioLine(PlatformBackbuffer *buffer, int x, int top,
 	}
 }
 
-void DEBUGPlatformDrawDebugAudio(GameSoundBuffer *gameSoundBuffer) {
+void DEBUGPlatformDrawDebugAudio() {
 	// Draw debug audio visualization
 	// Shows audio buffer state before we update the window
 	int debugQueued = SDL_GetAudioStreamQueued(globalAudioOutput.stream);
 	int debugQueuedSamples =
 		debugQueued / (globalAudioOutput.numChannels * sizeof(int16));
-	int targetQueuedSamples = (globalAudioOutput.sampleRate / 30) * 2;
+	int deviceSamples = PLATFORM_AUDIO_DEVICE_SAMPLE_FRAMES;
+	int callbackSamples =
+		(int)atomicLoadUInt32(&globalAudioOutput.lastCallbackSampleCount);
 
 	// Draw a visual representation at the top of the screen
 	// White line = current frame position
 	// Green area = queued audio
-	// Red line = target queue level
-	// Yellow area = audio we just generated this frame
+	// Red line = device buffer size
+	// Yellow area = audio the last callback generated
 
 	int debugHeight = 20;
 	int debugTop = 10;
 
-	// Scale: 1 pixel = (sampleRate / width) samples
-	real32 samplesPerPixel =
-		(real32)(globalAudioOutput.sampleRate) / (real32)globalBackbuffer.width;
+	// Scale: 1 pixel = (sampleRate / 8 / width) samples, the queue never
+	// holds much more than a device buffer so a second would be unreadable
+	real32 samplesPerPixel = (real32)(globalAudioOutput.sampleRate / 8) /
+							 (real32)globalBackbuffer.width;
 
 	// Draw current queued level (green)
 	int queuedPixels = (int)((real32)debugQueuedSamples / samplesPerPixel);
@@ -343,20 +980,38 @@ void DEBUGPlatformDrawDebugAudio(GameSoundBuffer *gameSoundBuffer) {
 										debugTop + debugHeight, 0xFF00FF00);
 	}
 
-	// Draw target queue level (red vertical line)
-	int targetPixels = (int)((real32)targetQueuedSamples / samplesPerPixel);
-	DEBUGplatformDrawDebugAudioLine(&globalBackbuffer, targetPixels, debugTop,
+	// Draw device buffer size (red vertical line)
+	int devicePixels = (int)((real32)deviceSamples / samplesPerPixel);
+	DEBUGplatformDrawDebugAudioLine(&globalBackbuffer, devicePixels, debugTop,
 									debugTop + debugHeight + 5, 0xFFFF0000);
 
-	// Draw current frame's audio generation (yellow, on top of green)
-	if (gameSoundBuffer->sampleCount > 0) {
-		int generatedPixels =
-			(int)((real32)gameSoundBuffer->sampleCount / samplesPerPixel);
-		for (int x = queuedPixels - generatedPixels;
-			 x < queuedPixels && x >= 0 && x < globalBackbuffer.width; x++) {
-			DEBUGplatformDrawDebugAudioLine(&globalBackbuffer, x, debugTop,
-											debugTop + debugHeight, 0xFFFFFF00);
-		}
+	// Draw last callback's audio generation (yellow, below the queue)
+	int generatedPixels = (int)((real32)callbackSamples / samplesPerPixel);
+	for (int x = 0; x < generatedPixels && x < globalBackbuffer.width; x++) {
+		DEBUGplatformDrawDebugAudioLine(&globalBackbuffer, x,
+										debugTop + debugHeight + 2,
+										debugTop + debugHeight + 6,
+										0xFFFFFF00);
+	}
+
+	// Draw the sync controller state (cyan = target margin on top of the
+	// device buffer, magenta = peak callback lateness, one orange tick per
+	// glitch)
+	PlatformAudioSync *sync = &globalAudioOutput.sync;
+	int marginPixels =
+		(int)((real32)(deviceSamples + sync->targetMarginSamples) /
+			  samplesPerPixel);
+	DEBUGplatformDrawDebugAudioLine(&globalBackbuffer, marginPixels, debugTop,
+									debugTop + debugHeight + 5, 0xFF00FFFF);
+	int latenessPixels = (int)(sync->peakLatenessSamples / samplesPerPixel);
+	DEBUGplatformDrawDebugAudioLine(&globalBackbuffer, latenessPixels, debugTop,
+									debugTop + debugHeight, 0xFFFF00FF);
+	for (uint32 i = 0; i < sync->glitchCount && i < 64; i++) {
+		int x = 4 + (int)i * 4;
+		DEBUGplatformDrawDebugAudioLine(&globalBackbuffer, x,
+										debugTop + debugHeight + 8,
+										debugTop + debugHeight + 12,
+										0xFFFF8000);
 	}
 
 	// Draw frame marker (white vertical line at beginning)
@@ -377,7 +1032,7 @@ DEBUGReadFileResult DEBUGPlatformReadEntireFile(const char *filename) {
 		return result;
 	}
 
-	result.size = safeTruncateUint64(status.st_size);
+	result.size = (size_t)status.st_size;
 
 	result.data = malloc(result.size);
 	if (!result.data) {
@@ -435,47 +1090,184 @@ bool DEBUGPlatformWriteEntireFile(const char *filename, uint32 size,
 }
 #endif
 
-void platformUpdateWindow(PlatformBackbuffer *buffer, SDL_Window *window,
-						  SDL_Renderer *renderer) {
-	SDL_UpdateTexture(buffer->texture, NULL, buffer->memory, buffer->pitch);
+// NOTE(bruno): textures grow in steps of this so dragging a window bigger
+// doesn't make a new one every frame
+#define PLATFORM_TEXTURE_GRANULARITY 256
+
+void platformUpdateWindow(PlatformBackbuffer *buffer, SDL_Renderer *renderer) {
+	TIMED_FUNCTION();
+
+	if (buffer->width > buffer->textureWidth ||
+		buffer->height > buffer->textureHeight) {
+		if (buffer->texture) SDL_DestroyTexture(buffer->texture);
+
+		int granularity = PLATFORM_TEXTURE_GRANULARITY;
+		int textureWidth =
+			(buffer->width + granularity - 1) / granularity * granularity;
+		int textureHeight =
+			(buffer->height + granularity - 1) / granularity * granularity;
+		buffer->texture = SDL_CreateTexture(
+			renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+			textureWidth, textureHeight);
+		if (!buffer->texture) {
+			printf("Failed to create the backbuffer texture: %s\n",
+				   SDL_GetError());
+			buffer->textureWidth = 0;
+			buffer->textureHeight = 0;
+			return;
+		}
+		SDL_SetTextureScaleMode(buffer->texture, SDL_SCALEMODE_NEAREST);
+		buffer->textureWidth = textureWidth;
+		buffer->textureHeight = textureHeight;
+	}
 
-	// Render the fixed 960x540 buffer at 0,0
-	// If window is larger, there will be black borders on right/bottom
-	// If window is smaller, the content will be cropped
+	SDL_Rect updateRect = {0, 0, buffer->width, buffer->height};
+	SDL_UpdateTexture(buffer->texture, &updateRect, buffer->memory,
+					  buffer->pitch);
 
-	real32 offsetX = 0.0f;
-	real32 offsetY = 0.0f;
+	// NOTE(bruno): whatever the whole scale doesn't cover, at most scale - 1
+	// pixels each way, is a black border around the centered image
+	int destWidth = buffer->width * buffer->scale;
+	int destHeight = buffer->height * buffer->scale;
+	SDL_FRect sourceRect = {0.0f, 0.0f, (float)buffer->width,
+							(float)buffer->height};
+	SDL_FRect destRect = {(float)((buffer->windowWidth - destWidth) / 2),
+						  (float)((buffer->windowHeight - destHeight) / 2),
+						  (float)destWidth, (float)destHeight};
 
-	SDL_FRect destRect = {offsetX, offsetY, (float)buffer->width,
-						  (float)buffer->height};
-	SDL_RenderTexture(renderer, buffer->texture, NULL, &destRect);
+	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+	SDL_RenderClear(renderer);
+	SDL_RenderTexture(renderer, buffer->texture, &sourceRect, &destRect);
 
 	SDL_RenderPresent(renderer);
 }
 
-void platformLoadControllers() {
+// NOTE(bruno): figures out how much we need to keep queued so the device
+// never runs dry. A callback that arrives later than the previous request
+// should have taken to play ate into the margin, if it ate more than we had
+// queued the device played silence
+void platformUpdateAudioSync(PlatformAudioSync *sync, int sampleRate,
+							 uint64 counter, int requestedSamples) {
+	uint64 frequency = SDL_GetPerformanceFrequency();
+
+	if (sync->callbackCount == 0) {
+		sync->windowStartCounter = counter;
+		sync->measuredSampleRate = (real32)sampleRate;
+		sync->targetMarginSamples = PLATFORM_AUDIO_MAX_MARGIN_SAMPLES;
+	} else {
+		real32 rate = sync->measuredSampleRate;
+		real32 secondsElapsed =
+			(real32)(counter - sync->lastCallbackCounter) / (real32)frequency;
+		real32 expectedSeconds = (real32)sync->lastRequestedSamples / rate;
+		real32 latenessSamples = (secondsElapsed - expectedSeconds) * rate;
+
+		if (latenessSamples > (real32)sync->lastMarginSamples) {
+			sync->glitchCount++;
+			// NOTE(bruno): we were wrong about how much was safe, back off
+			// hard and let the decay bring it down again
+			latenessSamples += 0.5f * PLATFORM_AUDIO_DEVICE_SAMPLE_FRAMES;
+		}
 
-	int gamepadCount;
-	uint *ids = SDL_GetGamepads(&gamepadCount);
+		sync->peakLatenessSamples *= PLATFORM_AUDIO_LATENESS_DECAY;
+		if (latenessSamples > sync->peakLatenessSamples) {
+			sync->peakLatenessSamples = latenessSamples;
+		}
 
-	// TODO: handle proper controller count exceeding the size of game
-	// controllers (which is currently 4)
-	for (int i = 0; i < gamepadCount && i < MAX_CONTROLLERS; i++) {
-		SDL_Gamepad *pad = SDL_OpenGamepad(ids[i]);
-		if (pad) {
-			GamepadHandles[i] = pad;
+		int target = (int)(1.25f * sync->peakLatenessSamples) +
+					 PLATFORM_AUDIO_MIN_MARGIN_SAMPLES;
+		if (target > PLATFORM_AUDIO_MAX_MARGIN_SAMPLES) {
+			target = PLATFORM_AUDIO_MAX_MARGIN_SAMPLES;
+		}
+		sync->targetMarginSamples = target;
+
+		sync->windowSampleCount += sync->lastRequestedSamples;
+		real32 windowSeconds =
+			(real32)(counter - sync->windowStartCounter) / (real32)frequency;
+		if (windowSeconds >= PLATFORM_AUDIO_DRIFT_WINDOW_SECONDS) {
+			real32 windowRate = (real32)sync->windowSampleCount / windowSeconds;
+			sync->measuredSampleRate += 0.25f * (windowRate - rate);
+			sync->driftPPM =
+				(sync->measuredSampleRate / (real32)sampleRate - 1.0f) *
+				1000000.0f;
+			sync->windowStartCounter = counter;
+			sync->windowSampleCount = 0;
 		}
 	}
+
+	sync->lastCallbackCounter = counter;
+	sync->lastRequestedSamples = requestedSamples;
+	sync->callbackCount++;
 }
 
-void platformInitializeSound(PlatformAudioOutput *audioOutput) {
+// NOTE(bruno): the device pulls samples on its own thread through this, so
+// audio latency is set by the device buffer and not by our frame rate. We
+// only ever queue the target margin on top of what it asked for
+void platformAudioStreamCallback(void *userdata, SDL_AudioStream *stream,
+								 int additionalAmount, int totalAmount) {
+	DEBUG_NAME_THREAD("audio");
+	TIMED_FUNCTION();
+
+	PlatformAudioOutput *audioOutput = (PlatformAudioOutput *)userdata;
+	PlatformAudioSync *sync = &audioOutput->sync;
+
+	int bytesPerSample = audioOutput->numChannels * sizeof(int16);
+	int requestedSamples = totalAmount / bytesPerSample;
+	int queuedSamples = SDL_GetAudioStreamQueued(stream) / bytesPerSample;
+
+	platformUpdateAudioSync(sync, audioOutput->sampleRate,
+							SDL_GetPerformanceCounter(), requestedSamples);
+
+	int samplesToGenerate =
+		requestedSamples + sync->targetMarginSamples - queuedSamples;
+	int minSamplesToGenerate = additionalAmount / bytesPerSample;
+	if (samplesToGenerate < minSamplesToGenerate) {
+		samplesToGenerate = minSamplesToGenerate;
+	}
+	sync->lastMarginSamples =
+		queuedSamples + samplesToGenerate - requestedSamples;
+	if (samplesToGenerate <= 0) return;
+	if (samplesToGenerate > audioOutput->maxSampleCount) {
+		samplesToGenerate = audioOutput->maxSampleCount;
+	}
+
+	GameSoundBuffer soundBuffer = {};
+	soundBuffer.samples = audioOutput->samples;
+	soundBuffer.sampleRate = audioOutput->sampleRate;
+	soundBuffer.sampleCount = samplesToGenerate;
+
+	PlatformGameCode *gameCode = audioOutput->gameCode;
+	if (gameCode && gameCode->loaded) {
+		gameCode->gameGetSoundSamples(audioOutput->gameMemory, &soundBuffer);
+	} else {
+		memset(soundBuffer.samples, 0, samplesToGenerate * bytesPerSample);
+	}
+
+	SDL_PutAudioStreamData(stream, soundBuffer.samples,
+						   samplesToGenerate * bytesPerSample);
+	atomicStoreUInt32(&audioOutput->lastCallbackSampleCount,
+					  (uint32)samplesToGenerate);
+}
+
+void platformInitializeSound(PlatformAudioOutput *audioOutput,
+							 GameMemory *gameMemory,
+							 PlatformGameCode *gameCode) {
 	audioOutput->sampleRate = 48000;
 	audioOutput->numChannels = 2;
+	audioOutput->gameMemory = gameMemory;
+	audioOutput->gameCode = gameCode;
+
+	// NOTE(bruno): way more than the device will ever ask for in one go
+	audioOutput->maxSampleCount = audioOutput->sampleRate;
+	audioOutput->samples = (int16 *)calloc(
+		audioOutput->maxSampleCount * audioOutput->numChannels, sizeof(int16));
 
 	// Set low-latency audio buffer size hint before opening device
 	// Lower values = lower latency but more CPU usage
 	// At 48000 Hz: 512 samples = ~10.7ms latency, 1024 = ~21.3ms
-	SDL_SetHint(SDL_HINT_AUDIO_DEVICE_SAMPLE_FRAMES, "512");
+	char deviceSampleFrames[16];
+	snprintf(deviceSampleFrames, sizeof(deviceSampleFrames), "%d",
+			 PLATFORM_AUDIO_DEVICE_SAMPLE_FRAMES);
+	SDL_SetHint(SDL_HINT_AUDIO_DEVICE_SAMPLE_FRAMES, deviceSampleFrames);
 
 	// Open the audio device
 	SDL_AudioSpec spec = {};
@@ -512,126 +1304,13 @@ void platformInitializeSound(PlatformAudioOutput *audioOutput) {
 		return;
 	}
 
+	SDL_SetAudioStreamGetCallback(audioOutput->stream,
+								  platformAudioStreamCallback, audioOutput);
+
 	// Resume the device (it starts paused)
 	SDL_ResumeAudioDevice(audioOutput->device);
 }
 
-void processControllerButton(GameButtonState *oldState,
-							 GameButtonState *newState, bool value) {
-	newState->endedDown = value;
-	newState->halfTransitionCount +=
-		(oldState->endedDown != newState->endedDown) ? 1 : 0;
-}
-
-void platformProcessControllers(GameInput *gameInput) {
-
-	// TODO(bruno): handle this loop when we have more controllers on sdl than
-	// on game
-	for (int i = 0; i < MAX_CONTROLLERS; i++) {
-		GameControllerInput *oldController = &gameInput->controllers[i + 1];
-		GameControllerInput *newController = &gameInput->controllers[i + 1];
-
-		SDL_Gamepad *pad = GamepadHandles[i];
-		if (!pad) {
-			newController->isConnected = false;
-			continue;
-		}
-
-		newController->isConnected = true;
-
-		// Process D-pad buttons
-		bool dpadUp = SDL_GetGamepadButton(pad, SDL_GAMEPAD_BUTTON_DPAD_UP);
-		bool dpadDown = SDL_GetGamepadButton(pad, SDL_GAMEPAD_BUTTON_DPAD_DOWN);
-		bool dpadLeft = SDL_GetGamepadButton(pad, SDL_GAMEPAD_BUTTON_DPAD_LEFT);
-		bool dpadRight =
-			SDL_GetGamepadButton(pad, SDL_GAMEPAD_BUTTON_DPAD_RIGHT);
-
-		processControllerButton(&oldController->moveUp, &newController->moveUp,
-								dpadUp);
-		processControllerButton(&oldController->moveDown,
-								&newController->moveDown, dpadDown);
-		processControllerButton(&oldController->moveLeft,
-								&newController->moveLeft, dpadLeft);
-		processControllerButton(&oldController->moveRight,
-								&newController->moveRight, dpadRight);
-
-		int16 sdlStickX = SDL_GetGamepadAxis(pad, SDL_GAMEPAD_AXIS_LEFTX);
-		int16 sdlStickY = SDL_GetGamepadAxis(pad, SDL_GAMEPAD_AXIS_LEFTY);
-		real32 stickX;
-		if (sdlStickX < 0) {
-			stickX = (real32)sdlStickX / 32768.0f;
-		} else {
-			stickX = (real32)sdlStickX / 32767.0f;
-		}
-		real32 stickY;
-		if (sdlStickY < 0) {
-			stickY = (real32)sdlStickY / 32768.0f;
-		} else {
-			stickY = (real32)sdlStickY / 32767.0f;
-		}
-
-		newController->stickAverageX = stickX;
-		newController->stickAverageY = stickY;
-
-		// Set isAnalog based on stick movement and dpad state
-		// If any dpad button is pressed, set to false (digital input)
-		// Otherwise, set based on whether stick is being used
-		bool dpadPressed = dpadUp || dpadDown || dpadLeft || dpadRight;
-		if (dpadPressed) {
-			newController->isAnalog = false;
-		} else {
-			newController->isAnalog = (stickX != 0.0f || stickY != 0.0f);
-		}
-
-		processControllerButton(
-			&oldController->actionDown, &newController->actionDown,
-			SDL_GetGamepadButton(pad, SDL_GAMEPAD_BUTTON_SOUTH));
-		processControllerButton(
-			&oldController->actionRight, &newController->actionRight,
-			SDL_GetGamepadButton(pad, SDL_GAMEPAD_BUTTON_EAST));
-		processControllerButton(
-			&oldController->actionLeft, &newController->actionLeft,
-			SDL_GetGamepadButton(pad, SDL_GAMEPAD_BUTTON_WEST));
-		processControllerButton(
-			&oldController->actionUp, &newController->actionUp,
-			SDL_GetGamepadButton(pad, SDL_GAMEPAD_BUTTON_NORTH));
-
-		// TODO(bruno): rumble
-	}
-}
-
-int platformGetSamplesToGenerate(int64 frameStart, int64 lastFrameStart) {
-	// Always generate audio based on elapsed time
-	uint64 perfFrequency = SDL_GetPerformanceFrequency();
-	real64 secondsElapsed =
-		(real64)(frameStart - lastFrameStart) / (real64)perfFrequency;
-
-	int samplesToGenerate =
-		(int)(secondsElapsed * globalAudioOutput.sampleRate) + 1;
-
-	// Clamp to max one frame at 15fps to handle debugger pauses
-	int maxSamplesPerFrame = globalAudioOutput.sampleRate / 15;
-	if (samplesToGenerate > maxSamplesPerFrame) {
-		samplesToGenerate = maxSamplesPerFrame;
-	}
-
-	return samplesToGenerate;
-}
-
-bool platformShouldQueueAudioSamples() {
-
-	// Only push to audio stream if queue is below target (prevent
-	// accumulation)
-	int queued = SDL_GetAudioStreamQueued(globalAudioOutput.stream);
-	int queuedSamples =
-		queued / (globalAudioOutput.numChannels * sizeof(int16));
-	// Target: keep about 2-3 frames worth queued (~66ms at 30fps = safe
-	// buffer)
-	int targetQueuedSamples = (globalAudioOutput.sampleRate / 30) * 2;
-
-	return queuedSamples < targetQueuedSamples;
-}
-
 bool platformInitializeGameMemory(GameMemory *gameMemory,
 								  PlatformState *platformState) {
 	gameMemory->permanentStorageSize = Megabytes(64);
@@ -658,9 +1337,24 @@ bool platformInitializeGameMemory(GameMemory *gameMemory,
 	gameMemory->transientStorage =
 		(void *)((uint8 *)memory + gameMemory->permanentStorageSize);
 
+#if HANDMADE_INTERNAL
 	gameMemory->DEBUGPlatformReadEntireFile = &DEBUGPlatformReadEntireFile;
 	gameMemory->DEBUGPlatformFreeFileMemory = &DEBUGPlatformFreeFileMemory;
 	gameMemory->DEBUGPlatformWriteEntireFile = &DEBUGPlatformWriteEntireFile;
+#endif
+
+	gameMemory->platformOpenFile = &platformOpenFile;
+	gameMemory->platformReadDataFromFile = &platformReadDataFromFile;
+	gameMemory->platformCloseFile = &platformCloseFile;
+	gameMemory->platformSubmitFileRead = &platformSubmitFileRead;
+	gameMemory->platformMapFile = &platformMapFile;
+	gameMemory->platformPrefetchMemory = &platformPrefetchMemory;
+	gameMemory->platformEvictMemory = &platformEvictMemory;
+
+	gameMemory->backgroundQueue = &globalBackgroundQueue;
+	gameMemory->highPriorityQueue = &globalHighPriorityQueue;
+	gameMemory->platformAddWorkEntry = &platformAddWorkEntry;
+	gameMemory->platformCompleteAllWork = &platformCompleteAllWork;
 
 	platformState->gamePermanentStorage = memory;
 	platformState->permanentStorageSize = totalSize;
@@ -669,16 +1363,6 @@ bool platformInitializeGameMemory(GameMemory *gameMemory,
 	return true;
 }
 
-void platformOutputSound(PlatformAudioOutput *audioOutput,
-						 GameSoundBuffer *gameSoundBuffer) {
-	if (!gameSoundBuffer->samples || gameSoundBuffer->sampleCount == 0) return;
-	// Push audio data to the stream
-	int bytesPerSample = audioOutput->numChannels * sizeof(int16);
-	int bytesToWrite = gameSoundBuffer->sampleCount * bytesPerSample;
-	SDL_PutAudioStreamData(audioOutput->stream, gameSoundBuffer->samples,
-						   bytesToWrite);
-}
-
 int platformGetDisplayRefreshRate(SDL_Window *window) {
 	int defaultRefreshRate = 60;
 
@@ -701,42 +1385,394 @@ real32 platformGetSecondsElapsed(int64 oldCounter, int64 currentCounter) {
 			(real32)SDL_GetPerformanceFrequency());
 }
 
-inline void platformDelayFrame(int64 frameStart, real32 targetSecondsPerFrame) {
+// NOTE(bruno): the governor only moves between full, 1/2 and 1/3 of the
+// refresh rate. It steps down quickly once the average work gets close to the
+// budget, and only steps back up after a long stretch of fitting comfortably
+// in the faster budget, so it doesn't flip back and forth at the edge
+#define GOVERNOR_MAX_DIVISOR 3
+#define GOVERNOR_SMOOTHING 0.1f
+#define GOVERNOR_STEP_DOWN_LOAD 0.9f
+#define GOVERNOR_STEP_UP_LOAD 0.6f
+#define GOVERNOR_STEP_DOWN_FRAMES 30
+#define GOVERNOR_STEP_UP_FRAMES 180
+
+inline real32 platformGetGovernorSecondsPerFrame(PlatformRateGovernor *governor,
+												 int divisor) {
+	return (real32)divisor / (real32)governor->refreshRate;
+}
+
+void platformInitializeRateGovernor(PlatformRateGovernor *governor,
+									int refreshRate) {
+	*governor = {};
+	governor->refreshRate = refreshRate;
+	governor->divisor = 1;
+}
+
+void platformSetGovernorDivisor(PlatformRateGovernor *governor, int divisor) {
+	printf("governor: %d Hz -> %d Hz (work %.2fms, budget %.2fms)\n",
+		   governor->refreshRate / governor->divisor,
+		   governor->refreshRate / divisor,
+		   governor->averageWorkSeconds * 1000.0f,
+		   platformGetGovernorSecondsPerFrame(governor, governor->divisor) *
+			   1000.0f);
+
+	governor->divisor = divisor;
+	governor->framesOverBudget = 0;
+	governor->framesUnderBudget = 0;
+}
+
+// NOTE(bruno): workSeconds is everything the frame did before handing the
+// image to the display. Returns the seconds per frame to pace the next frame
+// to
+real32 platformUpdateRateGovernor(PlatformRateGovernor *governor,
+								  real32 workSeconds) {
+	governor->averageWorkSeconds +=
+		GOVERNOR_SMOOTHING * (workSeconds - governor->averageWorkSeconds);
+
+	real32 budget =
+		platformGetGovernorSecondsPerFrame(governor, governor->divisor);
+	if (governor->averageWorkSeconds > GOVERNOR_STEP_DOWN_LOAD * budget) {
+		governor->framesOverBudget++;
+	} else {
+		governor->framesOverBudget = 0;
+	}
+
+	if (governor->divisor > 1) {
+		real32 fasterBudget =
+			platformGetGovernorSecondsPerFrame(governor, governor->divisor - 1);
+		if (governor->averageWorkSeconds <
+			GOVERNOR_STEP_UP_LOAD * fasterBudget) {
+			governor->framesUnderBudget++;
+		} else {
+			governor->framesUnderBudget = 0;
+		}
+	}
+
+	if (governor->framesOverBudget >= GOVERNOR_STEP_DOWN_FRAMES &&
+		governor->divisor < GOVERNOR_MAX_DIVISOR) {
+		platformSetGovernorDivisor(governor, governor->divisor + 1);
+	} else if (governor->framesUnderBudget >= GOVERNOR_STEP_UP_FRAMES) {
+		platformSetGovernorDivisor(governor, governor->divisor - 1);
+	}
+
+	return platformGetGovernorSecondsPerFrame(governor, governor->divisor);
+}
+
+// NOTE(bruno): measures the real time since the last frame and turns it into
+// whole simulation steps. What is left over carries to the next frame and
+// tells the game how far to blend towards the newest simulated state
+void platformAdvanceSimulationClock(PlatformSimulationClock *clock,
+									int64 frameStart, GameInput *input) {
+	if (clock->lastFrameStart) {
+		real32 frameSeconds =
+			platformGetSecondsElapsed(clock->lastFrameStart, frameStart);
+		clock->accumulatedSeconds += frameSeconds;
+	} else {
+		// NOTE(bruno): first frame, simulate one step so there is something
+		// to show
+		clock->accumulatedSeconds = clock->secondsPerStep;
+	}
+	clock->lastFrameStart = frameStart;
+
+	uint32 stepCount =
+		(uint32)(clock->accumulatedSeconds / clock->secondsPerStep);
+	clock->accumulatedSeconds -= (real32)stepCount * clock->secondsPerStep;
+	if (stepCount > GAME_MAX_SIMULATION_STEPS_PER_FRAME) {
+		clock->droppedStepCount +=
+			stepCount - GAME_MAX_SIMULATION_STEPS_PER_FRAME;
+		stepCount = GAME_MAX_SIMULATION_STEPS_PER_FRAME;
+	}
+
+	input->deltaTime = clock->secondsPerStep;
+	input->simulationStepCount = stepCount;
+	input->interpolation = clock->accumulatedSeconds / clock->secondsPerStep;
+}
+
+// NOTE(bruno): the spin tail never gets shorter than this, and the sleep
+// calibration never trusts the scheduler to wake us closer than it
+#define FRAME_PACER_MIN_SPIN_SECONDS 0.0002
+#define FRAME_PACER_MAX_SPIN_SECONDS 0.004
+#define FRAME_PACER_OVERSHOOT_DECAY 0.99
+#define FRAME_PACER_REPORT_FRAMES 600
+
+void platformSleepSeconds(real64 seconds) {
+	struct timespec request;
+	request.tv_sec = (time_t)seconds;
+	request.tv_nsec = (long)((seconds - (real64)request.tv_sec) * 1e9);
+
+	struct timespec remaining;
+	while (clock_nanosleep(CLOCK_MONOTONIC, 0, &request, &remaining) ==
+		   EINTR) {
+		request = remaining;
+	}
+}
+
+void platformRecordFrameError(PlatformFramePacer *pacer, real64 errorSeconds) {
+	if (errorSeconds < 0.0) errorSeconds = -errorSeconds;
+
+	uint32 bucket = (uint32)(errorSeconds * 1000000.0 /
+							 FRAME_PACER_BUCKET_MICROSECONDS);
+	if (bucket >= FRAME_PACER_BUCKET_COUNT) {
+		bucket = FRAME_PACER_BUCKET_COUNT - 1;
+	}
+	pacer->histogram[bucket]++;
+	pacer->frameCount++;
+
+	if (errorSeconds > pacer->maxErrorSeconds) {
+		pacer->maxErrorSeconds = errorSeconds;
+	}
+}
+
+// NOTE(bruno): upper edge of the bucket the percentile falls in, in
+// microseconds
+uint32 platformGetFrameErrorPercentile(PlatformFramePacer *pacer,
+									   real32 percentile) {
+	uint32 wanted = (uint32)(percentile * (real32)pacer->frameCount);
+	uint32 seen = 0;
+	for (uint32 i = 0; i < FRAME_PACER_BUCKET_COUNT; i++) {
+		seen += pacer->histogram[i];
+		if (seen > wanted) return (i + 1) * FRAME_PACER_BUCKET_MICROSECONDS;
+	}
+	return FRAME_PACER_BUCKET_COUNT * FRAME_PACER_BUCKET_MICROSECONDS;
+}
+
+void platformReportFramePacing(PlatformFramePacer *pacer) {
+	printf("frame error over %u frames  p50: <%uus  p99: <%uus  max: %.0fus  "
+		   "spin margin: %.0fus\n",
+		   pacer->frameCount, platformGetFrameErrorPercentile(pacer, 0.5f),
+		   platformGetFrameErrorPercentile(pacer, 0.99f),
+		   pacer->maxErrorSeconds * 1000000.0,
+		   pacer->sleepOvershootSeconds * 1000000.0);
+
+	pacer->frameCount = 0;
+	pacer->maxErrorSeconds = 0.0;
+	for (uint32 i = 0; i < FRAME_PACER_BUCKET_COUNT; i++) {
+		pacer->histogram[i] = 0;
+	}
+}
+
+// NOTE(bruno): sleeps until a calibrated margin before the deadline and spins
+// on the performance counter for the rest, so we are not at the mercy of the
+// scheduler's wake up granularity. Returns the counter it stopped at
+int64 platformWaitUntil(PlatformFramePacer *pacer, int64 deadline) {
+	uint64 frequency = SDL_GetPerformanceFrequency();
+
+	real64 spinSeconds = pacer->sleepOvershootSeconds;
+	if (spinSeconds < FRAME_PACER_MIN_SPIN_SECONDS) {
+		spinSeconds = FRAME_PACER_MIN_SPIN_SECONDS;
+	}
+
+	int64 now = SDL_GetPerformanceCounter();
+	real64 secondsLeft = (real64)(deadline - now) / (real64)frequency;
+	if (secondsLeft > spinSeconds) {
+		real64 sleepSeconds = secondsLeft - spinSeconds;
+		platformSleepSeconds(sleepSeconds);
 
-	real32 secondsElapsed =
-		platformGetSecondsElapsed(frameStart, SDL_GetPerformanceCounter());
+		int64 wokeUp = SDL_GetPerformanceCounter();
+		real64 overshoot =
+			(real64)(wokeUp - now) / (real64)frequency - sleepSeconds;
 
-	if (secondsElapsed < targetSecondsPerFrame) {
-		uint32 msToSleep =
-			(uint32)((targetSecondsPerFrame - secondsElapsed) * 1000.0f);
-		if (msToSleep > 0) {
-			SDL_Delay(msToSleep);
+		pacer->sleepOvershootSeconds *= FRAME_PACER_OVERSHOOT_DECAY;
+		if (overshoot > pacer->sleepOvershootSeconds) {
+			pacer->sleepOvershootSeconds = overshoot;
 		}
+		if (pacer->sleepOvershootSeconds > FRAME_PACER_MAX_SPIN_SECONDS) {
+			pacer->sleepOvershootSeconds = FRAME_PACER_MAX_SPIN_SECONDS;
+		}
+	}
+
+	now = SDL_GetPerformanceCounter();
+	while (now < deadline) {
+		_mm_pause();
+		now = SDL_GetPerformanceCounter();
 	}
+	return now;
+}
+
+void platformWaitForFrameEnd(PlatformFramePacer *pacer, int64 frameStart,
+							 real32 targetSecondsPerFrame) {
+	TIMED_FUNCTION();
+
+	uint64 frequency = SDL_GetPerformanceFrequency();
+	int64 deadline =
+		frameStart + (int64)((real64)targetSecondsPerFrame * (real64)frequency);
+
+	int64 now = platformWaitUntil(pacer, deadline);
+	platformRecordFrameError(pacer,
+							 (real64)(now - deadline) / (real64)frequency);
+#if HANDMADE_INTERNAL
+	if (pacer->frameCount >= FRAME_PACER_REPORT_FRAMES) {
+		platformReportFramePacing(pacer);
+	}
+#endif
 }
 
-time_t platformGetFileModTime(const char *filename) {
-	struct stat fileStatus;
-	if (stat(filename, &fileStatus) == 0) {
-		return fileStatus.st_mtime;
+// NOTE(bruno): holds the frame back by whatever the work after the latch
+// doesn't need of it, going by the slowest recent frames plus a margin for
+// the upload and the present. Returns the counter the input got latched at
+int64 platformWaitForInputLatch(PlatformInputLatch *latch,
+								PlatformFramePacer *pacer, int64 frameStart,
+								real32 targetSecondsPerFrame) {
+	TIMED_FUNCTION();
+
+	latch->delaySeconds = 0.0;
+	if (!latch->isEnabled) return SDL_GetPerformanceCounter();
+
+	real64 delaySeconds = (real64)targetSecondsPerFrame -
+						  latch->peakWorkSeconds - INPUT_LATCH_SAFETY_SECONDS;
+	real64 maxDelaySeconds =
+		INPUT_LATCH_MAX_DELAY_FRACTION * (real64)targetSecondsPerFrame;
+	if (delaySeconds > maxDelaySeconds) delaySeconds = maxDelaySeconds;
+	if (delaySeconds <= 0.0) return SDL_GetPerformanceCounter();
+
+	latch->delaySeconds = delaySeconds;
+	int64 deadline =
+		frameStart +
+		(int64)(delaySeconds * (real64)SDL_GetPerformanceFrequency());
+	return platformWaitUntil(pacer, deadline);
+}
+
+// NOTE(bruno): the compiler might write the library in several steps, so we
+// react both to writes being finished and to the build moving a finished
+// library into place
+int platformGameCodeWatchThreadProc(void *data) {
+	PlatformGameCodeWatch *watch = (PlatformGameCodeWatch *)data;
+
+	alignas(struct inotify_event) char buffer[4096];
+	for (;;) {
+		ssize_t bytesRead = read(watch->inotifyHandle, buffer, sizeof(buffer));
+		if (bytesRead <= 0) {
+			if (bytesRead == -1 && errno == EINTR) continue;
+			break;
+		}
+
+		for (char *at = buffer; at < buffer + bytesRead;) {
+			struct inotify_event *event = (struct inotify_event *)at;
+			if (event->len && strcmp(event->name, watch->filename) == 0) {
+				atomicStoreUInt32(&watch->changed, 1);
+			}
+			at += sizeof(struct inotify_event) + event->len;
+		}
 	}
+
 	return 0;
 }
 
+bool platformInitializeGameCodeWatch(PlatformGameCodeWatch *watch,
+									 const char *libPath) {
+	const char *slash = strrchr(libPath, '/');
+	if (slash) {
+		snprintf(watch->directory, sizeof(watch->directory), "%.*s",
+				 (int)(slash - libPath), libPath);
+		snprintf(watch->filename, sizeof(watch->filename), "%s", slash + 1);
+	} else {
+		snprintf(watch->directory, sizeof(watch->directory), ".");
+		snprintf(watch->filename, sizeof(watch->filename), "%s", libPath);
+	}
+
+	// NOTE(bruno): watching the directory and not the file, the file gets
+	// replaced by a new inode on every build
+	watch->inotifyHandle = inotify_init1(IN_CLOEXEC);
+	if (watch->inotifyHandle == -1) return false;
+	if (inotify_add_watch(watch->inotifyHandle, watch->directory,
+						  IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+		close(watch->inotifyHandle);
+		watch->inotifyHandle = -1;
+		return false;
+	}
+
+	SDL_Thread *thread = SDL_CreateThread(platformGameCodeWatchThreadProc,
+										  "game code watch", watch);
+	SDL_DetachThread(thread);
+	return true;
+}
+
+bool platformCopyFile(const char *source, const char *dest) {
+	int sourceHandle = open(source, O_RDONLY);
+	if (sourceHandle == -1) return false;
+
+	int destHandle =
+		open(dest, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	if (destHandle == -1) {
+		close(sourceHandle);
+		return false;
+	}
+
+	bool result = true;
+	char buffer[Kilobytes(64)];
+	for (;;) {
+		ssize_t bytesRead = read(sourceHandle, buffer, sizeof(buffer));
+		if (bytesRead == 0) break;
+		if (bytesRead == -1) {
+			result = false;
+			break;
+		}
+
+		ssize_t bytesToWrite = bytesRead;
+		char *nextByteLocation = buffer;
+		while (bytesToWrite) {
+			ssize_t bytesWritten =
+				write(destHandle, nextByteLocation, bytesToWrite);
+			if (bytesWritten == -1) {
+				result = false;
+				break;
+			}
+			bytesToWrite -= bytesWritten;
+			nextByteLocation += bytesWritten;
+		}
+		if (!result) break;
+	}
+
+	close(sourceHandle);
+	close(destHandle);
+	return result;
+}
+
 void platformUnloadGameCode(PlatformGameCode *platformGameCode) {
 	if (platformGameCode->loaded) {
+		// NOTE(bruno): queued entries point at functions inside the library
+		platformCompleteAllQueues();
+#if HANDMADE_INTERNAL
+		// NOTE(bruno): and so do the sites of everything the game recorded,
+		// fold it in while the names are still there
+		if (globalDebugTable) {
+			collateDebugEvents(globalDebugTable);
+			forgetDebugSitePointers(globalDebugTable);
+		}
+#endif
 		dlclose(platformGameCode->gameLib);
 		platformGameCode->loaded = false;
 		platformGameCode->gameLib = NULL;
 		platformGameCode->gameUpdateAndRender = NULL;
+		platformGameCode->gameGetSoundSamples = NULL;
 	}
 }
 
-bool platformLoadGameCode(PlatformGameCode *platformGameCode) {
-	platformGameCode->lastModTime = platformGetFileModTime(GAME_LIB_PATH);
+// NOTE(bruno): dlopen hands back the library it already has open when it
+// sees the same path again, so every load gets a path of its own. The copy is
+// unlinked right after dlopen, the mapping keeps it alive
+bool platformLoadGameCode(PlatformGameCode *platformGameCode,
+						  uint64 *copyCounter, uint64 *openCounter) {
+	char tempPath[512];
+	snprintf(tempPath, sizeof(tempPath), "%s.%d.%u.loaded", GAME_LIB_PATH,
+			 (int)getpid(), platformGameCode->loadCount++);
+
+	uint64 start = SDL_GetPerformanceCounter();
+	bool copied = platformCopyFile(GAME_LIB_PATH, tempPath);
+	*copyCounter = SDL_GetPerformanceCounter() - start;
+	if (!copied) {
+		unlink(tempPath);
+		return false;
+	}
 
-	platformGameCode->gameLib = dlopen(GAME_LIB_PATH, RTLD_LAZY);
-	if (!platformGameCode->gameLib) return false;
+	start = SDL_GetPerformanceCounter();
+	platformGameCode->gameLib = dlopen(tempPath, RTLD_NOW);
+	unlink(tempPath);
+	if (!platformGameCode->gameLib) {
+		printf("Failed to load game code: %s\n", dlerror());
+		*openCounter = SDL_GetPerformanceCounter() - start;
+		return false;
+	}
 
 	platformGameCode->gameUpdateAndRender = (GAME_UPDATE_AND_RENDER)dlsym(
 		platformGameCode->gameLib, "gameUpdateAndRender");
@@ -744,83 +1780,205 @@ bool platformLoadGameCode(PlatformGameCode *platformGameCode) {
 	if (!platformGameCode->gameUpdateAndRender) {
 		printf("Failed to load gameUpdateAndRender: %s\n", dlerror());
 		dlclose(platformGameCode->gameLib);
+		*openCounter = SDL_GetPerformanceCounter() - start;
+		return false;
+	}
+
+	platformGameCode->gameGetSoundSamples = (GAME_GET_SOUND_SAMPLES)dlsym(
+		platformGameCode->gameLib, "gameGetSoundSamples");
+
+	if (!platformGameCode->gameGetSoundSamples) {
+		printf("Failed to load gameGetSoundSamples: %s\n", dlerror());
+		dlclose(platformGameCode->gameLib);
+		*openCounter = SDL_GetPerformanceCounter() - start;
 		return false;
 	}
 
+	*openCounter = SDL_GetPerformanceCounter() - start;
 	platformGameCode->loaded = true;
 
 	return true;
 }
 
-int main(void) {
+bool platformReloadGameCode(PlatformGameCode *platformGameCode) {
+	// NOTE(bruno): keeps the audio thread out of the library while it gets
+	// swapped
+	platformLockAudio(&globalAudioOutput);
+
+	uint64 start = SDL_GetPerformanceCounter();
+	platformUnloadGameCode(platformGameCode);
+	uint64 closeCounter = SDL_GetPerformanceCounter() - start;
+
+	uint64 copyCounter = 0;
+	uint64 openCounter = 0;
+	bool loaded =
+		platformLoadGameCode(platformGameCode, &copyCounter, &openCounter);
+
+	platformUnlockAudio(&globalAudioOutput);
+
+	real64 msPerCount = 1000.0 / (real64)SDL_GetPerformanceFrequency();
+	printf("game code %s: dlclose %.2fms  copy %.2fms  dlopen+dlsym %.2fms\n",
+		   loaded ? "reloaded" : "reload failed",
+		   (real64)closeCounter * msPerCount, (real64)copyCounter * msPerCount,
+		   (real64)openCounter * msPerCount);
+
+	return loaded;
+}
+
+int main(int argc, char **argv) {
 	int initialWidth = 960;
 	int initialHeight = 540;
 
+	// NOTE(bruno): --replay plays a recording from snapshots/ once through
+	// as fast as frames can be made and quits, --headless runs without a
+	// window or a sound device. Together they are how ./bin/build pgo trains
+	// the release build
+	const char *replayFilename = 0;
+	bool isHeadless = false;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+			replayFilename = argv[++i];
+		} else if (strcmp(argv[i], "--headless") == 0) {
+			isHeadless = true;
+		} else {
+			printf("Usage: %s [--replay file.hmi] [--headless]\n", argv[0]);
+			return -1;
+		}
+	}
+	if (isHeadless) {
+		SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen");
+		SDL_SetHint(SDL_HINT_AUDIO_DRIVER, "dummy");
+	}
+
 	if (!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS | SDL_INIT_GAMEPAD |
 				  SDL_INIT_AUDIO))
 		return -1;
 
-	platformLoadControllers();
 	GameInput gameInputs[2];
 	gameInputs[0] = {};
 	gameInputs[1] = {};
 	GameInput *newInput = &gameInputs[0];
 	GameInput *oldInput = &gameInputs[1];
+	platformLoadControllers(newInput);
 
 	SDL_Window *window = SDL_CreateWindow("Handmade Hero", initialWidth,
 										  initialHeight, SDL_WINDOW_RESIZABLE);
 	SDL_Renderer *renderer = SDL_CreateRenderer(window, NULL);
 	if (!window || !renderer) // TODO(bruno): proper error handling
 		return -1;
-	if (!SDL_SetRenderVSync(renderer, 1)) {
+	if (!replayFilename && !SDL_SetRenderVSync(renderer, 1)) {
 		printf("Failed to set vsync on renderer: %s\n", SDL_GetError());
 	}
 
-	int refreshRate = 30;
-	real32 targetSecondsPerFrame =
-		1.0f / (real32)refreshRate; // TODO(bruno): change the game refresh rate
-									// based on the hardware capacity: if it's
-									// too slow, lower it to 30fps
+	// NOTE(bruno): we render at the display refresh rate, or a divisor of it
+	// when the governor decides we can't keep up, and simulate at a fixed
+	// rate, see platformAdvanceSimulationClock
+	int refreshRate = platformGetDisplayRefreshRate(window);
+	PlatformRateGovernor rateGovernor;
+	platformInitializeRateGovernor(&rateGovernor, refreshRate);
+	real32 targetSecondsPerFrame = 1.0f / (real32)refreshRate;
+	PlatformSimulationClock simulationClock = {};
+	simulationClock.secondsPerStep = 1.0f / (real32)GAME_SIMULATION_HZ;
 
 	GameMemory gameMemory = {};
 	PlatformState platformState = {};
+	PlatformFramePacer framePacer = {};
+	// NOTE(bruno): replays run unpaced, there is nothing to wait for
+	PlatformInputLatch inputLatch;
+	platformInitializeInputLatch(&inputLatch, !replayFilename,
+								 targetSecondsPerFrame);
 
 	if (!platformInitializeGameMemory(&gameMemory, &platformState)) {
 		return -1; // TODO(bruno): proper error handling
 	}
+	if (replayFilename &&
+		!platformStartReplay(&platformState, replayFilename)) {
+		return -1;
+	}
 
-	platformInitializeSound(&globalAudioOutput);
+#if HANDMADE_INTERNAL
+	globalTraceCapture.startupClock = __rdtsc();
+	globalTraceCapture.startupCounter = SDL_GetPerformanceCounter();
+
+	// NOTE(bruno): mostly per thread event buffers that are never touched,
+	// the pages only get committed for the threads that record
+	void *debugMemory = mmap(0, sizeof(DebugTable), PROT_READ | PROT_WRITE,
+							 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (debugMemory != MAP_FAILED) {
+		globalDebugTable = (DebugTable *)debugMemory;
+		initializeDebugTable(globalDebugTable);
+		gameMemory.debugTable = globalDebugTable;
+		DEBUG_NAME_THREAD("main");
+	}
+	platformInitializeOverlay(&globalOverlay, globalDebugTable);
+
+	const char *traceFilename = SDL_getenv(PLATFORM_TRACE_ENV_VAR);
+	if (traceFilename && strcmp(traceFilename, "1") == 0) {
+		platformToggleTrace(&globalTraceCapture, globalDebugTable);
+	} else if (traceFilename && traceFilename[0]) {
+		platformStartTrace(&globalTraceCapture, globalDebugTable,
+						   traceFilename);
+	}
+#endif
+
+	PlatformGameCode gameCode = {};
+
+	platformInitializeSound(&globalAudioOutput, &gameMemory, &gameCode);
+
+	platformInitializeWorkQueue(&globalBackgroundQueue, "background worker",
+								BACKGROUND_THREAD_COUNT);
+	platformInitializeWorkQueue(&globalHighPriorityQueue, "worker",
+								platformGetHighPriorityThreadCount());
+	platformInitializeAsyncIO(&globalAsyncIO);
 
 	globalRunning = true;
 
-	globalBackbuffer = {};
-	platformResizeBackbuffer(&globalBackbuffer, renderer, initialWidth,
-							 initialHeight);
+	int windowWidth = initialWidth;
+	int windowHeight = initialHeight;
+	SDL_GetWindowSizeInPixels(window, &windowWidth, &windowHeight);
+	if (!platformInitializeBackbuffer(&globalBackbuffer, BackbufferMode_Scaled,
+									  windowWidth, windowHeight)) {
+		return -1;
+	}
 
-	int64 lastFrameStart = SDL_GetPerformanceCounter();
+	PlatformGameCodeWatch gameCodeWatch = {};
+	if (!platformInitializeGameCodeWatch(&gameCodeWatch, GAME_LIB_PATH)) {
+		printf("Failed to watch %s, hot reload is off\n", GAME_LIB_PATH);
+	}
+	platformReloadGameCode(&gameCode);
 
-	PlatformGameCode gameCode = {};
-	platformLoadGameCode(&gameCode);
+#if HANDMADE_PLATFORMDEBUG
+	uint32 debugReportFrameCount = 0;
+#endif
 
 	while (globalRunning) {
-		time_t newModTime = platformGetFileModTime(GAME_LIB_PATH);
-		if (newModTime != gameCode.lastModTime) {
-			platformUnloadGameCode(&gameCode);
-			platformLoadGameCode(&gameCode);
+		if (atomicLoadUInt32(&gameCodeWatch.changed)) {
+			atomicStoreUInt32(&gameCodeWatch.changed, 0);
+			// NOTE(bruno): a library that doesn't load yet is most likely
+			// still being written, the next write raises the flag again
+			platformReloadGameCode(&gameCode);
 		}
 
 		int64 frameStart = SDL_GetPerformanceCounter();
+#if HANDMADE_INTERNAL
+		platformMarkOverlayFrame(&globalOverlay, FrameMark_Start);
+#endif
+		int64 latchCounter = platformWaitForInputLatch(
+			&inputLatch, &framePacer, frameStart, targetSecondsPerFrame);
+#if HANDMADE_INTERNAL
+		platformMarkOverlayFrame(&globalOverlay, FrameMark_LatchEnd);
+#endif
 
 #if HANDMADE_PLATFORMDEBUG
 		uint64 startCyclesCount = _rdtsc();
 #endif
 
-		platformProcessControllers(newInput);
 		GameInput *temp = oldInput;
 		oldInput = newInput;
 		newInput = temp;
-		newInput->deltaTime = targetSecondsPerFrame; // TODO(bruno): calculate
-													 // real delta time
+		platformCarryOverGamepads(oldInput, newInput);
+		platformAdvanceSimulationClock(&simulationClock, latchCounter,
+									   newInput);
 
 		GameControllerInput *oldKeyboard = &oldInput->controllers[0];
 		GameControllerInput *newKeyboard = &newInput->controllers[0];
@@ -835,51 +1993,79 @@ int main(void) {
 		for (size_t i = 0; i < arraylength(newInput->mouseButtons); i++) {
 			newInput->mouseButtons[i].endedDown =
 				oldInput->mouseButtons[i].endedDown;
+			newInput->mouseButtons[i].halfTransitionCount = 0;
+			newInput->mouseButtons[i].transitionSeconds = 0.0f;
 		}
 		newInput->mouseX = oldInput->mouseX;
 		newInput->mouseY = oldInput->mouseY;
 		newInput->mouseZ = oldInput->mouseZ;
 
-		globalRunning = platformProcessEvents(&globalBackbuffer, newKeyboard,
-											  newInput, &platformState);
+		globalRunning =
+			platformProcessEvents(&globalBackbuffer, newKeyboard, newInput,
+								  &platformState, &inputLatch);
 
 		GameBackbuffer gamebackbuffer = {};
 		gamebackbuffer.width = globalBackbuffer.width;
 		gamebackbuffer.height = globalBackbuffer.height;
 		gamebackbuffer.pitch = globalBackbuffer.pitch;
 		gamebackbuffer.memory = globalBackbuffer.memory;
-
-		// Only generate audio if we're actually going to use it
-		GameSoundBuffer gameSoundBuffer = {};
-		int16 samples[48000 * 2]; // TODO(bruno): 1 second max buffer.
-		if (platformShouldQueueAudioSamples()) {
-			// make this dynamic later
-			gameSoundBuffer.sampleCount =
-				platformGetSamplesToGenerate(frameStart, lastFrameStart);
-			gameSoundBuffer.sampleRate = globalAudioOutput.sampleRate;
-			gameSoundBuffer.samples = samples;
-		}
+		gamebackbuffer.format = BackbufferFormat_ARGB8888;
 
 		if (platformState.inputRecordingIndex) {
 			platformRecordInput(platformState, *newInput);
 		}
-		if (platformState.inputPlayingIndex) {
-			platformPlaybackInput(&platformState, newInput);
+		if (platformState.inputPlayingIndex &&
+			!platformPlaybackInput(&platformState, newInput)) {
+			break;
 		}
 
-		gameCode.gameUpdateAndRender(&gameMemory, &gamebackbuffer,
-									 &gameSoundBuffer, newInput);
-		platformOutputSound(&globalAudioOutput, &gameSoundBuffer);
+		if (gameCode.loaded) {
+			gameCode.gameUpdateAndRender(&gameMemory, &gamebackbuffer,
+										 newInput);
+		}
+#if HANDMADE_INTERNAL
+		platformMarkOverlayFrame(&globalOverlay, FrameMark_GameEnd);
+#endif
 
 #if HANDMADE_PLATFORMDEBUG
-		DEBUGPlatformDrawDebugAudio(&gameSoundBuffer);
+		DEBUGPlatformDrawDebugAudio();
+#endif
+#if HANDMADE_INTERNAL
+		platformDrawOverlay(&globalOverlay, &globalBackbuffer,
+							globalDebugTable);
+		platformMarkOverlayFrame(&globalOverlay, FrameMark_DrawEnd);
 #endif
 
-		platformUpdateWindow(&globalBackbuffer, window, renderer);
+		// NOTE(bruno): present blocks on the vblank with vsync on, which is
+		// waiting and not work, so it stays out of the governor's numbers.
+		// So does waiting for the latch
+		real32 workSeconds = platformGetSecondsElapsed(
+			latchCounter, SDL_GetPerformanceCounter());
 
-		platformDelayFrame(frameStart, targetSecondsPerFrame);
+		platformUpdateWindow(&globalBackbuffer, renderer);
+		platformRecordInputLatency(&inputLatch, workSeconds);
+#if HANDMADE_INTERNAL
+		platformMarkOverlayFrame(&globalOverlay, FrameMark_PresentEnd);
+#endif
 
-		lastFrameStart = frameStart;
+		if (!platformState.isReplaying) {
+			platformWaitForFrameEnd(&framePacer, frameStart,
+									targetSecondsPerFrame);
+		}
+#if HANDMADE_INTERNAL
+		platformMarkOverlayFrame(&globalOverlay, FrameMark_SleepEnd);
+		real32 budgetSeconds = targetSecondsPerFrame;
+#endif
+
+		targetSecondsPerFrame =
+			platformUpdateRateGovernor(&rateGovernor, workSeconds);
+
+#if HANDMADE_INTERNAL
+		if (globalDebugTable) endDebugFrame(globalDebugTable);
+		platformUpdateTrace(&globalTraceCapture);
+		platformEndOverlayFrame(&globalOverlay, globalDebugTable,
+								budgetSeconds);
+#endif
 
 #if HANDMADE_PLATFORMDEBUG
 		int64 frameEnd = SDL_GetPerformanceCounter();
@@ -896,12 +2082,34 @@ int main(void) {
 			(real64)queuedSamples / (real64)globalAudioOutput.sampleRate;
 		real64 msPerFrame =
 			((real64)frameDuration * 1000) / (real64)perfFrequency;
-		printf("ms/frame: %.02f  fps: %.02f  MegaCycles/frame: %lu  Audio "
-			   "queued: %.3fs\n",
-			   msPerFrame, fps, cyclesElapsed / (1000 * 1000), queuedSeconds);
+		PlatformAudioSync *sync = &globalAudioOutput.sync;
+		real64 latencyMs =
+			(real64)(PLATFORM_AUDIO_DEVICE_SAMPLE_FRAMES +
+					 sync->targetMarginSamples) *
+			1000.0 / (real64)globalAudioOutput.sampleRate;
+		// NOTE(bruno): printing is slow enough to show up in the frames it
+		// reports on, so only every so often
+		if (++debugReportFrameCount >= PLATFORM_DEBUG_REPORT_FRAMES) {
+			debugReportFrameCount = 0;
+			printf("ms/frame: %.02f  fps: %.02f  MegaCycles/frame: %lu  Audio "
+				   "queued: %.3fs  latency: %.1fms  margin: %d  drift: "
+				   "%.0fppm  glitches: %u\n",
+				   msPerFrame, fps, cyclesElapsed / (1000 * 1000),
+				   queuedSeconds, latencyMs, sync->targetMarginSamples,
+				   sync->driftPPM, sync->glitchCount);
+#if HANDMADE_INTERNAL
+			if (globalDebugTable) printLastDebugFrame(globalDebugTable, 3);
+#endif
+		}
 #endif
 	}
 
+#if HANDMADE_INTERNAL
+	// NOTE(bruno): a capture that is cut off never gets its closing bracket
+	platformStopTrace(&globalTraceCapture, globalDebugTable);
+	platformReapTraceWriter(&globalTraceCapture, true);
+#endif
+
 	// TODO(bruno): we are not freeing sdl renderer, sdl window and backbuffer
 	// here because honestly the OS will handle this for us after this return 0.
 	// but maybe we should revisit this?
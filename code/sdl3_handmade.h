@@ -1,14 +1,69 @@
 #ifndef SDL3_HANDMADE_H
 
 #include "handmade.h"
+#include "handmade_debug.h"
 #include <SDL3/SDL.h>
 
+// NOTE(bruno): native renders one pixel per window pixel, scaled renders at
+// around PLATFORM_BACKBUFFER_SCALED_WIDTH x HEIGHT and blows that up by a
+// whole number with nearest neighbor. F2 switches between them
+enum PlatformBackbufferMode {
+	BackbufferMode_Native,
+	BackbufferMode_Scaled,
+
+	BackbufferMode_Count,
+};
+
+#define PLATFORM_BACKBUFFER_MAX_WIDTH 7680
+#define PLATFORM_BACKBUFFER_MAX_HEIGHT 4320
+#define PLATFORM_BACKBUFFER_SCALED_WIDTH 960
+#define PLATFORM_BACKBUFFER_SCALED_HEIGHT 540
+
 struct PlatformBackbuffer {
 	int width;
 	int height;
 	int pitch;
 	void *memory;
+
+	PlatformBackbufferMode mode;
+	// NOTE(bruno): window pixels per backbuffer pixel, always 1 when native
+	int scale;
+	int windowWidth;
+	int windowHeight;
+
+	// NOTE(bruno): reserved once for the biggest backbuffer we allow, only
+	// the pages a size actually touches get committed
+	MemoryArena pool;
+
+	// NOTE(bruno): only ever grows, smaller backbuffers use the top left
 	SDL_Texture *texture;
+	int textureWidth;
+	int textureHeight;
+};
+
+struct PlatformGameCode;
+
+// NOTE(bruno): written by the audio thread on every callback. The main thread
+// only reads it for the debug overlay, so torn reads there are fine
+struct PlatformAudioSync {
+	uint64 lastCallbackCounter;
+	int lastRequestedSamples;
+	int lastMarginSamples;
+
+	// NOTE(bruno): device consumption measured against the performance
+	// counter, which is the clock the frames run on
+	uint64 windowStartCounter;
+	uint64 windowSampleCount;
+	real32 measuredSampleRate;
+	real32 driftPPM;
+
+	// NOTE(bruno): how late callbacks arrive compared to how long the device
+	// should have taken to play what it asked for last time. Decays slowly
+	real32 peakLatenessSamples;
+	int targetMarginSamples;
+
+	uint32 callbackCount;
+	uint32 glitchCount;
 };
 
 struct PlatformAudioOutput {
@@ -16,14 +71,309 @@ struct PlatformAudioOutput {
 	SDL_AudioStream *stream;
 	int sampleRate;
 	int numChannels;
+
+	// NOTE(bruno): used by the stream callback on the audio thread. Anything
+	// that changes what these point at must hold the stream lock
+	GameMemory *gameMemory;
+	PlatformGameCode *gameCode;
+
+	int16 *samples;
+	int maxSampleCount;
+
+	uint32 volatile lastCallbackSampleCount;
+
+	PlatformAudioSync sync;
+};
+
+// NOTE(bruno): sequence tells producers and consumers whose turn it is on
+// this slot, see platformTryAddWorkEntry
+struct PlatformWorkQueueEntry {
+	uint32 volatile sequence;
+	PlatformWorkQueueCallback callback;
+	void *data;
+};
+
+// NOTE(bruno): must be a power of two
+#define PLATFORM_WORK_QUEUE_SIZE 256
+
+// NOTE(bruno): bounded lock-free queue, any thread can add entries and any
+// thread can take them. Idle workers spin for a little while before they go
+// to sleep on the semaphore, so bursts of work don't pay for a wake up
+struct PlatformWorkQueue {
+	uint32 volatile completionGoal;
+	uint32 volatile completionCount;
+
+	alignas(64) uint32 volatile nextEntryToWrite;
+	alignas(64) uint32 volatile nextEntryToRead;
+
+	SDL_Semaphore *semaphore;
+	// NOTE(bruno): what its workers are called in the profiler
+	const char *name;
+
+	PlatformWorkQueueEntry entries[PLATFORM_WORK_QUEUE_SIZE];
+};
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define PLATFORM_HAS_IO_URING 1
+#endif
+#endif
+#ifndef PLATFORM_HAS_IO_URING
+#define PLATFORM_HAS_IO_URING 0
+#endif
+
+#define PLATFORM_IO_RING_ENTRIES 64
+
+#if PLATFORM_HAS_IO_URING
+// NOTE(bruno): pointers into the rings the kernel shares with us. Only the
+// completion thread touches the completion side, submissions take the mutex
+struct PlatformIOUring {
+	int ringHandle;
+
+	uint32 *sqHead;
+	uint32 *sqTail;
+	uint32 *sqRingMask;
+	uint32 *sqArray;
+	uint32 sqEntryCount;
+	struct io_uring_sqe *sqes;
+	uint32 unsubmittedCount;
+
+	uint32 *cqHead;
+	uint32 *cqTail;
+	uint32 *cqRingMask;
+	struct io_uring_cqe *cqes;
+
+	SDL_Mutex *submitMutex;
+};
+#endif
+
+struct PlatformAsyncIO {
+	bool volatile useRing;
+#if PLATFORM_HAS_IO_URING
+	PlatformIOUring ring;
+#endif
+
+	uint32 volatile submittedCount;
+	uint32 volatile completedCount;
+};
+
+// NOTE(bruno): picks how many display refreshes each frame gets, so frames
+// always land on a vblank even when we can't keep up with the display
+struct PlatformRateGovernor {
+	int refreshRate;
+	int divisor;
+
+	real32 averageWorkSeconds;
+	uint32 framesOverBudget;
+	uint32 framesUnderBudget;
+};
+
+struct PlatformSimulationClock {
+	real32 secondsPerStep;
+	real32 accumulatedSeconds;
+	int64 lastFrameStart;
+	uint32 droppedStepCount;
+};
+
+// NOTE(bruno): frame time error is |actual - target| per frame, bucketed in
+// FRAME_PACER_BUCKET_MICROSECONDS steps. The last bucket takes everything
+// past the end of the range
+#define FRAME_PACER_BUCKET_COUNT 64
+#define FRAME_PACER_BUCKET_MICROSECONDS 50
+
+struct PlatformFramePacer {
+	// NOTE(bruno): how much later than asked the sleep comes back, as a
+	// slowly decaying peak. We stop sleeping this much before the deadline
+	// and spin the rest
+	real64 sleepOvershootSeconds;
+
+	uint32 frameCount;
+	uint32 histogram[FRAME_PACER_BUCKET_COUNT];
+	real64 maxErrorSeconds;
+};
+
+// NOTE(bruno): the raw stick is kept because the dead zone needs both axes
+// and each event only brings one
+struct PlatformGamepad {
+	SDL_Gamepad *pad;
+	SDL_JoystickID id;
+	int16 stickX;
+	int16 stickY;
+};
+
+// NOTE(bruno): frames wait right after they start for as long as the work
+// they are about to do leaves free, and only then read the input. The frame
+// still lands on the same vblank, with input that much newer
+struct PlatformInputLatch {
+	bool isEnabled;
+
+	// NOTE(bruno): how long the work after the latch takes, as a slowly
+	// decaying peak
+	real64 peakWorkSeconds;
+	real64 delaySeconds;
+
+	// NOTE(bruno): SDL_GetTicksNS time, the clock event timestamps use. The
+	// oldest is the oldest button event the game saw this frame, 0 if none
+	uint64 latchTicks;
+	uint64 oldestEventTicks;
+
+	uint32 frameCount;
+	uint32 inputFrameCount;
+	real64 totalDelaySeconds;
+	real64 totalLatchSeconds;
+	real64 maxLatchSeconds;
+	real64 totalPresentSeconds;
+	real64 maxPresentSeconds;
 };
 
 struct PlatformGameCode {
 	void *gameLib;
 	GAME_UPDATE_AND_RENDER gameUpdateAndRender;
-	time_t lastModTime;
+	GAME_GET_SOUND_SAMPLES gameGetSoundSamples;
 	bool loaded;
+
+	// NOTE(bruno): every load dlopens its own copy of the library, so the
+	// build can overwrite the original whenever it wants
+	uint32 loadCount;
+};
+
+// NOTE(bruno): a watcher thread blocks on inotify and raises the flag when
+// the library gets written or moved into place. The main loop only ever
+// reads the flag
+struct PlatformGameCodeWatch {
+	int inotifyHandle;
+	char directory[256];
+	char filename[256];
+	uint32 volatile changed;
+};
+
+#if HANDMADE_INTERNAL
+// NOTE(bruno): a Chrome trace (chrome://tracing or ui.perfetto.dev) of
+// everything collation sees while a capture runs. Collation pushes records
+// into the ring and a writer thread of its own formats them and writes them
+// out, so the frame never waits on the disk
+#define PLATFORM_TRACE_BUFFER_SIZE Megabytes(1)
+#define PLATFORM_TRACE_ENV_VAR "HANDMADE_TRACE"
+
+struct PlatformTraceWriter {
+	DebugTraceRing ring;
+
+	DebugTable *table;
+	int fileHandle;
+	char filename[256];
+	SDL_Semaphore *semaphore;
+	uint32 volatile stopping;
+	uint32 volatile finished;
+
+	uint64 startClock;
+	real64 cyclesPerMicrosecond;
+	uint64 lastFrameEndClock;
+	// NOTE(bruno): one bit per thread slot that got its name written
+	uint32 namedThreads;
+	uint64 eventCount;
+	bool failed;
+
+	uint32 bufferUsed;
+	char buffer[PLATFORM_TRACE_BUFFER_SIZE];
+};
+
+struct PlatformTraceCapture {
+	// NOTE(bruno): the cycle counter and the performance counter read
+	// together at startup, the later pair tells us the cycle rate
+	uint64 startupClock;
+	int64 startupCounter;
+
+	PlatformTraceWriter *writer;
+	// NOTE(bruno): a stopped writer that is still finishing its file, it
+	// gets unmapped once it says it's done
+	PlatformTraceWriter *stoppingWriter;
+	uint32 captureCount;
+};
+
+// NOTE(bruno): the main loop marks where each part of a frame ends, the
+// overlay turns the marks into the phases it graphs
+enum PlatformFrameMark {
+	FrameMark_Start,
+	FrameMark_LatchEnd,
+	FrameMark_GameEnd,
+	FrameMark_DrawEnd,
+	FrameMark_PresentEnd,
+	FrameMark_SleepEnd,
+
+	FrameMark_Count,
+};
+
+enum PlatformFramePhase {
+	FramePhase_Sim,
+	FramePhase_Render,
+	FramePhase_Present,
+	FramePhase_Sleep,
+
+	FramePhase_Count,
+};
+
+struct PlatformOverlayFrame {
+	real32 totalMs;
+	real32 budgetMs;
+	real32 phaseMs[FramePhase_Count];
+};
+
+struct PlatformOverlayRect {
+	int minX;
+	int minY;
+	int maxX;
+	int maxY;
+	uint32 color;
+	// NOTE(bruno): darkens what is under it instead of filling it
+	bool isShade;
+};
+
+struct PlatformOverlayText {
+	int x;
+	int y;
+	uint32 color;
+	char text[64];
+};
+
+// NOTE(bruno): printable ASCII in a 5x7 font with descenders, one cell of
+// spacing to the right and below each glyph
+#define PLATFORM_OVERLAY_FIRST_GLYPH ' '
+#define PLATFORM_OVERLAY_GLYPH_COUNT 96
+#define PLATFORM_OVERLAY_GLYPH_WIDTH 6
+#define PLATFORM_OVERLAY_GLYPH_HEIGHT 9
+#define PLATFORM_OVERLAY_ATLAS_WIDTH                                           \
+	(PLATFORM_OVERLAY_GLYPH_COUNT * PLATFORM_OVERLAY_GLYPH_WIDTH)
+
+#define PLATFORM_OVERLAY_HISTORY 256
+#define PLATFORM_OVERLAY_TOP_BLOCKS 8
+#define PLATFORM_OVERLAY_MAX_RECTS 1280
+#define PLATFORM_OVERLAY_MAX_TEXTS 32
+
+// NOTE(bruno): timings go into the history every frame whether the overlay
+// shows or not, that is a handful of cycle counter reads. Drawing only
+// happens while it shows, into batches that get flushed in one go
+struct PlatformOverlay {
+	bool isVisible;
+	uint32 mainThreadIndex;
+
+	uint64 markClocks[FrameMark_Count];
+	int64 markCounters[FrameMark_Count];
+	real64 msPerCycle;
+
+	uint32 frameCount;
+	PlatformOverlayFrame frames[PLATFORM_OVERLAY_HISTORY];
+
+	uint32 rectCount;
+	PlatformOverlayRect rects[PLATFORM_OVERLAY_MAX_RECTS];
+	uint32 textCount;
+	PlatformOverlayText texts[PLATFORM_OVERLAY_MAX_TEXTS];
+
+	// NOTE(bruno): the font expanded into pixel masks the first time the
+	// overlay shows, a glyph row is then a handful of masked stores
+	bool isAtlasBuilt;
+	uint32 atlas[PLATFORM_OVERLAY_GLYPH_HEIGHT][PLATFORM_OVERLAY_ATLAS_WIDTH];
 };
+#endif
 
 struct PlatformState {
 	int inputRecordingIndex;
@@ -31,6 +381,9 @@ struct PlatformState {
 
 	int inputPlaybackHandle;
 	int inputRecordingHandle;
+	// NOTE(bruno): playing a recording back once through with --replay,
+	// the game quits when it runs out instead of looping
+	bool isReplaying;
 
 	void *gamePermanentStorage;
 	size_t permanentStorageSize;
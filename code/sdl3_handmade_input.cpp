@@ -0,0 +1,101 @@
+// NOTE(bruno): input waits in SDL's own queue until the main loop latches
+// it, see platformWaitForInputLatch. SDL stamps every event when it comes in,
+// so pumping late loses nothing, the timestamps still say when each press
+// happened and the order is SDL's
+
+#define INPUT_LATCH_SAFETY_SECONDS 0.002
+// NOTE(bruno): per frame, a spike is mostly forgotten after a few seconds
+#define INPUT_LATCH_PEAK_DECAY 0.99
+#define INPUT_LATCH_MAX_DELAY_FRACTION 0.75
+#define INPUT_LATENCY_REPORT_FRAMES 600
+
+void platformInitializeInputLatch(PlatformInputLatch *latch, bool isEnabled,
+								  real32 targetSecondsPerFrame) {
+	*latch = {};
+	latch->isEnabled = isEnabled;
+	// NOTE(bruno): no waiting until we know how long frames take
+	latch->peakWorkSeconds = targetSecondsPerFrame;
+}
+
+// NOTE(bruno): how long before the latch the event happened. Anything stamped
+// after the latch (it came in while we were draining) counts as at the latch
+real32 platformGetInputEventAge(PlatformInputLatch *latch, SDL_Event *event) {
+	uint64 timestamp = event->common.timestamp;
+	if (!timestamp || timestamp >= latch->latchTicks) return 0.0f;
+	return (real32)((real64)(latch->latchTicks - timestamp) / 1e9);
+}
+
+// NOTE(bruno): only presses and releases count towards the latency numbers,
+// a mouse that keeps moving would always be a frame old
+void platformNoteInputEvent(PlatformInputLatch *latch, SDL_Event *event) {
+	uint64 timestamp = event->common.timestamp;
+	if (!timestamp) return;
+	if (!latch->oldestEventTicks || timestamp < latch->oldestEventTicks) {
+		latch->oldestEventTicks = timestamp;
+	}
+}
+
+void platformReportInputLatency(PlatformInputLatch *latch) {
+	real64 frameCount = (real64)latch->frameCount;
+	real64 inputFrameCount =
+		latch->inputFrameCount ? (real64)latch->inputFrameCount : 1.0;
+	printf("input over %u frames  latch delay: %.2fms  event to latch: "
+		   "%.2fms (max %.2fms)  event to present: %.2fms (max %.2fms)  "
+		   "frames with input: %u\n",
+		   latch->frameCount, latch->totalDelaySeconds * 1000.0 / frameCount,
+		   latch->totalLatchSeconds * 1000.0 / inputFrameCount,
+		   latch->maxLatchSeconds * 1000.0,
+		   latch->totalPresentSeconds * 1000.0 / inputFrameCount,
+		   latch->maxPresentSeconds * 1000.0, latch->inputFrameCount);
+
+	latch->frameCount = 0;
+	latch->inputFrameCount = 0;
+	latch->totalDelaySeconds = 0.0;
+	latch->totalLatchSeconds = 0.0;
+	latch->maxLatchSeconds = 0.0;
+	latch->totalPresentSeconds = 0.0;
+	latch->maxPresentSeconds = 0.0;
+}
+
+// NOTE(bruno): right after the present returns. With vsync on that is about
+// when the frame gets scanned out, so event to present is as close to input
+// to photon as we can measure from in here
+void platformRecordInputLatency(PlatformInputLatch *latch,
+								real32 workSeconds) {
+	uint64 presentTicks = SDL_GetTicksNS();
+
+	latch->peakWorkSeconds *= INPUT_LATCH_PEAK_DECAY;
+	if (workSeconds > latch->peakWorkSeconds) {
+		latch->peakWorkSeconds = workSeconds;
+	}
+
+	latch->frameCount++;
+	latch->totalDelaySeconds += latch->delaySeconds;
+
+	uint64 oldest = latch->oldestEventTicks;
+	if (oldest) {
+		real64 latchSeconds =
+			oldest < latch->latchTicks
+				? (real64)(latch->latchTicks - oldest) / 1e9
+				: 0.0;
+		real64 presentSeconds =
+			oldest < presentTicks ? (real64)(presentTicks - oldest) / 1e9
+								  : 0.0;
+
+		latch->inputFrameCount++;
+		latch->totalLatchSeconds += latchSeconds;
+		latch->totalPresentSeconds += presentSeconds;
+		if (latchSeconds > latch->maxLatchSeconds) {
+			latch->maxLatchSeconds = latchSeconds;
+		}
+		if (presentSeconds > latch->maxPresentSeconds) {
+			latch->maxPresentSeconds = presentSeconds;
+		}
+	}
+
+#if HANDMADE_INTERNAL
+	if (latch->frameCount >= INPUT_LATENCY_REPORT_FRAMES) {
+		platformReportInputLatency(latch);
+	}
+#endif
+}
@@ -0,0 +1,312 @@
+// NOTE(bruno): asynchronous reads for the game. With io_uring the kernel
+// reads straight into the caller's memory and a completion thread marks the
+// reads as done. Without it (old headers, old kernel, or a kernel that says
+// no) every read becomes an entry on the background queue instead.
+
+#if PLATFORM_HAS_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+
+// NOTE(bruno): no liburing, just the three syscalls and the shared rings
+
+inline int platformIOUringSetup(uint32 entries,
+								struct io_uring_params *params) {
+	return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+inline int platformIOUringEnter(int ringHandle, uint32 toSubmit,
+								uint32 minComplete, uint32 flags) {
+	return (int)syscall(__NR_io_uring_enter, ringHandle, toSubmit, minComplete,
+						flags, NULL, 0);
+}
+#endif
+
+// NOTE(bruno): the kernel won't do more than this in a single read, bigger
+// reads get split and resubmitted as the parts complete
+#define PLATFORM_MAX_READ_PART Gigabytes(1)
+
+void platformFinishFileRead(PlatformAsyncIO *asyncIO, PlatformFileRead *read,
+							PlatformFileReadState state) {
+	atomicStoreUInt32(&read->state, state);
+	atomicAddUInt32(&asyncIO->completedCount, 1);
+}
+
+void platformFileReadWork(PlatformWorkQueue *queue, void *data) {
+	PlatformFileRead *read = (PlatformFileRead *)data;
+	uint64 remaining = read->size - read->bytesRead;
+	bool ok = platformReadDataFromFile(
+		read->file, read->offset + read->bytesRead, remaining,
+		(uint8 *)read->dest + read->bytesRead);
+	if (ok) read->bytesRead = read->size;
+
+	platformFinishFileRead(
+		&globalAsyncIO, read,
+		ok ? PlatformFileRead_Done : PlatformFileRead_Failed);
+}
+
+void platformSubmitFileReadToQueue(PlatformFileRead *read) {
+	platformAddWorkEntry(&globalBackgroundQueue, platformFileReadWork, read);
+}
+
+#if PLATFORM_HAS_IO_URING
+// NOTE(bruno): how often a kernel that is short on memory or has a full
+// completion ring gets asked again, with a millisecond in between, before
+// we give up on it. Bounded because the completion thread submits too, and
+// while it waits nobody empties the completion ring
+#define PLATFORM_IO_RING_BUSY_TRIES 8
+
+// NOTE(bruno): hands every entry in the ring over to the kernel. Interrupted
+// and short submissions go again right away. False when the kernel refused
+// them, call with the submit mutex held
+bool platformFlushIOUringSubmissions(PlatformIOUring *ring) {
+	uint32 busyTryCount = 0;
+	while (ring->unsubmittedCount) {
+		int submitted = platformIOUringEnter(ring->ringHandle,
+											 ring->unsubmittedCount, 0, 0);
+		if (submitted > 0) {
+			ring->unsubmittedCount -= (uint32)submitted;
+			continue;
+		}
+		if (submitted < 0 && errno == EINTR) continue;
+
+		bool isBusy = submitted == 0 || errno == EAGAIN || errno == EBUSY;
+		if (!isBusy || busyTryCount++ >= PLATFORM_IO_RING_BUSY_TRIES) {
+			return false;
+		}
+		SDL_Delay(1);
+	}
+	return true;
+}
+
+// NOTE(bruno): entries the kernel hasn't consumed yet still belong to us, only
+// the submitting side moves the tail and there is no kernel polling thread.
+// Rewinds the tail over them and returns their reads, call with the submit mutex held
+uint32 platformTakeBackIOUringSubmissions(PlatformIOUring *ring,
+										  PlatformFileRead **reads) {
+	uint32 tail = *ring->sqTail;
+	uint32 head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+
+	uint32 count = 0;
+	for (uint32 i = head; i != tail; i++) {
+		struct io_uring_sqe *sqe =
+			&ring->sqes[ring->sqArray[i & *ring->sqRingMask]];
+		reads[count++] = (PlatformFileRead *)sqe->user_data;
+	}
+
+	__atomic_store_n(ring->sqTail, head, __ATOMIC_RELEASE);
+	ring->unsubmittedCount = 0;
+	return count;
+}
+
+// NOTE(bruno): returns false when the read didn't make it to the kernel,
+// either because the submission ring is full or because the kernel refused
+// it, and the caller puts it on the queue. Earlier reads the kernel refused
+// along with it go on the queue from here, so every counted read finishes
+bool platformSubmitFileReadToRing(PlatformIOUring *ring,
+								  PlatformFileRead *read) {
+	SDL_LockMutex(ring->submitMutex);
+
+	uint32 tail = *ring->sqTail;
+	uint32 head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+	if (tail - head == ring->sqEntryCount) {
+		SDL_UnlockMutex(ring->submitMutex);
+		return false;
+	}
+
+	uint64 remaining = read->size - read->bytesRead;
+	if (remaining > PLATFORM_MAX_READ_PART) remaining = PLATFORM_MAX_READ_PART;
+
+	uint32 index = tail & *ring->sqRingMask;
+	struct io_uring_sqe *sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = (int)read->file->platformHandle;
+	sqe->addr = (uint64)((uint8 *)read->dest + read->bytesRead);
+	sqe->len = (uint32)remaining;
+	sqe->off = read->offset + read->bytesRead;
+	sqe->user_data = (uint64)read;
+	ring->sqArray[index] = index;
+
+	__atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+	ring->unsubmittedCount++;
+
+	PlatformFileRead *refused[PLATFORM_IO_RING_ENTRIES];
+	uint32 refusedCount = 0;
+	if (!platformFlushIOUringSubmissions(ring)) {
+		refusedCount = platformTakeBackIOUringSubmissions(ring, refused);
+	}
+
+	SDL_UnlockMutex(ring->submitMutex);
+
+	bool wasTaken = true;
+	for (uint32 i = 0; i < refusedCount; i++) {
+		if (refused[i] == read) {
+			wasTaken = false;
+		} else {
+			platformSubmitFileReadToQueue(refused[i]);
+		}
+	}
+	return wasTaken;
+}
+
+void platformHandleFileReadCompletion(PlatformAsyncIO *asyncIO,
+									  PlatformFileRead *read, int32 result) {
+	if (result == -EINVAL || result == -EOPNOTSUPP) {
+		// NOTE(bruno): kernel without IORING_OP_READ, or a file type io_uring
+		// can't read. Stop using the ring and finish this one on the queue
+		asyncIO->useRing = false;
+		platformSubmitFileReadToQueue(read);
+	} else if (result == -EINTR || result == -EAGAIN) {
+		if (!platformSubmitFileReadToRing(&asyncIO->ring, read)) {
+			platformSubmitFileReadToQueue(read);
+		}
+	} else if (result <= 0) {
+		// NOTE(bruno): a real error, or the file ended before size
+		platformFinishFileRead(asyncIO, read, PlatformFileRead_Failed);
+	} else {
+		read->bytesRead += (uint64)result;
+		if (read->bytesRead >= read->size) {
+			platformFinishFileRead(asyncIO, read, PlatformFileRead_Done);
+		} else if (!platformSubmitFileReadToRing(&asyncIO->ring, read)) {
+			platformSubmitFileReadToQueue(read);
+		}
+	}
+}
+
+int platformIOCompletionThreadProc(void *data) {
+	PlatformAsyncIO *asyncIO = (PlatformAsyncIO *)data;
+	PlatformIOUring *ring = &asyncIO->ring;
+	DEBUG_NAME_THREAD("io completion");
+
+	for (;;) {
+		int entered = platformIOUringEnter(ring->ringHandle, 0, 1,
+										   IORING_ENTER_GETEVENTS);
+		if (entered < 0 && errno != EINTR) break;
+
+		uint32 head = *ring->cqHead;
+		uint32 tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+		while (head != tail) {
+			struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cqRingMask];
+			PlatformFileRead *read = (PlatformFileRead *)cqe->user_data;
+			int32 result = cqe->res;
+			head++;
+			// NOTE(bruno): give the slot back before handling it, handling
+			// can submit again
+			__atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+
+			platformHandleFileReadCompletion(asyncIO, read, result);
+		}
+	}
+
+	return 0;
+}
+
+bool platformInitializeIOUring(PlatformIOUring *ring, uint32 entryCount) {
+	struct io_uring_params params = {};
+	ring->ringHandle = platformIOUringSetup(entryCount, &params);
+	if (ring->ringHandle < 0) return false;
+
+	size_t sqRingSize =
+		params.sq_off.array + params.sq_entries * sizeof(uint32);
+	size_t cqRingSize =
+		params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (singleMap) {
+		if (cqRingSize > sqRingSize) sqRingSize = cqRingSize;
+		cqRingSize = sqRingSize;
+	}
+
+	uint8 *sqRing =
+		(uint8 *)mmap(0, sqRingSize, PROT_READ | PROT_WRITE,
+					  MAP_SHARED | MAP_POPULATE, ring->ringHandle,
+					  IORING_OFF_SQ_RING);
+	if (sqRing == MAP_FAILED) {
+		close(ring->ringHandle);
+		return false;
+	}
+
+	uint8 *cqRing = sqRing;
+	if (!singleMap) {
+		cqRing = (uint8 *)mmap(0, cqRingSize, PROT_READ | PROT_WRITE,
+							   MAP_SHARED | MAP_POPULATE, ring->ringHandle,
+							   IORING_OFF_CQ_RING);
+		if (cqRing == MAP_FAILED) {
+			munmap(sqRing, sqRingSize);
+			close(ring->ringHandle);
+			return false;
+		}
+	}
+
+	ring->sqes = (struct io_uring_sqe *)mmap(
+		0, params.sq_entries * sizeof(struct io_uring_sqe),
+		PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ringHandle,
+		IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		if (!singleMap) munmap(cqRing, cqRingSize);
+		munmap(sqRing, sqRingSize);
+		close(ring->ringHandle);
+		return false;
+	}
+
+	ring->sqHead = (uint32 *)(sqRing + params.sq_off.head);
+	ring->sqTail = (uint32 *)(sqRing + params.sq_off.tail);
+	ring->sqRingMask = (uint32 *)(sqRing + params.sq_off.ring_mask);
+	ring->sqArray = (uint32 *)(sqRing + params.sq_off.array);
+	ring->sqEntryCount = params.sq_entries;
+
+	ring->cqHead = (uint32 *)(cqRing + params.cq_off.head);
+	ring->cqTail = (uint32 *)(cqRing + params.cq_off.tail);
+	ring->cqRingMask = (uint32 *)(cqRing + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(cqRing + params.cq_off.cqes);
+
+	ring->submitMutex = SDL_CreateMutex();
+	return true;
+}
+#endif
+
+void platformSubmitFileRead(PlatformFileRead *read) {
+	PlatformAsyncIO *asyncIO = &globalAsyncIO;
+
+	read->bytesRead = 0;
+	read->state = PlatformFileRead_Pending;
+	if (!read->file->isValid || read->size == 0) {
+		read->state = read->file->isValid ? PlatformFileRead_Done
+										  : PlatformFileRead_Failed;
+		return;
+	}
+
+	atomicAddUInt32(&asyncIO->submittedCount, 1);
+#if PLATFORM_HAS_IO_URING
+	if (asyncIO->useRing &&
+		platformSubmitFileReadToRing(&asyncIO->ring, read)) {
+		return;
+	}
+#endif
+	platformSubmitFileReadToQueue(read);
+}
+
+// NOTE(bruno): reads write into game memory, same as queued work does
+void platformCompleteAllFileReads(PlatformAsyncIO *asyncIO) {
+	while (atomicLoadUInt32(&asyncIO->completedCount) !=
+		   atomicLoadUInt32(&asyncIO->submittedCount)) {
+		if (!platformDoNextWorkQueueEntry(&globalBackgroundQueue)) {
+			_mm_pause();
+		}
+	}
+}
+
+void platformInitializeAsyncIO(PlatformAsyncIO *asyncIO) {
+	asyncIO->useRing = false;
+#if PLATFORM_HAS_IO_URING
+	if (platformInitializeIOUring(&asyncIO->ring, PLATFORM_IO_RING_ENTRIES)) {
+		asyncIO->useRing = true;
+		SDL_Thread *thread = SDL_CreateThread(platformIOCompletionThreadProc,
+											  "io completion", asyncIO);
+		SDL_DetachThread(thread);
+	}
+#endif
+	if (!asyncIO->useRing) {
+		printf("io_uring not available, file reads go through the "
+			   "background queue\n");
+	}
+}
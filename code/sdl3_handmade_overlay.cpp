@@ -0,0 +1,334 @@
+// NOTE(bruno): F1 shows the overlay: a rolling graph of the last frames with
+// the time each one spent simulating, rendering, presenting and sleeping
+// stacked on top of each other and a red line at the budget, and below it the
+// blocks with the most self time in the last frame. Render is the game's
+// "render" block plus drawing the debug views, sim is the rest of the game
+// and input.
+
+// NOTE(bruno): the classic 5x7 font, five columns per glyph with the top row
+// in the lowest bit. The eighth row is only there for descenders
+global_variable uint8 globalOverlayFont[PLATFORM_OVERLAY_GLYPH_COUNT][5] = {
+	{0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5F, 0x00, 0x00},
+	{0x00, 0x07, 0x00, 0x07, 0x00}, {0x14, 0x7F, 0x14, 0x7F, 0x14},
+	{0x24, 0x2A, 0x7F, 0x2A, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62},
+	{0x36, 0x49, 0x56, 0x20, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00},
+	{0x00, 0x1C, 0x22, 0x41, 0x00}, {0x00, 0x41, 0x22, 0x1C, 0x00},
+	{0x2A, 0x1C, 0x7F, 0x1C, 0x2A}, {0x08, 0x08, 0x3E, 0x08, 0x08},
+	{0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08},
+	{0x00, 0x60, 0x60, 0x00, 0x00}, {0x20, 0x10, 0x08, 0x04, 0x02},
+	{0x3E, 0x51, 0x49, 0x45, 0x3E}, {0x00, 0x42, 0x7F, 0x40, 0x00},
+	{0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4B, 0x31},
+	{0x18, 0x14, 0x12, 0x7F, 0x10}, {0x27, 0x45, 0x45, 0x45, 0x39},
+	{0x3C, 0x4A, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03},
+	{0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1E},
+	{0x00, 0x36, 0x36, 0x00, 0x00}, {0x00, 0x56, 0x36, 0x00, 0x00},
+	{0x08, 0x14, 0x22, 0x41, 0x00}, {0x14, 0x14, 0x14, 0x14, 0x14},
+	{0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x51, 0x09, 0x06},
+	{0x32, 0x49, 0x79, 0x41, 0x3E}, {0x7E, 0x11, 0x11, 0x11, 0x7E},
+	{0x7F, 0x49, 0x49, 0x49, 0x36}, {0x3E, 0x41, 0x41, 0x41, 0x22},
+	{0x7F, 0x41, 0x41, 0x22, 0x1C}, {0x7F, 0x49, 0x49, 0x49, 0x41},
+	{0x7F, 0x09, 0x09, 0x09, 0x01}, {0x3E, 0x41, 0x49, 0x49, 0x7A},
+	{0x7F, 0x08, 0x08, 0x08, 0x7F}, {0x00, 0x41, 0x7F, 0x41, 0x00},
+	{0x20, 0x40, 0x41, 0x3F, 0x01}, {0x7F, 0x08, 0x14, 0x22, 0x41},
+	{0x7F, 0x40, 0x40, 0x40, 0x40}, {0x7F, 0x02, 0x0C, 0x02, 0x7F},
+	{0x7F, 0x04, 0x08, 0x10, 0x7F}, {0x3E, 0x41, 0x41, 0x41, 0x3E},
+	{0x7F, 0x09, 0x09, 0x09, 0x06}, {0x3E, 0x41, 0x51, 0x21, 0x5E},
+	{0x7F, 0x09, 0x19, 0x29, 0x46}, {0x46, 0x49, 0x49, 0x49, 0x31},
+	{0x01, 0x01, 0x7F, 0x01, 0x01}, {0x3F, 0x40, 0x40, 0x40, 0x3F},
+	{0x1F, 0x20, 0x40, 0x20, 0x1F}, {0x3F, 0x40, 0x38, 0x40, 0x3F},
+	{0x63, 0x14, 0x08, 0x14, 0x63}, {0x07, 0x08, 0x70, 0x08, 0x07},
+	{0x61, 0x51, 0x49, 0x45, 0x43}, {0x00, 0x7F, 0x41, 0x41, 0x00},
+	{0x02, 0x04, 0x08, 0x10, 0x20}, {0x00, 0x41, 0x41, 0x7F, 0x00},
+	{0x04, 0x02, 0x01, 0x02, 0x04}, {0x40, 0x40, 0x40, 0x40, 0x40},
+	{0x00, 0x01, 0x02, 0x04, 0x00}, {0x20, 0x54, 0x54, 0x54, 0x78},
+	{0x7F, 0x48, 0x44, 0x44, 0x38}, {0x38, 0x44, 0x44, 0x44, 0x20},
+	{0x38, 0x44, 0x44, 0x48, 0x7F}, {0x38, 0x54, 0x54, 0x54, 0x18},
+	{0x08, 0x7E, 0x09, 0x01, 0x02}, {0x18, 0xA4, 0xA4, 0xA4, 0x7C},
+	{0x7F, 0x08, 0x04, 0x04, 0x78}, {0x00, 0x44, 0x7D, 0x40, 0x00},
+	{0x40, 0x80, 0x84, 0x7D, 0x00}, {0x7F, 0x10, 0x28, 0x44, 0x00},
+	{0x00, 0x41, 0x7F, 0x40, 0x00}, {0x7C, 0x04, 0x18, 0x04, 0x78},
+	{0x7C, 0x08, 0x04, 0x04, 0x78}, {0x38, 0x44, 0x44, 0x44, 0x38},
+	{0xFC, 0x24, 0x24, 0x24, 0x18}, {0x18, 0x24, 0x24, 0x18, 0xFC},
+	{0x7C, 0x08, 0x04, 0x04, 0x08}, {0x48, 0x54, 0x54, 0x54, 0x20},
+	{0x04, 0x3F, 0x44, 0x40, 0x20}, {0x3C, 0x40, 0x40, 0x20, 0x7C},
+	{0x1C, 0x20, 0x40, 0x20, 0x1C}, {0x3C, 0x40, 0x30, 0x40, 0x3C},
+	{0x44, 0x28, 0x10, 0x28, 0x44}, {0x1C, 0xA0, 0xA0, 0xA0, 0x7C},
+	{0x44, 0x64, 0x54, 0x4C, 0x44}, {0x00, 0x08, 0x36, 0x41, 0x00},
+	{0x00, 0x00, 0x7F, 0x00, 0x00}, {0x00, 0x41, 0x36, 0x08, 0x00},
+	{0x08, 0x04, 0x08, 0x10, 0x08}, {0x00, 0x00, 0x00, 0x00, 0x00},
+};
+
+global_variable uint32 globalOverlayPhaseColors[FramePhase_Count] = {
+	0xFF40C040, // sim
+	0xFF4080FF, // render
+	0xFFE0C040, // present
+	0xFF505050, // sleep
+};
+
+global_variable const char *globalOverlayPhaseNames[FramePhase_Count] = {
+	"sim",
+	"render",
+	"present",
+	"sleep",
+};
+
+global_variable PlatformOverlay globalOverlay;
+
+void platformInitializeOverlay(PlatformOverlay *overlay, DebugTable *table) {
+	DebugThreadEvents *thread = table ? getDebugThreadEvents(table) : 0;
+	overlay->mainThreadIndex = thread ? (uint32)(thread - table->threads) : 0;
+}
+
+inline void platformMarkOverlayFrame(PlatformOverlay *overlay,
+									 PlatformFrameMark mark) {
+	overlay->markClocks[mark] = __rdtsc();
+	overlay->markCounters[mark] = SDL_GetPerformanceCounter();
+}
+
+// NOTE(bruno): after the frame got collated, the render block of this frame
+// is in the last debug frame by then
+void platformEndOverlayFrame(PlatformOverlay *overlay, DebugTable *table,
+							 real32 budgetSeconds) {
+	uint64 *clocks = overlay->markClocks;
+	int64 *counters = overlay->markCounters;
+
+	uint64 frameCycles =
+		clocks[FrameMark_SleepEnd] - clocks[FrameMark_Start];
+	real64 frameMs = (real64)(counters[FrameMark_SleepEnd] -
+							  counters[FrameMark_Start]) *
+					 1000.0 / (real64)SDL_GetPerformanceFrequency();
+	if (frameCycles) overlay->msPerCycle = frameMs / (real64)frameCycles;
+
+	uint64 renderCycles = 0;
+	DebugFrame *debugFrame = table ? getLastDebugFrame(table) : 0;
+	if (debugFrame) {
+		uint32 root = debugFrame->threadRoots[overlay->mainThreadIndex];
+		uint32 game =
+			findDebugChildNode(table, debugFrame, root, "gameUpdateAndRender");
+		uint32 render = findDebugChildNode(table, debugFrame, game, "render");
+		if (render) renderCycles = debugFrame->nodes[render].cycles;
+	}
+
+	uint64 gameCycles =
+		clocks[FrameMark_GameEnd] - clocks[FrameMark_LatchEnd];
+	if (renderCycles > gameCycles) renderCycles = gameCycles;
+
+	uint64 phaseCycles[FramePhase_Count];
+	phaseCycles[FramePhase_Sim] = gameCycles - renderCycles;
+	phaseCycles[FramePhase_Render] =
+		renderCycles + (clocks[FrameMark_DrawEnd] - clocks[FrameMark_GameEnd]);
+	phaseCycles[FramePhase_Present] =
+		clocks[FrameMark_PresentEnd] - clocks[FrameMark_DrawEnd];
+	// NOTE(bruno): waiting for the input latch is idle time too
+	phaseCycles[FramePhase_Sleep] =
+		(clocks[FrameMark_SleepEnd] - clocks[FrameMark_PresentEnd]) +
+		(clocks[FrameMark_LatchEnd] - clocks[FrameMark_Start]);
+
+	PlatformOverlayFrame *frame =
+		&overlay->frames[overlay->frameCount++ % PLATFORM_OVERLAY_HISTORY];
+	frame->totalMs = (real32)frameMs;
+	frame->budgetMs = budgetSeconds * 1000.0f;
+	for (uint32 phase = 0; phase < FramePhase_Count; phase++) {
+		frame->phaseMs[phase] =
+			(real32)((real64)phaseCycles[phase] * overlay->msPerCycle);
+	}
+}
+
+void platformBuildOverlayAtlas(PlatformOverlay *overlay) {
+	for (uint32 glyph = 0; glyph < PLATFORM_OVERLAY_GLYPH_COUNT; glyph++) {
+		for (uint32 y = 0; y < PLATFORM_OVERLAY_GLYPH_HEIGHT; y++) {
+			for (uint32 x = 0; x < PLATFORM_OVERLAY_GLYPH_WIDTH; x++) {
+				bool isSet =
+					x < 5 && y < 8 && (globalOverlayFont[glyph][x] >> y) & 1;
+				overlay->atlas[y][glyph * PLATFORM_OVERLAY_GLYPH_WIDTH + x] =
+					isSet ? 0xFFFFFFFF : 0;
+			}
+		}
+	}
+	overlay->isAtlasBuilt = true;
+}
+
+inline void platformPushOverlayRect(PlatformOverlay *overlay, int minX,
+									int minY, int maxX, int maxY,
+									uint32 color, bool isShade = false) {
+	if (overlay->rectCount == PLATFORM_OVERLAY_MAX_RECTS) return;
+
+	PlatformOverlayRect *rect = &overlay->rects[overlay->rectCount++];
+	rect->minX = minX;
+	rect->minY = minY;
+	rect->maxX = maxX;
+	rect->maxY = maxY;
+	rect->color = color;
+	rect->isShade = isShade;
+}
+
+void platformPushOverlayText(PlatformOverlay *overlay, int x, int y,
+							 uint32 color, const char *format, ...) {
+	if (overlay->textCount == PLATFORM_OVERLAY_MAX_TEXTS) return;
+
+	PlatformOverlayText *text = &overlay->texts[overlay->textCount++];
+	text->x = x;
+	text->y = y;
+	text->color = color;
+
+	va_list args;
+	va_start(args, format);
+	vsnprintf(text->text, sizeof(text->text), format, args);
+	va_end(args);
+}
+
+void platformDrawOverlayRect(PlatformBackbuffer *buffer,
+							 PlatformOverlayRect *rect) {
+	int minX = rect->minX < 0 ? 0 : rect->minX;
+	int minY = rect->minY < 0 ? 0 : rect->minY;
+	int maxX = rect->maxX > buffer->width ? buffer->width : rect->maxX;
+	int maxY = rect->maxY > buffer->height ? buffer->height : rect->maxY;
+
+	uint8 *row = (uint8 *)buffer->memory + minY * buffer->pitch;
+	for (int y = minY; y < maxY; y++) {
+		uint32 *pixel = (uint32 *)row;
+		if (rect->isShade) {
+			for (int x = minX; x < maxX; x++) {
+				pixel[x] = ((pixel[x] >> 1) & 0x007F7F7F) | 0xFF000000;
+			}
+		} else {
+			for (int x = minX; x < maxX; x++) {
+				pixel[x] = rect->color;
+			}
+		}
+		row += buffer->pitch;
+	}
+}
+
+void platformDrawOverlayText(PlatformOverlay *overlay,
+							 PlatformBackbuffer *buffer,
+							 PlatformOverlayText *text) {
+	int glyphX = text->x;
+	for (const char *at = text->text; *at; at++) {
+		uint32 glyph = (uint32)(uint8)*at - PLATFORM_OVERLAY_FIRST_GLYPH;
+		if (glyph >= PLATFORM_OVERLAY_GLYPH_COUNT) glyph = '?' - ' ';
+
+		int minX = glyphX < 0 ? 0 : glyphX;
+		int maxX = glyphX + PLATFORM_OVERLAY_GLYPH_WIDTH;
+		if (maxX > buffer->width) maxX = buffer->width;
+
+		for (int y = 0; y < PLATFORM_OVERLAY_GLYPH_HEIGHT; y++) {
+			int bufferY = text->y + y;
+			if (bufferY < 0 || bufferY >= buffer->height) continue;
+
+			uint32 *pixel = (uint32 *)((uint8 *)buffer->memory +
+									   bufferY * buffer->pitch);
+			uint32 *mask =
+				&overlay->atlas[y][glyph * PLATFORM_OVERLAY_GLYPH_WIDTH];
+			for (int x = minX; x < maxX; x++) {
+				uint32 glyphMask = mask[x - glyphX];
+				pixel[x] = (text->color & glyphMask) | (pixel[x] & ~glyphMask);
+			}
+		}
+		glyphX += PLATFORM_OVERLAY_GLYPH_WIDTH;
+	}
+}
+
+void platformFlushOverlay(PlatformOverlay *overlay,
+						  PlatformBackbuffer *buffer) {
+	for (uint32 i = 0; i < overlay->rectCount; i++) {
+		platformDrawOverlayRect(buffer, &overlay->rects[i]);
+	}
+	for (uint32 i = 0; i < overlay->textCount; i++) {
+		platformDrawOverlayText(overlay, buffer, &overlay->texts[i]);
+	}
+	overlay->rectCount = 0;
+	overlay->textCount = 0;
+}
+
+void platformDrawOverlay(PlatformOverlay *overlay, PlatformBackbuffer *buffer,
+						 DebugTable *table) {
+	if (!overlay->isVisible || !overlay->frameCount) return;
+	TIMED_FUNCTION();
+
+	if (!overlay->isAtlasBuilt) platformBuildOverlayAtlas(overlay);
+
+	int lineHeight = PLATFORM_OVERLAY_GLYPH_HEIGHT + 2;
+	int columnWidth = 2;
+	int graphWidth = PLATFORM_OVERLAY_HISTORY * columnWidth;
+	int graphHeight = 96;
+	int left = 8;
+	int top = 56;
+	int graphLeft = left + 6;
+	int graphTop = top + 6 + lineHeight;
+	int legendTop = graphTop + graphHeight + 6;
+	int blocksTop = legendTop + lineHeight + 4;
+	int bottom = blocksTop + PLATFORM_OVERLAY_TOP_BLOCKS * lineHeight + 4;
+
+	platformPushOverlayRect(overlay, left, top, graphLeft + graphWidth + 6,
+							bottom, 0, true);
+
+	PlatformOverlayFrame *latest =
+		&overlay->frames[(overlay->frameCount - 1) % PLATFORM_OVERLAY_HISTORY];
+	// NOTE(bruno): twice the budget fits in the graph, anything over that
+	// gets cut off at the top
+	real32 graphMs = 2.0f * latest->budgetMs;
+	if (graphMs < 1.0f) graphMs = 1.0f;
+	real32 pixelsPerMs = (real32)graphHeight / graphMs;
+
+	uint32 frameCount = overlay->frameCount < PLATFORM_OVERLAY_HISTORY
+							? overlay->frameCount
+							: PLATFORM_OVERLAY_HISTORY;
+	real32 worstMs = 0.0f;
+	for (uint32 i = 0; i < frameCount; i++) {
+		uint32 frameIndex = overlay->frameCount - frameCount + i;
+		PlatformOverlayFrame *frame =
+			&overlay->frames[frameIndex % PLATFORM_OVERLAY_HISTORY];
+		if (frame->totalMs > worstMs) worstMs = frame->totalMs;
+
+		int x = graphLeft + (PLATFORM_OVERLAY_HISTORY - frameCount + i) *
+								columnWidth;
+		int y = graphTop + graphHeight;
+		for (uint32 phase = 0; phase < FramePhase_Count; phase++) {
+			int height = (int)(frame->phaseMs[phase] * pixelsPerMs + 0.5f);
+			if (height > y - graphTop) height = y - graphTop;
+			if (height <= 0) continue;
+
+			platformPushOverlayRect(overlay, x, y - height, x + columnWidth,
+									y, globalOverlayPhaseColors[phase]);
+			y -= height;
+		}
+	}
+
+	int budgetY =
+		graphTop + graphHeight - (int)(latest->budgetMs * pixelsPerMs + 0.5f);
+	platformPushOverlayRect(overlay, graphLeft, budgetY,
+							graphLeft + graphWidth, budgetY + 1, 0xFFFF2020);
+
+	platformPushOverlayText(overlay, graphLeft, top + 4, 0xFFFFFFFF,
+							"frame %6.2fms  budget %6.2fms  worst %6.2fms",
+							latest->totalMs, latest->budgetMs, worstMs);
+
+	int legendX = graphLeft;
+	for (uint32 phase = 0; phase < FramePhase_Count; phase++) {
+		platformPushOverlayRect(overlay, legendX, legendTop + 1, legendX + 6,
+								legendTop + 7,
+								globalOverlayPhaseColors[phase]);
+		platformPushOverlayText(overlay, legendX + 10, legendTop, 0xFFFFFFFF,
+								"%s %.2f", globalOverlayPhaseNames[phase],
+								latest->phaseMs[phase]);
+		legendX += 120;
+	}
+
+	DebugFrame *debugFrame = table ? getLastDebugFrame(table) : 0;
+	if (debugFrame) {
+		DebugSiteTotal hottest[PLATFORM_OVERLAY_TOP_BLOCKS];
+		uint32 hottestCount = getHottestDebugSites(
+			table, debugFrame, hottest, PLATFORM_OVERLAY_TOP_BLOCKS);
+		for (uint32 i = 0; i < hottestCount; i++) {
+			platformPushOverlayText(
+				overlay, graphLeft, blocksTop + (int)i * lineHeight,
+				0xFFFFFFFF, "%-32.32s %8.3fms %6u hits",
+				table->sites[hottest[i].siteIndex].name,
+				(real64)hottest[i].selfCycles * overlay->msPerCycle,
+				hottest[i].hitCount);
+		}
+	}
+
+	platformFlushOverlay(overlay, buffer);
+}
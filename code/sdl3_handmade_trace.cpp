@@ -0,0 +1,316 @@
+// NOTE(bruno): Chrome Trace Event JSON, one B/E pair per timed block with the
+// slot of the recording thread as tid, plus one X event per frame on a track
+// of its own. Timestamps are microseconds since the first frame of the
+// capture.
+//
+// T starts and stops a capture into handmade_trace_<n>.json, setting
+// HANDMADE_TRACE to a filename (or to 1 for the numbered one) traces from
+// launch on. Only the frame thread starts, stops and feeds captures.
+
+#define PLATFORM_TRACE_FRAME_TID DEBUG_MAX_THREADS
+// NOTE(bruno): long enough for the longest event we write
+#define PLATFORM_TRACE_MAX_EVENT_SIZE 1024
+// NOTE(bruno): how long the cycle counter has to run next to the performance
+// counter before we trust the rate we get out of them
+#define PLATFORM_TRACE_CALIBRATION_SECONDS 0.1
+
+global_variable PlatformTraceCapture globalTraceCapture;
+
+void platformFlushTraceBuffer(PlatformTraceWriter *writer) {
+	char *nextByteLocation = writer->buffer;
+	uint32 bytesToWrite = writer->bufferUsed;
+	writer->bufferUsed = 0;
+
+	while (bytesToWrite && !writer->failed) {
+		ssize_t bytesWritten =
+			write(writer->fileHandle, nextByteLocation, bytesToWrite);
+		if (bytesWritten == -1) {
+			if (errno == EINTR) continue;
+			writer->failed = true;
+			break;
+		}
+		bytesToWrite -= (uint32)bytesWritten;
+		nextByteLocation += bytesWritten;
+	}
+}
+
+void platformWriteTrace(PlatformTraceWriter *writer, const char *format, ...) {
+	if (PLATFORM_TRACE_BUFFER_SIZE - writer->bufferUsed <
+		PLATFORM_TRACE_MAX_EVENT_SIZE) {
+		platformFlushTraceBuffer(writer);
+	}
+
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(writer->buffer + writer->bufferUsed,
+						   PLATFORM_TRACE_MAX_EVENT_SIZE, format, args);
+	va_end(args);
+
+	if (length > 0) {
+		writer->bufferUsed += (uint32)length < PLATFORM_TRACE_MAX_EVENT_SIZE
+								  ? (uint32)length
+								  : PLATFORM_TRACE_MAX_EVENT_SIZE - 1;
+	}
+}
+
+// NOTE(bruno): function names and paths hardly ever need it, but a stray
+// quote would make the whole file unreadable
+void platformEscapeTraceString(char *dest, size_t destSize,
+							   const char *source) {
+	size_t used = 0;
+	for (const char *at = source; *at && used + 3 < destSize; at++) {
+		char c = *at;
+		if (c == '"' || c == '\\') {
+			dest[used++] = '\\';
+			dest[used++] = c;
+		} else if ((uint8)c < ' ') {
+			dest[used++] = ' ';
+		} else {
+			dest[used++] = c;
+		}
+	}
+	dest[used] = 0;
+}
+
+inline real64 platformGetTraceTimestamp(PlatformTraceWriter *writer,
+										uint64 clock) {
+	return (real64)(int64)(clock - writer->startClock) /
+		   writer->cyclesPerMicrosecond;
+}
+
+// NOTE(bruno): names get written the first time a thread shows up, the
+// platform only names its threads once they are running
+void platformWriteTraceThreadName(PlatformTraceWriter *writer,
+								  uint32 threadIndex) {
+	uint32 bit = 1u << threadIndex;
+	if (writer->namedThreads & bit) return;
+	writer->namedThreads |= bit;
+
+	char escapedName[128];
+	const char *name = writer->table->threads[threadIndex].name;
+	if (name) {
+		platformEscapeTraceString(escapedName, sizeof(escapedName), name);
+	} else {
+		snprintf(escapedName, sizeof(escapedName), "thread %u", threadIndex);
+	}
+	platformWriteTrace(writer,
+					   ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+					   "\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+					   threadIndex, escapedName);
+}
+
+void platformWriteTraceRecord(PlatformTraceWriter *writer,
+							  DebugTraceRecord *record) {
+	real64 timestamp = platformGetTraceTimestamp(writer, record->clock);
+
+	switch (record->type) {
+		case DebugTrace_BeginBlock: {
+			platformWriteTraceThreadName(writer, record->threadIndex);
+
+			char name[2 * sizeof(((DebugSiteRecord *)0)->name)] = "?";
+			char file[2 * sizeof(((DebugSiteRecord *)0)->file)] = "?";
+			int32 line = 0;
+			if (record->siteIndex != DEBUG_NO_SITE) {
+				DebugSiteRecord *site =
+					&writer->table->sites[record->siteIndex];
+				platformEscapeTraceString(name, sizeof(name), site->name);
+				platformEscapeTraceString(file, sizeof(file), site->file);
+				line = site->line;
+			}
+
+			platformWriteTrace(writer,
+							   ",\n{\"name\":\"%s\",\"cat\":\"%s:%d\","
+							   "\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+							   name, file, line, timestamp,
+							   record->threadIndex);
+		} break;
+
+		case DebugTrace_EndBlock: {
+			platformWriteTrace(writer,
+							   ",\n{\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,"
+							   "\"tid\":%u}",
+							   timestamp, record->threadIndex);
+		} break;
+
+		case DebugTrace_FrameEnd: {
+			real64 frameStart =
+				platformGetTraceTimestamp(writer, writer->lastFrameEndClock);
+			writer->lastFrameEndClock = record->clock;
+			platformWriteTrace(writer,
+							   ",\n{\"name\":\"frame\",\"ph\":\"X\","
+							   "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u,"
+							   "\"args\":{\"frame\":%u}}",
+							   frameStart, timestamp - frameStart,
+							   PLATFORM_TRACE_FRAME_TID, record->siteIndex);
+		} break;
+	}
+	writer->eventCount++;
+}
+
+void platformDrainTraceRing(PlatformTraceWriter *writer) {
+	DebugTraceRing *ring = &writer->ring;
+	uint32 writeIndex = atomicLoadUInt32(&ring->writeIndex);
+	uint32 readIndex = ring->readIndex;
+
+	while (readIndex != writeIndex) {
+		platformWriteTraceRecord(
+			writer, &ring->records[readIndex & (DEBUG_TRACE_RING_SIZE - 1)]);
+		readIndex++;
+		// NOTE(bruno): hand the space back as we go, a slow disk shouldn't
+		// make collation drop records it has room for
+		if ((readIndex & 4095) == 0) {
+			atomicStoreUInt32(&ring->readIndex, readIndex);
+		}
+	}
+	atomicStoreUInt32(&ring->readIndex, readIndex);
+}
+
+// NOTE(bruno): woken up once a frame. Drains the ring, and once it's told to
+// stop drains it one last time and closes the file
+int platformTraceWriterThreadProc(void *data) {
+	PlatformTraceWriter *writer = (PlatformTraceWriter *)data;
+
+	bool stopping = false;
+	while (!stopping) {
+		SDL_WaitSemaphore(writer->semaphore);
+		stopping = atomicLoadUInt32(&writer->stopping);
+		platformDrainTraceRing(writer);
+	}
+
+	platformWriteTrace(writer, "\n]}\n");
+	platformFlushTraceBuffer(writer);
+	close(writer->fileHandle);
+
+	if (writer->failed) {
+		printf("Failed writing the trace to %s\n", writer->filename);
+	} else {
+		printf("Wrote %llu trace events to %s, dropped %u\n",
+			   (unsigned long long)writer->eventCount, writer->filename,
+			   writer->ring.droppedCount);
+	}
+
+	atomicStoreUInt32(&writer->finished, 1);
+	return 0;
+}
+
+// NOTE(bruno): with wait false only cleans up after a writer that is done
+void platformReapTraceWriter(PlatformTraceCapture *capture, bool wait) {
+	PlatformTraceWriter *writer = capture->stoppingWriter;
+	if (!writer) return;
+	if (!wait && !atomicLoadUInt32(&writer->finished)) return;
+
+	while (!atomicLoadUInt32(&writer->finished)) {
+		SDL_Delay(1);
+	}
+
+	SDL_DestroySemaphore(writer->semaphore);
+	munmap(writer, sizeof(PlatformTraceWriter));
+	capture->stoppingWriter = 0;
+}
+
+void platformStartTrace(PlatformTraceCapture *capture, DebugTable *table,
+						const char *filename) {
+	if (!table || capture->writer) return;
+	platformReapTraceWriter(capture, true);
+
+	int fileHandle = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fileHandle == -1) {
+		printf("Failed to open %s for the trace\n", filename);
+		return;
+	}
+
+	void *memory = mmap(0, sizeof(PlatformTraceWriter), PROT_READ | PROT_WRITE,
+						MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED) {
+		close(fileHandle);
+		return;
+	}
+
+	PlatformTraceWriter *writer = (PlatformTraceWriter *)memory;
+	writer->table = table;
+	writer->fileHandle = fileHandle;
+	snprintf(writer->filename, sizeof(writer->filename), "%s", filename);
+
+	// NOTE(bruno): only tracing from launch ever has to wait here
+	real64 perfFrequency = (real64)SDL_GetPerformanceFrequency();
+	real64 secondsSinceStartup =
+		(real64)(SDL_GetPerformanceCounter() - capture->startupCounter) /
+		perfFrequency;
+	if (secondsSinceStartup < PLATFORM_TRACE_CALIBRATION_SECONDS) {
+		SDL_Delay((uint32)((PLATFORM_TRACE_CALIBRATION_SECONDS -
+							secondsSinceStartup) *
+						   1000.0) +
+				  1);
+		secondsSinceStartup =
+			(real64)(SDL_GetPerformanceCounter() - capture->startupCounter) /
+			perfFrequency;
+	}
+	writer->cyclesPerMicrosecond =
+		(real64)(__rdtsc() - capture->startupClock) /
+		(secondsSinceStartup * 1000000.0);
+
+	// NOTE(bruno): the events of the frame we are in get collated into the
+	// capture too, so it starts where that frame did
+	writer->startClock = getCollatingDebugFrame(table)->beginClock;
+	writer->lastFrameEndClock = writer->startClock;
+
+	platformWriteTrace(writer,
+					   "{\"traceEvents\":[\n"
+					   "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+					   "\"args\":{\"name\":\"handmade\"}}");
+	platformWriteTrace(writer,
+					   ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+					   "\"tid\":%u,\"args\":{\"name\":\"frames\"}}",
+					   PLATFORM_TRACE_FRAME_TID);
+
+	writer->semaphore = SDL_CreateSemaphore(0);
+	SDL_Thread *thread = writer->semaphore
+							 ? SDL_CreateThread(platformTraceWriterThreadProc,
+												"trace writer", writer)
+							 : 0;
+	if (!thread) {
+		if (writer->semaphore) SDL_DestroySemaphore(writer->semaphore);
+		close(fileHandle);
+		munmap(writer, sizeof(PlatformTraceWriter));
+		printf("Failed to start the trace writer\n");
+		return;
+	}
+	SDL_DetachThread(thread);
+
+	capture->writer = writer;
+	table->trace = &writer->ring;
+	printf("Tracing to %s\n", filename);
+}
+
+void platformStopTrace(PlatformTraceCapture *capture, DebugTable *table) {
+	PlatformTraceWriter *writer = capture->writer;
+	if (!writer) return;
+
+	// NOTE(bruno): collation runs on this thread, so nothing gets pushed
+	// after this
+	table->trace = 0;
+	atomicStoreUInt32(&writer->stopping, 1);
+	SDL_SignalSemaphore(writer->semaphore);
+
+	platformReapTraceWriter(capture, true);
+	capture->writer = 0;
+	capture->stoppingWriter = writer;
+}
+
+void platformToggleTrace(PlatformTraceCapture *capture, DebugTable *table) {
+	if (capture->writer) {
+		platformStopTrace(capture, table);
+		return;
+	}
+
+	char filename[64];
+	snprintf(filename, sizeof(filename), "handmade_trace_%u.json",
+			 ++capture->captureCount);
+	platformStartTrace(capture, table, filename);
+}
+
+// NOTE(bruno): once a frame, after it got collated
+void platformUpdateTrace(PlatformTraceCapture *capture) {
+	if (capture->writer) SDL_SignalSemaphore(capture->writer->semaphore);
+	platformReapTraceWriter(capture, false);
+}
@@ -1,10 +1,9 @@
 #include "handmade.cpp"
 #include "test_framework.h"
+#include "handmade_debug.cpp"
 
 World createTestWorld() {
 	World world = {};
-	world.width = 2;
-	world.height = 2;
 	world.tilemapWidth = 16;
 	world.tilemapHeight = 9;
 	world.tileSideInMeters = 1.4f;
@@ -15,148 +14,1082 @@ World createTestWorld() {
 TEST(test_recanonicalizePosition_withinBounds) {
 	World world = createTestWorld();
 
-	CanonicalPosition pos = {};
+	WorldPosition pos = {};
 	pos.tilemapX = 0;
 	pos.tilemapY = 0;
 	pos.tileX = 5;
 	pos.tileY = 4;
-	pos.x = 30.0f;
-	pos.y = 25.0f;
+	pos.tileRelX = 0.5f;
+	pos.tileRelY = 0.3f;
 
-	CanonicalPosition result = recanonicalizePosition(&world, pos);
+	WorldPosition result = recanonicalizePosition(&world, pos);
 
 	EXPECT_EQ(result.tilemapX, 0);
 	EXPECT_EQ(result.tilemapY, 0);
 	EXPECT_EQ(result.tileX, 5);
 	EXPECT_EQ(result.tileY, 4);
-	EXPECT_FLOAT_EQ(result.x, 30.0f, 0.01f);
-	EXPECT_FLOAT_EQ(result.y, 25.0f, 0.01f);
+	EXPECT_FLOAT_EQ(result.tileRelX, 0.5f, 0.01f);
+	EXPECT_FLOAT_EQ(result.tileRelY, 0.3f, 0.01f);
 }
 
 TEST(test_recanonicalizePosition_xOverflow) {
 	World world = createTestWorld();
 
-	CanonicalPosition pos = {};
+	WorldPosition pos = {};
 	pos.tilemapX = 0;
 	pos.tilemapY = 0;
 	pos.tileX = 5;
 	pos.tileY = 4;
-	pos.x = 70.0f;
-	pos.y = 25.0f;
+	pos.tileRelX = 2.0f;
+	pos.tileRelY = 0.3f;
 
-	CanonicalPosition result = recanonicalizePosition(&world, pos);
+	WorldPosition result = recanonicalizePosition(&world, pos);
 
 	EXPECT_EQ(result.tilemapX, 0);
 	EXPECT_EQ(result.tilemapY, 0);
 	EXPECT_EQ(result.tileX, 6);
 	EXPECT_EQ(result.tileY, 4);
-	EXPECT_FLOAT_EQ(result.x, 10.0f, 0.01f);
-	EXPECT_FLOAT_EQ(result.y, 25.0f, 0.01f);
+	EXPECT_FLOAT_EQ(result.tileRelX, 0.6f, 0.01f);
+	EXPECT_FLOAT_EQ(result.tileRelY, 0.3f, 0.01f);
 }
 
 TEST(test_recanonicalizePosition_yOverflow) {
 	World world = createTestWorld();
 
-	CanonicalPosition pos = {};
+	WorldPosition pos = {};
 	pos.tilemapX = 0;
 	pos.tilemapY = 0;
 	pos.tileX = 5;
 	pos.tileY = 4;
-	pos.x = 30.0f;
-	pos.y = 125.0f;
+	pos.tileRelX = 0.5f;
+	pos.tileRelY = 3.0f;
 
-	CanonicalPosition result = recanonicalizePosition(&world, pos);
+	WorldPosition result = recanonicalizePosition(&world, pos);
 
 	EXPECT_EQ(result.tilemapX, 0);
 	EXPECT_EQ(result.tilemapY, 0);
 	EXPECT_EQ(result.tileX, 5);
 	EXPECT_EQ(result.tileY, 6);
-	EXPECT_FLOAT_EQ(result.x, 30.0f, 0.01f);
-	EXPECT_FLOAT_EQ(result.y, 5.0f, 0.01f);
+	EXPECT_FLOAT_EQ(result.tileRelX, 0.5f, 0.01f);
+	EXPECT_FLOAT_EQ(result.tileRelY, 0.2f, 0.01f);
 }
 
 TEST(test_recanonicalizePosition_tilemapXOverflow) {
 	World world = createTestWorld();
 
-	CanonicalPosition pos = {};
+	WorldPosition pos = {};
 	pos.tilemapX = 0;
 	pos.tilemapY = 0;
 	pos.tileX = 15;
 	pos.tileY = 4;
-	pos.x = 70.0f;
-	pos.y = 25.0f;
+	pos.tileRelX = 2.0f;
+	pos.tileRelY = 0.3f;
 
-	CanonicalPosition result = recanonicalizePosition(&world, pos);
+	WorldPosition result = recanonicalizePosition(&world, pos);
 
 	EXPECT_EQ(result.tilemapX, 1);
 	EXPECT_EQ(result.tilemapY, 0);
 	EXPECT_EQ(result.tileX, 0);
 	EXPECT_EQ(result.tileY, 4);
-	EXPECT_FLOAT_EQ(result.x, 10.0f, 0.01f);
-	EXPECT_FLOAT_EQ(result.y, 25.0f, 0.01f);
+	EXPECT_FLOAT_EQ(result.tileRelX, 0.6f, 0.01f);
+	EXPECT_FLOAT_EQ(result.tileRelY, 0.3f, 0.01f);
 }
 
 TEST(test_recanonicalizePosition_tilemapYOverflow) {
 	World world = createTestWorld();
 
-	CanonicalPosition pos = {};
+	WorldPosition pos = {};
 	pos.tilemapX = 0;
 	pos.tilemapY = 0;
 	pos.tileX = 5;
 	pos.tileY = 8;
-	pos.x = 30.0f;
-	pos.y = 70.0f;
+	pos.tileRelX = 0.5f;
+	pos.tileRelY = 2.0f;
 
-	CanonicalPosition result = recanonicalizePosition(&world, pos);
+	WorldPosition result = recanonicalizePosition(&world, pos);
 
 	EXPECT_EQ(result.tilemapX, 0);
 	EXPECT_EQ(result.tilemapY, 1);
 	EXPECT_EQ(result.tileX, 5);
 	EXPECT_EQ(result.tileY, 0);
-	EXPECT_FLOAT_EQ(result.x, 30.0f, 0.01f);
-	EXPECT_FLOAT_EQ(result.y, 10.0f, 0.01f);
+	EXPECT_FLOAT_EQ(result.tileRelX, 0.5f, 0.01f);
+	EXPECT_FLOAT_EQ(result.tileRelY, 0.6f, 0.01f);
 }
 
 TEST(test_recanonicalizePosition_xUnderflow) {
 	World world = createTestWorld();
 
-	CanonicalPosition pos = {};
+	WorldPosition pos = {};
 	pos.tilemapX = 0;
 	pos.tilemapY = 0;
 	pos.tileX = 5;
 	pos.tileY = 4;
-	pos.x = -10.0f;
-	pos.y = 25.0f;
+	pos.tileRelX = -0.2f;
+	pos.tileRelY = 0.3f;
 
-	CanonicalPosition result = recanonicalizePosition(&world, pos);
+	WorldPosition result = recanonicalizePosition(&world, pos);
 
 	EXPECT_EQ(result.tilemapX, 0);
 	EXPECT_EQ(result.tilemapY, 0);
 	EXPECT_EQ(result.tileX, 4);
 	EXPECT_EQ(result.tileY, 4);
-	EXPECT_FLOAT_EQ(result.x, 50.0f, 0.01f);
-	EXPECT_FLOAT_EQ(result.y, 25.0f, 0.01f);
+	EXPECT_FLOAT_EQ(result.tileRelX, 1.2f, 0.01f);
+	EXPECT_FLOAT_EQ(result.tileRelY, 0.3f, 0.01f);
 }
 
 TEST(test_recanonicalizePosition_exactBoundary) {
 	World world = createTestWorld();
 
-	CanonicalPosition pos = {};
+	WorldPosition pos = {};
 	pos.tilemapX = 0;
 	pos.tilemapY = 0;
 	pos.tileX = 5;
 	pos.tileY = 4;
-	pos.x = 0.0f;
-	pos.y = 0.0f;
+	pos.tileRelX = 0.0f;
+	pos.tileRelY = 0.0f;
 
-	CanonicalPosition result = recanonicalizePosition(&world, pos);
+	WorldPosition result = recanonicalizePosition(&world, pos);
 
 	EXPECT_EQ(result.tilemapX, 0);
 	EXPECT_EQ(result.tilemapY, 0);
 	EXPECT_EQ(result.tileX, 5);
 	EXPECT_EQ(result.tileY, 4);
-	EXPECT_FLOAT_EQ(result.x, 0.0f, 0.01f);
-	EXPECT_FLOAT_EQ(result.y, 0.0f, 0.01f);
+	EXPECT_FLOAT_EQ(result.tileRelX, 0.0f, 0.01f);
+	EXPECT_FLOAT_EQ(result.tileRelY, 0.0f, 0.01f);
+}
+
+global_variable uint8 g_testArenaMemory[Megabytes(1)];
+
+// NOTE(bruno): two 4x3 tilemaps side by side, with a wall that splits the
+// middle row so paths have to go around it
+//   0 0 0 0 | 0 0 0 0
+//   0 1 1 1 | 1 0 0 0
+//   0 0 0 0 | 0 0 0 0
+global_variable uint32 g_flowFieldTiles0[3][4] = {
+	{0, 0, 0, 0},
+	{0, 1, 1, 1},
+	{0, 0, 0, 0},
+};
+global_variable uint32 g_flowFieldTiles1[3][4] = {
+	{0, 0, 0, 0},
+	{1, 0, 0, 0},
+	{0, 0, 0, 0},
+};
+global_variable World g_testWorld;
+
+void addTestTilemap(World *world, int32 tilemapX, int32 tilemapY,
+					uint32 *tiles) {
+	Tilemap *tilemap = addTilemap(world, tilemapX, tilemapY);
+	for (int32 i = 0; i < world->tilemapWidth * world->tilemapHeight; i++) {
+		tilemap->tiles[i] = tiles[i];
+	}
+	tilemap->state = TilemapState_Ready;
+}
+
+World *createFlowFieldTestWorld(MemoryArena *arena, FlowField *field) {
+	World *world = &g_testWorld;
+	initializeArena(arena, sizeof(g_testArenaMemory), g_testArenaMemory);
+	initializeWorld(world, arena, 4, 3);
+	world->tileSideInMeters = 1.4f;
+	world->tileSideInPixels = 60;
+
+	addTestTilemap(world, 0, 0, (uint32 *)g_flowFieldTiles0);
+	addTestTilemap(world, 1, 0, (uint32 *)g_flowFieldTiles1);
+
+	initializeFlowField(field, world, arena);
+	return world;
+}
+
+TEST(test_interpolateWorldPosition_crossesTilemaps) {
+	World world = createTestWorld();
+
+	WorldPosition from = {};
+	from.tilemapX = 0;
+	from.tileX = 15;
+	from.tileRelX = 1.2f;
+	from.tileRelY = 0.5f;
+
+	WorldPosition to = from;
+	to.tilemapX = 1;
+	to.tileX = 0;
+	to.tileRelX = 0.2f;
+
+	// NOTE(bruno): 0.4 meters apart, halfway is 0.2 meters past the start
+	WorldPosition result = interpolateWorldPosition(&world, from, to, 0.5f);
+
+	EXPECT_EQ(result.tilemapX, 1);
+	EXPECT_EQ(result.tileX, 0);
+	EXPECT_FLOAT_EQ(result.tileRelX, 0.0f, 0.01f);
+	EXPECT_FLOAT_EQ(result.tileRelY, 0.5f, 0.01f);
+}
+
+TEST(test_getVisibleTileRange_coversOnlyTheBackbuffer) {
+	World world = createTestWorld();
+	world.metersToPixels =
+		(real32)world.tileSideInPixels / world.tileSideInMeters;
+	GameBackbuffer buffer = {};
+	buffer.width = 960;
+	buffer.height = 540;
+
+	// NOTE(bruno): half a tile off the grid across, so both edge columns are
+	// cut in half. Down it lines up, rows 0 to 8 fill the 540 pixels exactly
+	WorldPosition camera = {};
+	camera.tilemapX = 1;
+	camera.tileX = 8;
+	camera.tileY = 4;
+	camera.tileRelX = 0.7f;
+	camera.tileRelY = 0.7f;
+	TileRange range = getVisibleTileRange(&buffer, &world, camera);
+	EXPECT_EQ(range.minAbsTileX, 16);
+	EXPECT_EQ(range.maxAbsTileX, 32);
+	EXPECT_EQ(range.minAbsTileY, 0);
+	EXPECT_EQ(range.maxAbsTileY, 8);
+
+	// NOTE(bruno): on the grid, the 16 columns end right on the edges
+	camera.tileRelX = 0.0f;
+	range = getVisibleTileRange(&buffer, &world, camera);
+	EXPECT_EQ(range.minAbsTileX, 16);
+	EXPECT_EQ(range.maxAbsTileX, 31);
+}
+
+TEST(test_wasButtonDown_usesTheTransitionTime) {
+	// NOTE(bruno): pressed 10ms before the latch
+	GameButtonState pressed = {};
+	pressed.endedDown = true;
+	pressed.halfTransitionCount = 1;
+	pressed.transitionSeconds = 0.01f;
+
+	EXPECT_EQ(wasButtonDown(&pressed, 0.0f), true);
+	EXPECT_EQ(wasButtonDown(&pressed, 0.005f), true);
+	EXPECT_EQ(wasButtonDown(&pressed, 0.02f), false);
+
+	// NOTE(bruno): held since an earlier frame, time doesn't matter
+	GameButtonState held = {};
+	held.endedDown = true;
+	EXPECT_EQ(wasButtonDown(&held, 0.02f), true);
+
+	GameButtonState released = pressed;
+	released.endedDown = false;
+	EXPECT_EQ(wasButtonDown(&released, 0.0f), false);
+	EXPECT_EQ(wasButtonDown(&released, 0.02f), true);
+}
+
+global_variable GameState g_testGameState;
+
+TEST(test_simulatePlayer_movesWithTheAnalogStick) {
+	MemoryArena arena;
+	FlowField field;
+	World *world = createFlowFieldTestWorld(&arena, &field);
+
+	GameState *gameState = &g_testGameState;
+	gameState->playerPos = {};
+	gameState->playerPos.tileX = 1;
+	gameState->playerPos.tileRelX = 0.7f;
+	gameState->playerPos.tileRelY = 0.7f;
+
+	GameInput input = {};
+	input.deltaTime = 0.1f;
+	GameControllerInput *pad = gameGetController(&input, 1);
+	pad->isConnected = true;
+	pad->isAnalog = true;
+	pad->stickAverageX = 0.5f;
+	// NOTE(bruno): the d-pad doesn't count while the stick is in use
+	pad->moveDown.endedDown = true;
+
+	simulatePlayer(gameState, world, &input, 0.0f);
+
+	// NOTE(bruno): half of 5 m/s for a tenth of a second
+	EXPECT_EQ(gameState->playerPos.tileX, 1);
+	EXPECT_FLOAT_EQ(gameState->playerPos.tileRelX, 0.95f, 0.001f);
+	EXPECT_FLOAT_EQ(gameState->playerPos.tileRelY, 0.7f, 0.001f);
+}
+
+global_variable uint32 g_testPixels[4 * 4];
+
+GameBackbuffer createTestBackbuffer() {
+	for (uint32 i = 0; i < arraylength(g_testPixels); i++) {
+		g_testPixels[i] = 0;
+	}
+	GameBackbuffer buffer = {};
+	buffer.width = 4;
+	buffer.height = 4;
+	buffer.pitch = 4 * sizeof(uint32);
+	buffer.memory = g_testPixels;
+	return buffer;
+}
+
+TEST(test_rectangleRasterizers_blendClipAndSwizzle) {
+	GameBackbuffer buffer = createTestBackbuffer();
+
+	// NOTE(bruno): hangs off the top left, only one pixel is inside
+	renderRectangle(&buffer, -2.0f, -2.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f);
+	EXPECT_EQ(g_testPixels[0], 0xFFFF0000u);
+	EXPECT_EQ(g_testPixels[1], 0u);
+	EXPECT_EQ(g_testPixels[4], 0u);
+
+	// NOTE(bruno): an alpha of 0.5 rounds to 128 out of 255
+	renderBlendedRectangle(&buffer, 0.0f, 0.0f, 2.0f, 1.0f, 1.0f, 1.0f, 1.0f,
+						   0.5f, RenderBlend_Alpha);
+	EXPECT_EQ(g_testPixels[0], 0xFFFF8080u);
+	EXPECT_EQ(g_testPixels[1], 0x80808080u);
+
+	renderBlendedRectangle(&buffer, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f, 0.0f,
+						   1.0f, RenderBlend_Additive);
+	EXPECT_EQ(g_testPixels[0], 0xFFFFFF80u);
+
+	buffer.format = BackbufferFormat_ABGR8888;
+	renderRectangle(&buffer, 3.0f, 3.0f, 4.0f, 4.0f, 1.0f, 0.0f, 0.0f);
+	EXPECT_EQ(g_testPixels[15], 0xFF0000FFu);
+}
+
+TEST(test_renderTexturedQuad_samplesAndBlends) {
+	// NOTE(bruno): 2x2, the top right texel is half transparent red
+	uint32 texels[4] = {0xFF112233u, 0x80800000u, 0xFF445566u, 0xFF778899u};
+	LoadedBitmap bitmap = {};
+	bitmap.width = 2;
+	bitmap.height = 2;
+	bitmap.pitch = 2 * sizeof(uint32);
+	bitmap.memory = texels;
+
+	// NOTE(bruno): one texel per pixel lands every pixel center on a texel
+	// center, so bilinear gives back the texels
+	GameBackbuffer buffer = createTestBackbuffer();
+	g_testPixels[2] = 0xFF0000FFu;
+	renderTexturedQuad(&buffer, {1.0f, 0.0f}, {2.0f, 0.0f}, {0.0f, 2.0f},
+					   &bitmap, 1.0f);
+	EXPECT_EQ(g_testPixels[0], 0u);
+	EXPECT_EQ(g_testPixels[1], 0xFF112233u);
+	EXPECT_EQ(g_testPixels[2], 0xFF80007Fu);
+	EXPECT_EQ(g_testPixels[5], 0xFF445566u);
+	EXPECT_EQ(g_testPixels[6], 0xFF778899u);
+	EXPECT_EQ(g_testPixels[9], 0u);
+
+	// NOTE(bruno): turned a quarter clockwise, the bitmap's x runs down
+	buffer = createTestBackbuffer();
+	renderTexturedQuad(&buffer, {3.0f, 1.0f}, {0.0f, 2.0f}, {-2.0f, 0.0f},
+					   &bitmap, 1.0f);
+	EXPECT_EQ(g_testPixels[6], 0xFF112233u);
+	EXPECT_EQ(g_testPixels[10], 0x80800000u);
+	EXPECT_EQ(g_testPixels[5], 0xFF445566u);
+	EXPECT_EQ(g_testPixels[9], 0xFF778899u);
+	EXPECT_EQ(g_testPixels[7], 0u);
+}
+
+TEST(test_flowField_pathsAroundWalls) {
+	MemoryArena arena;
+	FlowField field;
+	World *world = createFlowFieldTestWorld(&arena, &field);
+
+	updateFlowField(&field, world, 0, 1);
+
+	EXPECT_EQ(getFlowFieldDistance(&field, world, 0, 1), 0);
+	EXPECT_EQ(getFlowFieldDistance(&field, world, 0, 0), 1);
+	EXPECT_EQ(getFlowFieldDistance(&field, world, 5, 1), 7);
+	EXPECT_EQ(getFlowFieldDistance(&field, world, 2, 1),
+			  FLOW_FIELD_UNREACHED);
+	EXPECT_EQ(getFlowFieldDirection(&field, world, 4, 0), FlowDirection_Left);
+	EXPECT_EQ(getFlowFieldDirection(&field, world, 0, 0), FlowDirection_Down);
+	EXPECT_EQ(getFlowFieldDirection(&field, world, 0, 1), FlowDirection_None);
+}
+
+TEST(test_flowField_repairsOnlyDirtyChunks) {
+	MemoryArena arena;
+	FlowField field;
+	World *world = createFlowFieldTestWorld(&arena, &field);
+
+	updateFlowField(&field, world, 0, 1);
+	EXPECT_EQ(field.rebuildCount, 1u);
+
+	invalidateFlowFieldChunk(&field, world, 100, 0);
+	EXPECT_EQ(field.hasDirtyChunks, false);
+
+	// NOTE(bruno): a wall at 5,0 in the second tilemap, the way around it is
+	// now along the bottom row
+	getTilemap(world, 1, 0)->tiles[1] = 1;
+	invalidateFlowFieldChunk(&field, world, 1, 0);
+	EXPECT_EQ(field.hasDirtyChunks, true);
+	updateFlowField(&field, world, 0, 1);
+
+	EXPECT_EQ(field.rebuildCount, 1u);
+	EXPECT_EQ(getFlowFieldDistance(&field, world, 5, 0),
+			  FLOW_FIELD_UNREACHED);
+	EXPECT_EQ(getFlowFieldDistance(&field, world, 5, 1), 7);
+	EXPECT_EQ(getFlowFieldDistance(&field, world, 6, 0), 9);
+	EXPECT_EQ(getFlowFieldDirection(&field, world, 6, 0), FlowDirection_Down);
+
+	// NOTE(bruno): no more than the 4x3 tiles of the second tilemap were
+	// written, and the first one kept what it had
+	EXPECT_EQ(field.writtenCellCount <= 12, true);
+	EXPECT_EQ(getFlowFieldDistance(&field, world, 3, 0), 4);
+	EXPECT_EQ(getFlowFieldDistance(&field, world, 3, 2), 4);
+	EXPECT_EQ(getFlowFieldDirection(&field, world, 3, 0), FlowDirection_Left);
+}
+
+TEST(test_flowField_repairMatchesARebuild) {
+	MemoryArena arena;
+	FlowField field;
+	World *world = createFlowFieldTestWorld(&arena, &field);
+	FlowField rebuilt;
+	initializeFlowField(&rebuilt, world, &arena);
+
+	// NOTE(bruno): around the wall and over into the second tilemap, one or
+	// two tiles at a time
+	int32 pathX[] = {0, 0, 1, 3, 4, 5, 5, 7, 6, 5, 3};
+	int32 pathY[] = {1, 0, 0, 0, 0, 0, 2, 2, 1, 2, 2};
+	uint32 mismatchCount = 0;
+	for (uint32 step = 0; step < arraylength(pathX); step++) {
+		updateFlowField(&field, world, pathX[step], pathY[step]);
+		rebuilt.isValid = false;
+		updateFlowField(&rebuilt, world, pathX[step], pathY[step]);
+
+		for (int32 absTileY = 0; absTileY < 3; absTileY++) {
+			for (int32 absTileX = 0; absTileX < 8; absTileX++) {
+				if (getFlowFieldDistance(&field, world, absTileX, absTileY) !=
+					getFlowFieldDistance(&rebuilt, world, absTileX,
+										 absTileY)) {
+					mismatchCount++;
+				}
+			}
+		}
+	}
+
+	EXPECT_EQ(mismatchCount, 0u);
+	EXPECT_EQ(field.rebuildCount, 1u);
+}
+
+TEST(test_worldgen_isDeterministic) {
+	MemoryArena arena;
+	initializeArena(&arena, sizeof(g_testArenaMemory), g_testArenaMemory);
+	World *world = &g_testWorld;
+	initializeWorld(world, &arena, 16, 9);
+	world->seed = 1234;
+
+	uint32 first[9 * 16];
+	uint32 second[9 * 16];
+	generateTilemapTiles(world, -3, 7, first);
+	generateTilemapTiles(world, -3, 7, second);
+
+	int32 differentTiles = 0;
+	for (uint32 i = 0; i < arraylength(first); i++) {
+		if (first[i] != second[i]) differentTiles++;
+	}
+	EXPECT_EQ(differentTiles, 0);
+	// NOTE(bruno): the spawn point in the middle must always be open
+	EXPECT_EQ(first[4 * 16 + 8], 0);
+}
+
+TEST(test_worldgen_doorsLineUpWithNeighbors) {
+	MemoryArena arena;
+	initializeArena(&arena, sizeof(g_testArenaMemory), g_testArenaMemory);
+	World *world = &g_testWorld;
+	initializeWorld(world, &arena, 16, 9);
+	world->seed = 42;
+
+	uint32 left[9][16];
+	uint32 right[9][16];
+	uint32 below[9][16];
+	generateTilemapTiles(world, 5, -2, (uint32 *)left);
+	generateTilemapTiles(world, 6, -2, (uint32 *)right);
+	generateTilemapTiles(world, 5, -1, (uint32 *)below);
+
+	int32 mismatchedRows = 0;
+	int32 openRows = 0;
+	for (int32 y = 0; y < 9; y++) {
+		if (left[y][15] != right[y][0]) mismatchedRows++;
+		if (left[y][15] == 0) openRows++;
+	}
+	EXPECT_EQ(mismatchedRows, 0);
+	EXPECT_EQ(openRows, 1);
+
+	int32 mismatchedColumns = 0;
+	int32 openColumns = 0;
+	for (int32 x = 0; x < 16; x++) {
+		if (left[8][x] != below[0][x]) mismatchedColumns++;
+		if (left[8][x] == 0) openColumns++;
+	}
+	EXPECT_EQ(mismatchedColumns, 0);
+	EXPECT_EQ(openColumns, 1);
+}
+
+TEST(test_soundCommandRing_fillsAndDrainsInOrder) {
+	SoundCommandRing ring = {};
+
+	int32 pushed = 0;
+	for (int32 i = 0; i < SOUND_COMMAND_RING_SIZE + 4; i++) {
+		SoundCommand command = {};
+		command.type = SoundCommand_SetTone;
+		command.toneHz = (real32)i;
+		if (pushSoundCommand(&ring, command)) pushed++;
+	}
+	EXPECT_EQ(pushed, SOUND_COMMAND_RING_SIZE);
+
+	int32 popped = 0;
+	int32 outOfOrder = 0;
+	SoundCommand command;
+	while (popSoundCommand(&ring, &command)) {
+		if (command.toneHz != (real32)popped) outOfOrder++;
+		popped++;
+	}
+	EXPECT_EQ(popped, SOUND_COMMAND_RING_SIZE);
+	EXPECT_EQ(outOfOrder, 0);
+
+	SoundCommand lastCommand = {};
+	lastCommand.toneHz = 440.0f;
+	EXPECT_EQ(pushSoundCommand(&ring, lastCommand), true);
+	EXPECT_EQ(popSoundCommand(&ring, &command), true);
+	EXPECT_FLOAT_EQ(command.toneHz, 440.0f, 0.01f);
+}
+
+TEST(test_parseWAV_deinterleavesStereo) {
+	struct {
+		uint32 riffID, size, waveID;
+		uint32 fmtID, fmtSize;
+		uint16 formatTag, channelCount;
+		uint32 samplesPerSecond, averageBytesPerSecond;
+		uint16 blockAlign, bitsPerSample;
+		uint32 dataID, dataSize;
+		int16 samples[6];
+	} file = {};
+	file.riffID = WaveChunkID_RIFF;
+	file.size = sizeof(file) - 8;
+	file.waveID = WaveChunkID_WAVE;
+	file.fmtID = WaveChunkID_fmt;
+	file.fmtSize = 16;
+	file.formatTag = 1;
+	file.channelCount = 2;
+	file.samplesPerSecond = 48000;
+	file.averageBytesPerSecond = 48000 * 4;
+	file.blockAlign = 4;
+	file.bitsPerSample = 16;
+	file.dataID = WaveChunkID_data;
+	file.dataSize = sizeof(file.samples);
+	int16 interleaved[] = {1, -1, 2, -2, 3, -3};
+	for (uint32 i = 0; i < arraylength(interleaved); i++) {
+		file.samples[i] = interleaved[i];
+	}
+
+	MemoryArena arena;
+	initializeArena(&arena, sizeof(g_testArenaMemory), g_testArenaMemory);
+	LoadedSound sound = parseWAV(&arena, &file, sizeof(file));
+
+	EXPECT_EQ(sound.sampleCount, 3u);
+	EXPECT_EQ(sound.channelCount, 2u);
+	EXPECT_EQ(sound.samples[0][2], 3);
+	EXPECT_EQ(sound.samples[1][2], -3);
+	EXPECT_EQ(sound.samples[1][3], 0);
+}
+
+global_variable GameAudioState g_testAudio;
+
+TEST(test_mixer_clampsPansAndPadsWithSilence) {
+	int16 samples[6 + 4] = {20000, 20000, 20000, 20000, 20000, 20000};
+	LoadedSound sound = {};
+	sound.sampleCount = 6;
+	sound.channelCount = 1;
+	sound.samples[0] = samples;
+
+	g_testAudio = {};
+	SoundCommand play = {};
+	play.type = SoundCommand_PlaySound;
+	play.sound = &sound;
+	play.volume = 1.0f;
+	play.pan = -1.0f;
+	startPlayingSound(&g_testAudio, &play);
+	startPlayingSound(&g_testAudio, &play);
+
+	// NOTE(bruno): 7 is not a multiple of 4, so the scalar tail runs too
+	int16 output[2 * 7];
+	GameSoundBuffer soundBuffer = {};
+	soundBuffer.sampleRate = 48000;
+	soundBuffer.sampleCount = 7;
+	soundBuffer.samples = output;
+	gameOutputSound(&soundBuffer, &g_testAudio);
+
+	EXPECT_EQ(output[0], 32767);
+	EXPECT_EQ(output[1], 0);
+	EXPECT_EQ(output[2 * 5], 32767);
+	EXPECT_EQ(output[2 * 6], 0);
+	EXPECT_EQ(g_testAudio.playingSoundCount, 0u);
+}
+
+#define TEST_STREAM_SAMPLES (STREAM_BUFFER_SAMPLES + 100)
+
+struct TestWaveFile {
+	uint32 riffID, size, waveID;
+	uint32 fmtID, fmtSize;
+	uint16 formatTag, channelCount;
+	uint32 samplesPerSecond, averageBytesPerSecond;
+	uint16 blockAlign, bitsPerSample;
+	uint32 dataID, dataSize;
+	int16 samples[TEST_STREAM_SAMPLES];
+};
+
+global_variable TestWaveFile g_testWaveFile;
+global_variable int16 g_testStreamOutput[2 * TEST_STREAM_SAMPLES];
+
+PlatformFileHandle testOpenFile(const char *filename) {
+	PlatformFileHandle result = {};
+	result.isValid = true;
+	result.size = sizeof(g_testWaveFile);
+	return result;
+}
+
+bool testReadDataFromFile(PlatformFileHandle *handle, uint64 offset,
+						  uint64 size, void *dest) {
+	if (offset + size > handle->size) return false;
+	uint8 *source = (uint8 *)&g_testWaveFile + offset;
+	for (uint64 i = 0; i < size; i++) {
+		((uint8 *)dest)[i] = source[i];
+	}
+	return true;
+}
+
+void testCloseFile(PlatformFileHandle *handle) { *handle = {}; }
+
+// NOTE(bruno): runs the work right away instead of on a worker
+void testAddWorkEntry(PlatformWorkQueue *queue,
+					  PlatformWorkQueueCallback callback, void *data) {
+	callback(queue, data);
+}
+
+void fillTestWaveFile() {
+	TestWaveFile *file = &g_testWaveFile;
+	*file = {};
+	file->riffID = WaveChunkID_RIFF;
+	file->size = sizeof(*file) - 8;
+	file->waveID = WaveChunkID_WAVE;
+	file->fmtID = WaveChunkID_fmt;
+	file->fmtSize = 16;
+	file->formatTag = 1;
+	file->channelCount = 1;
+	file->samplesPerSecond = 48000;
+	file->averageBytesPerSecond = 48000 * 2;
+	file->blockAlign = 2;
+	file->bitsPerSample = 16;
+	file->dataID = WaveChunkID_data;
+	file->dataSize = sizeof(file->samples);
+	for (int32 i = 0; i < TEST_STREAM_SAMPLES; i++) {
+		file->samples[i] = (int16)(i % 1000);
+	}
+}
+
+TEST(test_streamingSound_playsAcrossBuffersAndStops) {
+	fillTestWaveFile();
+
+	GameMemory gameMemory = {};
+	gameMemory.platformOpenFile = testOpenFile;
+	gameMemory.platformReadDataFromFile = testReadDataFromFile;
+	gameMemory.platformCloseFile = testCloseFile;
+	gameMemory.platformAddWorkEntry = testAddWorkEntry;
+
+	MemoryArena arena;
+	initializeArena(&arena, sizeof(g_testArenaMemory), g_testArenaMemory);
+	StreamingSound stream;
+	EXPECT_EQ(openStreamingWAV(&gameMemory, &arena, &stream, "music.wav",
+							   false),
+			  true);
+	EXPECT_EQ(stream.sampleCount, (uint32)TEST_STREAM_SAMPLES);
+
+	updateStreamingSound(&gameMemory, &stream);
+	EXPECT_EQ(stream.finishedLoading, true);
+
+	g_testAudio = {};
+	SoundCommand play = {};
+	play.type = SoundCommand_PlayStream;
+	play.stream = &stream;
+	play.volume = 1.0f;
+	play.pan = -1.0f;
+	startPlayingStream(&g_testAudio, &play);
+
+	GameSoundBuffer soundBuffer = {};
+	soundBuffer.sampleRate = 48000;
+	soundBuffer.sampleCount = TEST_STREAM_SAMPLES;
+	soundBuffer.samples = g_testStreamOutput;
+	gameOutputSound(&soundBuffer, &g_testAudio);
+
+	int32 mismatched = 0;
+	for (int32 i = 0; i < TEST_STREAM_SAMPLES; i++) {
+		if (g_testStreamOutput[2 * i] != (int16)(i % 1000)) mismatched++;
+	}
+	EXPECT_EQ(mismatched, 0);
+	EXPECT_EQ(stream.starvedSampleCount, 0u);
+	EXPECT_EQ(g_testAudio.playingStreamCount, 0u);
+	EXPECT_EQ(stream.buffers[0].state, (uint32)StreamBuffer_Empty);
+}
+
+void testSubmitFileRead(PlatformFileRead *read) {
+	bool ok = testReadDataFromFile(read->file, read->offset, read->size,
+								   read->dest);
+	read->state = ok ? PlatformFileRead_Done : PlatformFileRead_Failed;
+}
+
+TEST(test_loadingWAV_parsesOnceTheReadIsDone) {
+	fillTestWaveFile();
+
+	GameMemory gameMemory = {};
+	gameMemory.platformOpenFile = testOpenFile;
+	gameMemory.platformCloseFile = testCloseFile;
+	gameMemory.platformSubmitFileRead = testSubmitFileRead;
+
+	MemoryArena arena;
+	initializeArena(&arena, sizeof(g_testArenaMemory), g_testArenaMemory);
+	PendingSoundLoad load;
+	LoadedSound sound;
+	beginLoadingWAV(&gameMemory, &arena, &load, &sound, "door.wav");
+	EXPECT_EQ(sound.sampleCount, 0u);
+
+	updateLoadingWAV(&gameMemory, &arena, &load);
+	EXPECT_EQ(load.isPending, false);
+	EXPECT_EQ(sound.sampleCount, (uint32)TEST_STREAM_SAMPLES);
+	EXPECT_EQ(sound.samples[0][1234], 234);
+}
+
+// NOTE(bruno): a pack with the null asset and a few stereo door sounds, laid
+// out the way the packer writes it. Sound n starts at sample value n * 1000
+alignas(64) global_variable uint8 g_testAssetPack[Kilobytes(4)];
+global_variable uint64 g_testAssetPackSize;
+
+void fillTestAssetPack(uint32 soundCount, uint32 sampleCount) {
+	for (uint32 i = 0; i < sizeof(g_testAssetPack); i++) {
+		g_testAssetPack[i] = 0;
+	}
+
+	AssetPackHeader *header = (AssetPackHeader *)g_testAssetPack;
+	header->magicValue = ASSET_PACK_MAGIC_VALUE;
+	header->version = ASSET_PACK_VERSION;
+	header->typeCount = Asset_Count;
+	header->assetCount = soundCount + 1;
+	header->types = sizeof(AssetPackHeader);
+	header->assets = header->types + Asset_Count * sizeof(AssetPackType);
+
+	AssetPackType *types = (AssetPackType *)(g_testAssetPack + header->types);
+	types[Asset_None] = {1, 1};
+	types[Asset_DoorSound] = {1, soundCount + 1};
+
+	AssetPackAsset *assets =
+		(AssetPackAsset *)(g_testAssetPack + header->assets);
+	uint64 stride = getAssetPackChannelStride(sampleCount);
+	uint64 dataOffset = header->assets + (soundCount + 1) * sizeof(*assets);
+	for (uint32 soundIndex = 1; soundIndex <= soundCount; soundIndex++) {
+		AssetPackAsset *asset = &assets[soundIndex];
+		asset->kind = AssetKind_Sound;
+		asset->sound.sampleCount = sampleCount;
+		asset->sound.channelCount = 2;
+		asset->dataOffset = alignAssetPackOffset(dataOffset);
+		asset->dataSize = 2 * stride;
+		dataOffset = asset->dataOffset + asset->dataSize;
+
+		int16 *left = (int16 *)(g_testAssetPack + asset->dataOffset);
+		int16 *right = (int16 *)(g_testAssetPack + asset->dataOffset + stride);
+		for (uint32 i = 0; i < sampleCount; i++) {
+			left[i] = (int16)(soundIndex * 1000 + i);
+			right[i] = (int16)-i;
+		}
+	}
+	g_testAssetPackSize = dataOffset;
+}
+
+PlatformMappedFile testMapFile(const char *filename) {
+	PlatformMappedFile result = {};
+	result.isValid = true;
+	result.size = g_testAssetPackSize;
+	result.memory = g_testAssetPack;
+	return result;
+}
+
+void testPrefetchMemory(void *memory, uint64 size) {}
+
+global_variable uint64 g_testEvictedSize;
+
+void testEvictMemory(void *memory, uint64 size) { g_testEvictedSize += size; }
+
+GameMemory createTestAssetMemory() {
+	GameMemory gameMemory = {};
+	gameMemory.platformMapFile = testMapFile;
+	gameMemory.platformPrefetchMemory = testPrefetchMemory;
+	gameMemory.platformEvictMemory = testEvictMemory;
+	gameMemory.platformAddWorkEntry = testAddWorkEntry;
+	return gameMemory;
+}
+
+TEST(test_assetPack_loadsSoundsOnFirstRequest) {
+	fillTestAssetPack(1, 100);
+	GameMemory gameMemory = createTestAssetMemory();
+
+	MemoryArena arena;
+	initializeArena(&arena, sizeof(g_testArenaMemory), g_testArenaMemory);
+	Assets assets;
+	EXPECT_EQ(openAssetPack(&gameMemory, &assets, &arena, "assets.hmp",
+							Kilobytes(64)),
+			  true);
+	EXPECT_EQ(getFirstAsset(&assets, Asset_None), 0u);
+
+	uint32 door = getFirstAsset(&assets, Asset_DoorSound);
+	EXPECT_EQ(door, 1u);
+
+	// NOTE(bruno): the test queue runs the load right away, but the first
+	// request still only gets it going
+	LoadedSound *sound = getSound(&gameMemory, &assets, door);
+	EXPECT_EQ(sound == &assets.placeholderSound, true);
+	EXPECT_EQ(assets.slots[door].state, (uint32)AssetState_Loaded);
+
+	sound = getSound(&gameMemory, &assets, door);
+	EXPECT_EQ(sound->sampleCount, 100u);
+	EXPECT_EQ(sound->channelCount, 2u);
+	EXPECT_EQ(sound->samples[0][42], 1042);
+	EXPECT_EQ(sound->samples[1][42], -42);
+	EXPECT_EQ(sound->samples[1][100], 0);
+	uint64 misalignment =
+		(uint64)sound->samples[1] & (ASSET_PACK_ALIGNMENT - 1);
+	EXPECT_EQ(misalignment, 0u);
+	// NOTE(bruno): played straight from the mapping
+	EXPECT_EQ((uint8 *)sound->samples[0] ==
+				  g_testAssetPack + assets.assets[door].dataOffset,
+			  true);
+
+	// NOTE(bruno): a payload running past the end of the file
+	g_testAssetPackSize -= 64;
+	EXPECT_EQ(openAssetPack(&gameMemory, &assets, &arena, "assets.hmp",
+							Kilobytes(64)),
+			  false);
+	EXPECT_EQ(getFirstAsset(&assets, Asset_DoorSound), 0u);
+}
+
+TEST(test_assetPack_evictsLeastRecentlyUsed) {
+	fillTestAssetPack(3, 100);
+	GameMemory gameMemory = createTestAssetMemory();
+
+	// NOTE(bruno): room for exactly two sounds
+	uint64 soundSize = 2 * getAssetPackChannelStride(100);
+	MemoryArena arena;
+	initializeArena(&arena, sizeof(g_testArenaMemory), g_testArenaMemory);
+	Assets assets;
+	openAssetPack(&gameMemory, &assets, &arena, "assets.hmp", 2 * soundSize);
+	g_testEvictedSize = 0;
+
+	getSound(&gameMemory, &assets, 1);
+	getSound(&gameMemory, &assets, 2);
+	getSound(&gameMemory, &assets, 1);
+	getSound(&gameMemory, &assets, 3);
+	EXPECT_EQ(assets.slots[1].state, (uint32)AssetState_Loaded);
+	EXPECT_EQ(assets.slots[2].state, (uint32)AssetState_Unloaded);
+	EXPECT_EQ(assets.slots[3].state, (uint32)AssetState_Loaded);
+	EXPECT_EQ(assets.evictionCount, 1u);
+	EXPECT_EQ(g_testEvictedSize, soundSize);
+	EXPECT_EQ(assets.residentSize, 2 * soundSize);
+
+	getSound(&gameMemory, &assets, 3);
+	getSound(&gameMemory, &assets, 2);
+	EXPECT_EQ(assets.slots[1].state, (uint32)AssetState_Unloaded);
+	EXPECT_EQ(assets.slots[3].state, (uint32)AssetState_Loaded);
+	EXPECT_EQ(getSound(&gameMemory, &assets, 2)->samples[0][0], 2000);
+	EXPECT_EQ(assets.evictionCount, 2u);
+	EXPECT_EQ(assets.residentSize, 2 * soundSize);
+}
+
+global_variable SoundCommandRing g_testSoundCommands;
+
+TEST(test_assetPack_keepsPlayingSoundsUntilTheyFinish) {
+	fillTestAssetPack(2, 100);
+	GameMemory gameMemory = createTestAssetMemory();
+
+	// NOTE(bruno): room for one sound
+	MemoryArena arena;
+	initializeArena(&arena, sizeof(g_testArenaMemory), g_testArenaMemory);
+	Assets assets;
+	openAssetPack(&gameMemory, &assets, &arena, "assets.hmp",
+				  2 * getAssetPackChannelStride(100));
+
+	getSound(&gameMemory, &assets, 1);
+	SoundCommand play = {};
+	play.type = SoundCommand_PlaySound;
+	play.sound = getSound(&gameMemory, &assets, 1);
+	play.volume = 1.0f;
+	g_testSoundCommands = {};
+	EXPECT_EQ(pushSoundCommand(&g_testSoundCommands, play), true);
+
+	// NOTE(bruno): the audio thread hasn't even picked it up yet
+	getSound(&gameMemory, &assets, 2);
+	EXPECT_EQ(assets.slots[1].state, (uint32)AssetState_Loaded);
+	EXPECT_EQ(assets.slots[2].state, (uint32)AssetState_Unloaded);
+
+	g_testAudio = {};
+	applySoundCommands(&g_testSoundCommands, &g_testAudio);
+	int16 output[2 * 64];
+	GameSoundBuffer soundBuffer = {};
+	soundBuffer.sampleRate = 48000;
+	soundBuffer.sampleCount = 64;
+	soundBuffer.samples = output;
+	gameOutputSound(&soundBuffer, &g_testAudio);
+	getSound(&gameMemory, &assets, 2);
+	EXPECT_EQ(assets.slots[1].state, (uint32)AssetState_Loaded);
+	EXPECT_EQ(assets.slots[2].state, (uint32)AssetState_Unloaded);
+
+	// NOTE(bruno): the last samples play, after that it can go
+	gameOutputSound(&soundBuffer, &g_testAudio);
+	EXPECT_EQ(g_testAudio.playingSoundCount, 0u);
+	getSound(&gameMemory, &assets, 2);
+	EXPECT_EQ(assets.slots[1].state, (uint32)AssetState_Unloaded);
+	EXPECT_EQ(assets.slots[2].state, (uint32)AssetState_Loaded);
+}
+
+// NOTE(bruno): big, but the untouched thread buffers never get paged in
+global_variable DebugTable g_testDebugTable;
+
+DebugNode *findTestDebugChild(DebugTable *table, DebugFrame *frame,
+							  uint32 parent, const char *name) {
+	for (uint32 child = frame->nodes[parent].firstChild; child;
+		 child = frame->nodes[child].nextSibling) {
+		DebugNode *node = &frame->nodes[child];
+		if (isDebugStringEqual(table->sites[node->siteIndex].name,
+							   sizeof(table->sites[0].name), name)) {
+			return node;
+		}
+	}
+	return 0;
+}
+
+uint32 findTestDebugThreadRoot(DebugFrame *frame) {
+	for (uint32 i = 0; i < DEBUG_MAX_THREADS; i++) {
+		if (frame->threadRoots[i]) return frame->threadRoots[i];
+	}
+	return 0;
+}
+
+TEST(test_profiler_foldsBlocksIntoAHierarchy) {
+	DebugTable *table = &g_testDebugTable;
+	initializeDebugTable(table);
+	globalDebugTable = table;
+
+	for (int32 i = 0; i < 3; i++) {
+		TIMED_BLOCK("outer");
+		for (int32 j = 0; j < 2; j++) {
+			TIMED_BLOCK("inner");
+		}
+	}
+	endDebugFrame(table);
+
+	DebugFrame *frame = getLastDebugFrame(table);
+	uint32 root = findTestDebugThreadRoot(frame);
+	DebugNode *outer = findTestDebugChild(table, frame, root, "outer");
+	EXPECT_EQ(outer != 0, true);
+	EXPECT_EQ(outer->hitCount, 3u);
+
+	DebugNode *inner =
+		findTestDebugChild(table, frame, (uint32)(outer - frame->nodes),
+						   "inner");
+	EXPECT_EQ(inner != 0, true);
+	EXPECT_EQ(inner->hitCount, 6u);
+	EXPECT_EQ(inner->cycles <= outer->cycles, true);
+	EXPECT_EQ(outer->selfCycles, outer->cycles - inner->cycles);
+	EXPECT_EQ(frame->nodes[root].cycles, outer->cycles);
+
+	// NOTE(bruno): a block open across the end of a frame shows up in both,
+	// but only counts as a hit in the one it ends in
+	{
+		TIMED_BLOCK("spanning");
+		endDebugFrame(table);
+	}
+	endDebugFrame(table);
+	globalDebugTable = 0;
+
+	DebugFrame *first = &table->frames[(table->frameCount - 2) %
+									   DEBUG_FRAME_COUNT];
+	DebugNode *spanning = findTestDebugChild(
+		table, first, findTestDebugThreadRoot(first), "spanning");
+	EXPECT_EQ(spanning != 0, true);
+	EXPECT_EQ(spanning->hitCount, 0u);
+	EXPECT_EQ(spanning->cycles > 0, true);
+
+	DebugFrame *second = getLastDebugFrame(table);
+	spanning = findTestDebugChild(table, second,
+								  findTestDebugThreadRoot(second), "spanning");
+	EXPECT_EQ(spanning != 0, true);
+	EXPECT_EQ(spanning->hitCount, 1u);
+}
+
+global_variable DebugTraceRing g_testTraceRing;
+
+TEST(test_profiler_feedsTheTraceWhileCapturing) {
+	DebugTable *table = &g_testDebugTable;
+	initializeDebugTable(table);
+	globalDebugTable = table;
+
+	DebugTraceRing *ring = &g_testTraceRing;
+	*ring = {};
+	table->trace = ring;
+	uint32 frameNumber = (uint32)table->frameCount;
+	{
+		TIMED_BLOCK("traced");
+	}
+	endDebugFrame(table);
+
+	table->trace = 0;
+	{
+		TIMED_BLOCK("untraced");
+	}
+	endDebugFrame(table);
+	globalDebugTable = 0;
+
+	EXPECT_EQ(ring->writeIndex, 3u);
+	EXPECT_EQ(ring->droppedCount, 0u);
+
+	DebugTraceRecord *begin = &ring->records[0];
+	DebugTraceRecord *end = &ring->records[1];
+	DebugTraceRecord *frameEnd = &ring->records[2];
+	EXPECT_EQ(begin->type, (uint8)DebugTrace_BeginBlock);
+	EXPECT_EQ(isDebugStringEqual(table->sites[begin->siteIndex].name,
+								 sizeof(table->sites[0].name), "traced"),
+			  true);
+	EXPECT_EQ(end->type, (uint8)DebugTrace_EndBlock);
+	EXPECT_EQ(end->threadIndex, begin->threadIndex);
+	EXPECT_EQ(end->clock >= begin->clock, true);
+	EXPECT_EQ(frameEnd->type, (uint8)DebugTrace_FrameEnd);
+	EXPECT_EQ(frameEnd->siteIndex, frameNumber);
+	EXPECT_EQ(frameEnd->clock >= end->clock, true);
+}
+
+TEST(test_profiler_ranksSitesBySelfCycles) {
+	DebugTable *table = &g_testDebugTable;
+	initializeDebugTable(table);
+	globalDebugTable = table;
+
+	for (int32 i = 0; i < 2; i++) {
+		TIMED_BLOCK("parent");
+		volatile uint32 spin = 0;
+		for (uint32 j = 0; j < 20000; j++) spin += j;
+		{
+			TIMED_BLOCK("leaf");
+		}
+	}
+	{
+		TIMED_BLOCK("other");
+		TIMED_BLOCK("leaf");
+	}
+	endDebugFrame(table);
+	globalDebugTable = 0;
+
+	DebugFrame *frame = getLastDebugFrame(table);
+	DebugSiteTotal hottest[2];
+	uint32 count = getHottestDebugSites(table, frame, hottest, 2);
+	EXPECT_EQ(count, 2u);
+	EXPECT_EQ(isDebugStringEqual(table->sites[hottest[0].siteIndex].name,
+								 sizeof(table->sites[0].name), "parent"),
+			  true);
+	EXPECT_EQ(hottest[0].hitCount, 2u);
+	EXPECT_EQ(hottest[0].selfCycles >= hottest[1].selfCycles, true);
+
+	// NOTE(bruno): the leaf under both parents counts as one site
+	DebugSiteTotal all[8];
+	count = getHottestDebugSites(table, frame, all, 8);
+	uint32 leafHits = 0;
+	for (uint32 i = 0; i < count; i++) {
+		if (isDebugStringEqual(table->sites[all[i].siteIndex].name,
+							   sizeof(table->sites[0].name), "leaf")) {
+			leafHits += all[i].hitCount;
+		}
+	}
+	EXPECT_EQ(leafHits, 3u);
 }
 
 int main() {
@@ -171,6 +1104,28 @@ int main() {
 	RUN_TEST(test_recanonicalizePosition_tilemapYOverflow);
 	RUN_TEST(test_recanonicalizePosition_xUnderflow);
 	RUN_TEST(test_recanonicalizePosition_exactBoundary);
+	RUN_TEST(test_interpolateWorldPosition_crossesTilemaps);
+	RUN_TEST(test_getVisibleTileRange_coversOnlyTheBackbuffer);
+	RUN_TEST(test_wasButtonDown_usesTheTransitionTime);
+	RUN_TEST(test_simulatePlayer_movesWithTheAnalogStick);
+	RUN_TEST(test_rectangleRasterizers_blendClipAndSwizzle);
+	RUN_TEST(test_renderTexturedQuad_samplesAndBlends);
+	RUN_TEST(test_flowField_pathsAroundWalls);
+	RUN_TEST(test_flowField_repairsOnlyDirtyChunks);
+	RUN_TEST(test_flowField_repairMatchesARebuild);
+	RUN_TEST(test_worldgen_isDeterministic);
+	RUN_TEST(test_worldgen_doorsLineUpWithNeighbors);
+	RUN_TEST(test_soundCommandRing_fillsAndDrainsInOrder);
+	RUN_TEST(test_parseWAV_deinterleavesStereo);
+	RUN_TEST(test_mixer_clampsPansAndPadsWithSilence);
+	RUN_TEST(test_streamingSound_playsAcrossBuffersAndStops);
+	RUN_TEST(test_loadingWAV_parsesOnceTheReadIsDone);
+	RUN_TEST(test_assetPack_loadsSoundsOnFirstRequest);
+	RUN_TEST(test_assetPack_evictsLeastRecentlyUsed);
+	RUN_TEST(test_assetPack_keepsPlayingSoundsUntilTheyFinish);
+	RUN_TEST(test_profiler_foldsBlocksIntoAHierarchy);
+	RUN_TEST(test_profiler_feedsTheTraceWhileCapturing);
+	RUN_TEST(test_profiler_ranksSitesBySelfCycles);
 
 	printTestSummary(&g_testContext);
 